@@ -0,0 +1,20 @@
+# Adds the "simbench" target to [env:bench]: runs the benchmark firmware on
+# simavr until the stimulus script ends (the firmware then sleeps with
+# interrupts disabled, which makes simavr exit). The report is also kept in
+# simbench.log for the sizebudget target.
+import os
+
+Import("env")
+
+simavr = os.path.join(
+    env.PioPlatform().get_package_dir("tool-simavr") or "", "bin", "simavr")
+
+env.AddCustomTarget(
+    name="simbench",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions=[
+        '"%s" -m atmega328p -f 16000000 $BUILD_DIR/${PROGNAME}.elf'
+        ' | tee $BUILD_DIR/simbench.log' % simavr
+    ],
+    title="Simulated latency benchmark",
+    description="Run loop() latency probes on simavr")
@@ -0,0 +1,149 @@
+# Adds the "sizebudget" target: attributes flash and RAM to the libraries that
+# contributed them and fails when .data+.bss or the peak stack exceed the
+# custom_ram_budget / custom_stack_budget limits in platformio.ini.
+#
+# -flto merges all objects before code generation, so the linker map only names
+# LTO partitions. Symbols are therefore matched back to the archive (or src/
+# object) that defined them before LTO, and sized from the final ELF. The map
+# file is used for the list of archive members the linker actually pulled in.
+#
+# Peak stack is a runtime figure: it is taken from the last simbench report
+# ("stack peak=" line) when one exists, so run
+#   pio run -e bench -t simbench -t sizebudget
+# to check both limits. Without a report only the static RAM limit is checked.
+import os
+import re
+import subprocess
+
+Import("env")
+
+LTO_SUFFIX = re.compile(r"\.(lto_priv|constprop|isra|part)\.\d+")
+MAP_MEMBER = re.compile(r"^\S*?([^/\s]+\.a)\(")
+
+
+def tool(name):
+    return env.subst("$CC").replace("gcc", name)
+
+
+def run(args):
+    return subprocess.run(args, check=True, capture_output=True,
+                          text=True).stdout.splitlines()
+
+
+def owner_name(path, build_dir):
+    if path.endswith(".a"):
+        name = os.path.basename(path)[:-2]
+        return name[3:] if name.startswith("lib") else name
+    return os.path.relpath(os.path.dirname(path), build_dir)
+
+
+def symbol_owners(build_dir):
+    owners = {}
+    for root, _, files in os.walk(build_dir):
+        for name in files:
+            if not name.endswith((".a", ".o")):
+                continue
+            path = os.path.join(root, name)
+            # gcc-nm reads the symbol tables of LTO objects
+            for line in run([tool("gcc-nm"), "--defined-only", path]):
+                parts = line.split()
+                if len(parts) == 3:
+                    owners.setdefault(parts[2], owner_name(path, build_dir))
+    return owners
+
+
+def linked_archives(map_path):
+    archives = set()
+    if not os.path.isfile(map_path):
+        return archives
+    with open(map_path) as f:
+        for line in f:
+            if line.startswith("Memory Configuration"):
+                break
+            m = MAP_MEMBER.match(line)
+            if m:
+                archives.add(m.group(1))
+    return archives
+
+
+def attribute(elf, owners):
+    usage = {}
+    for line in run([tool("nm"), "--size-sort", "-S", elf]):
+        parts = line.split()
+        if len(parts) != 4:
+            continue
+        size, kind, name = int(parts[1], 16), parts[2].lower(), parts[3]
+        owner = owners.get(LTO_SUFFIX.sub("", name), "toolchain")
+        flash, ram = usage.get(owner, (0, 0))
+        if kind in "tr":
+            flash += size
+        elif kind == "d":
+            flash += size
+            ram += size
+        elif kind == "b":
+            ram += size
+        usage[owner] = (flash, ram)
+    return usage
+
+
+def section_sizes(elf):
+    sizes = {}
+    for line in run([tool("size"), "-A", elf]):
+        parts = line.split()
+        if len(parts) == 3 and parts[0].startswith("."):
+            sizes[parts[0]] = int(parts[1])
+    return sizes
+
+
+def last_stack_peak(build_dir):
+    log = os.path.join(build_dir, "simbench.log")
+    if not os.path.isfile(log):
+        return None
+    peak = None
+    with open(log) as f:
+        for line in f:
+            m = re.search(r"stack peak=(\d+)", line)
+            if m:
+                peak = int(m.group(1))
+    return peak
+
+
+def check_budget(target, source, env):
+    build_dir = env.subst("$BUILD_DIR")
+    elf = env.subst("$BUILD_DIR/${PROGNAME}.elf")
+    ram_budget = int(env.GetProjectOption("custom_ram_budget"))
+    stack_budget = int(env.GetProjectOption("custom_stack_budget"))
+
+    usage = attribute(elf, symbol_owners(build_dir))
+    print("%-24s %8s %8s" % ("owner", "flash", "ram"))
+    for owner, (flash, ram) in sorted(usage.items(), key=lambda i: -i[1][0]):
+        print("%-24s %8d %8d" % (owner, flash, ram))
+    archives = linked_archives(os.path.join(build_dir, "firmware.map"))
+    if archives:
+        print("archives linked: " + ", ".join(sorted(archives)))
+
+    sizes = section_sizes(elf)
+    static_ram = sizes.get(".data", 0) + sizes.get(".bss", 0)
+    failed = False
+    print("static RAM (.data+.bss): %d / %d bytes" % (static_ram, ram_budget))
+    if static_ram > ram_budget:
+        print("FAIL: static RAM over budget")
+        failed = True
+
+    peak = last_stack_peak(build_dir)
+    if peak is None:
+        print("peak stack: no simbench report, not checked")
+    else:
+        print("peak stack: %d / %d bytes" % (peak, stack_budget))
+        if peak > stack_budget:
+            print("FAIL: peak stack over budget")
+            failed = True
+    return 1 if failed else 0
+
+
+env.AddCustomTarget(
+    name="sizebudget",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions=[check_budget],
+    title="Size budget",
+    description="Per-library flash/RAM use and the RAM/stack budget check")
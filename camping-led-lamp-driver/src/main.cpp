@@ -1,20 +1,22 @@
 #include <Arduino.h>
-#include <Wire.h>
 #include <U8g2lib.h>
-#include <Encoder.h>
-#include <Bounce2.h>
 #include <IRremote.h>
-// NEW: Include libraries for the temperature sensor
-#include <OneWire.h>
-#include <DallasTemperature.h>
 // AVR sleep control
 #include <avr/sleep.h>
+#include <avr/eeprom.h>
+#include <avr/wdt.h>
+#include <util/crc16.h>
+#include <util/atomic.h>
 
 // --- Pin Definitions ---
 #define ENCODER_PIN_A 2
 #define ENCODER_PIN_B 3
 #define ENCODER_SWITCH_PIN 4
 #define PWM_OUTPUT_PIN 9
+// NEW: Warm white LED channel on OC1B; PWM_OUTPUT_PIN drives the cool one
+#define PWM_WARM_PIN 10
+// Timer1 fast PWM TOP (ICR1): 10-bit, 15.6 kHz. Another 4 bits come from dithering.
+#define PWM_TOP 1023
 #define IR_RECEIVE_PIN 7
 #define VOLTAGE_SENSE_PIN A1
 // NEW: Pin for the DS18B20 temperature sensor
@@ -29,25 +31,266 @@
 #define IR_CODE_PRESET_2 0xB946FF00
 #define IR_CODE_PRESET_3 0xB847FF00
 #define IR_CODE_PRESET_4 0xBB44FF00
+// NEW: Keys 1, 3, 7 and 9 start (or stop) the built-in light scenes
+#define IR_CODE_SCENE_1 0xF30CFF00
+#define IR_CODE_SCENE_2 0xA15EFF00
+#define IR_CODE_SCENE_3 0xBD42FF00
+#define IR_CODE_SCENE_4 0xB54AFF00
+// NEW: Keys 4 and 6 make the light warmer or cooler
+#define IR_CODE_WARMER 0xF708FF00
+#define IR_CODE_COOLER 0xA55AFF00
+// NEW: Address << 8 | command of a raw NEC code, as carried by IR input events
+#define IR_COMMAND(code) ((uint16_t)((((code) & 0xFF) << 8) | (((code) >> 16) & 0xFF)))
 
 
 // --- OLED Display Setup ---
-U8G2_SSD1306_128X64_NONAME_1_HW_I2C u8g2(U8G2_R0, U8X8_PIN_NONE);
+// MODIFIED: The SSD1306 runs on our own TWI driver instead of Wire. U8g2 renders one
+// 8-row page at a time into its page buffer; the page is copied out and sent by the
+// TWI interrupt while loop() carries on (see serviceDisplay()). U8g2's own commands
+// (init, power save) still go through the blocking byte callback below.
+const uint8_t OLED_PAGES = 8;
+const uint8_t OLED_WIDTH = 128;
+// Per-page header: column high/low = 0, page address, then the data control byte
+const uint8_t OLED_PAGE_HEADER = 7;
+const uint32_t OLED_I2C_CLOCK = 400000;
+
+uint8_t twiBuffer[OLED_PAGE_HEADER + OLED_WIDTH];
+uint8_t twiAddress = 0x78; // 8-bit write address, taken from U8g2 at init
+volatile uint8_t twiLength = 0;
+volatile uint8_t twiIndex = 0;
+volatile bool twiBusy = false;
+volatile uint8_t twiPage = 0;
+volatile uint16_t twiErrors = 0;
+// Bit n set = page n still has to be rendered and sent for the requested frame
+volatile uint8_t displayDirtyPages = 0;
+// Column window [first, end) of the dirty pages still to be sent
+volatile uint8_t displayColumnFirst = OLED_WIDTH;
+volatile uint8_t displayColumnEnd = 0;
+
+void twiInit() {
+    // Internal pull-ups, like Wire.begin()
+    digitalWrite(SDA, HIGH);
+    digitalWrite(SCL, HIGH);
+    TWSR = 0; // prescaler 1
+    TWBR = ((F_CPU / OLED_I2C_CLOCK) - 16) / 2;
+    TWCR = _BV(TWEN);
+}
+
+void twiWaitIdle() {
+    while (twiBusy);
+    while (TWCR & _BV(TWSTO)); // previous STOP still on the bus
+}
+
+// Blocking byte-level helpers for U8g2's command traffic (TWI interrupt disabled)
+void twiPolledCommand(uint8_t twcr) {
+    TWCR = twcr;
+    while (!(TWCR & _BV(TWINT)));
+}
+
+void twiPolledWrite(uint8_t data) {
+    TWDR = data;
+    twiPolledCommand(_BV(TWINT) | _BV(TWEN));
+}
+
+extern "C" uint8_t u8x8_byte_lamp_twi(u8x8_t* u8x8, uint8_t msg, uint8_t arg_int, void* arg_ptr) {
+    switch (msg) {
+        case U8X8_MSG_BYTE_INIT:
+            twiAddress = u8x8_GetI2CAddress(u8x8);
+            twiInit();
+            break;
+        case U8X8_MSG_BYTE_START_TRANSFER:
+            twiWaitIdle();
+            twiPolledCommand(_BV(TWINT) | _BV(TWEN) | _BV(TWSTA));
+            twiPolledWrite(twiAddress);
+            break;
+        case U8X8_MSG_BYTE_SEND:
+            for (uint8_t i = 0; i < arg_int; i++) {
+                twiPolledWrite(((uint8_t*)arg_ptr)[i]);
+            }
+            break;
+        case U8X8_MSG_BYTE_END_TRANSFER:
+            TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);
+            break;
+        case U8X8_MSG_BYTE_SET_DC:
+            break;
+        default:
+            return 0;
+    }
+    return 1;
+}
+
+ISR(TWI_vect) {
+    switch (TWSR & 0xF8) {
+        case 0x08: // START sent
+            TWDR = twiAddress;
+            TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE);
+            break;
+        case 0x18: // SLA+W acknowledged
+        case 0x28: // data byte acknowledged
+            if (twiIndex < twiLength) {
+                TWDR = twiBuffer[twiIndex++];
+                TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE);
+            } else {
+                TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);
+                twiBusy = false;
+            }
+            break;
+        default: // NACK, arbitration lost or bus error: release the bus and resend the page
+            TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);
+            displayDirtyPages |= _BV(twiPage);
+            twiErrors++;
+            twiBusy = false;
+            break;
+    }
+}
+
+class U8G2_SSD1306_128X64_NONAME_1_LAMP_TWI : public U8G2 {
+  public:
+    U8G2_SSD1306_128X64_NONAME_1_LAMP_TWI(const u8g2_cb_t* rotation) : U8G2() {
+        u8g2_Setup_ssd1306_i2c_128x64_noname_1(&u8g2, rotation, u8x8_byte_lamp_twi, u8x8_gpio_and_delay_arduino);
+    }
+};
+U8G2_SSD1306_128X64_NONAME_1_LAMP_TWI u8g2(U8G2_R0);
 
 // --- Input Component Setup ---
-Encoder myEncoder(ENCODER_PIN_A, ENCODER_PIN_B);
-Bounce debouncer = Bounce();
+// MODIFIED: Inputs are event driven. The PCINT2 interrupt decodes the encoder
+// quadrature and debounces the button, and pushes typed, timestamped events into
+// a fixed-size ring that handleInputs() drains on the next pass. The ring is
+// single-producer/single-consumer with one-byte head and tail indices that
+// each side updates atomically. The Encoder and Bounce2 libraries are gone.
+// The IRremote receive-complete callback runs in the library's Timer2 interrupt,
+// which must stay shorter than a 1-Wire slot, so it only timestamps the frame.
+// The receiver holds the frame until resume(), and handleInputs() decodes it
+// (NEC, repeats included) after the ring.
+enum InputEventType : uint8_t {
+  INPUT_ENCODER,      // value: quadrature steps (int8)
+  INPUT_BUTTON_DOWN,
+  INPUT_BUTTON_UP,
+  INPUT_IR            // value: NEC address << 8 | command
+};
+const uint8_t INPUT_FLAG_REPEAT = 0x01;  // NEC repeat frame
+
+struct InputEvent {
+  InputEventType type;
+  uint8_t flags;
+  uint16_t value;
+  uint16_t timeMs;    // low 16 bits of millis() when it happened
+};
 
-// NEW: Setup for the temperature sensor
-OneWire oneWire(ONEWIRE_BUS_PIN);
-DallasTemperature sensors(&oneWire);
+const uint8_t INPUT_QUEUE_SIZE = 16;          // power of two
+const uint16_t BUTTON_DEBOUNCE_MS = 25;
+// Pins 0..7 are PD0..PD7 and PCINT16..23 on the Nano, so bit n of PIND/PCMSK2 is pin n
+const uint8_t INPUT_ENCODER_MASK = _BV(ENCODER_PIN_A) | _BV(ENCODER_PIN_B);
+const uint8_t INPUT_BUTTON_MASK = _BV(ENCODER_SWITCH_PIN);
+
+InputEvent inputQueue[INPUT_QUEUE_SIZE];
+volatile uint8_t inputHead = 0;               // written by the producers only
+volatile uint8_t inputTail = 0;               // written by handleInputs() only
+volatile int16_t inputEncoderOverflow = 0;    // steps that found the ring full
+volatile uint8_t inputDropped = 0;
+volatile bool wokeByPin = false;              // any PCINT2 edge (see Idle Power Management)
+
+uint8_t encoderState = 0;                     // last A/B levels (ISR)
+bool buttonReportedUp = true;                 // debounced level (ISR, or loop with interrupts off)
+uint16_t buttonLastEdge = 0;
+
+// Encoder position in quadrature steps (4 per detent), owned by the loop
+long encoderPosition = 0;
+
+// Interrupt context only
+bool pushInputEvent(InputEventType type, uint8_t flags, uint16_t value) {
+    uint8_t head = inputHead;
+    uint8_t next = (head + 1) & (INPUT_QUEUE_SIZE - 1);
+    if (next == inputTail) {
+        inputDropped++;
+        return false;
+    }
+    InputEvent& event = inputQueue[head];
+    event.type = type;
+    event.flags = flags;
+    event.value = value;
+    event.timeMs = millis();
+    inputHead = next;
+    return true;
+}
+
+bool popInputEvent(InputEvent& event) {
+    uint8_t tail = inputTail;
+    if (tail == inputHead) return false;
+    event = inputQueue[tail];
+    inputTail = (tail + 1) & (INPUT_QUEUE_SIZE - 1);
+    return true;
+}
+
+// Index: new B, new A, old B, old A. Same direction and 4 steps per detent as the Encoder library.
+const int8_t QUADRATURE_STEP[16] = { 0, 1, -1, 0, -1, 0, 0, 1, 1, 0, 0, -1, 0, -1, 1, 0 };
+
+ISR(PCINT2_vect) {
+    uint8_t pins = PIND;
+    wokeByPin = true;
+
+    uint8_t ab = ((pins & _BV(ENCODER_PIN_A)) ? 1 : 0) | ((pins & _BV(ENCODER_PIN_B)) ? 2 : 0);
+    int8_t step = QUADRATURE_STEP[(ab << 2) | encoderState];
+    encoderState = ab;
+    if (step != 0 && !pushInputEvent(INPUT_ENCODER, 0, (uint16_t)step)) inputEncoderOverflow += step;
+
+    // Lockout debounce: report the first edge at once, ignore the bounce after it
+    bool up = pins & INPUT_BUTTON_MASK;
+    uint16_t now = millis();
+    if (up != buttonReportedUp && (uint16_t)(now - buttonLastEdge) >= BUTTON_DEBOUNCE_MS) {
+        buttonReportedUp = up;
+        buttonLastEdge = now;
+        pushInputEvent(up ? INPUT_BUTTON_UP : INPUT_BUTTON_DOWN, 0, 0);
+    }
+}
+
+volatile bool irFrameReady = false;
+volatile uint16_t irFrameTimeMs = 0;
+
+// Called by IRremote from its timer interrupt when a frame is complete
+void irReceiveComplete() {
+    irFrameTimeMs = millis();
+    irFrameReady = true;
+}
+
+// Loop side: decodes the completed frame, if any, into an INPUT_IR event
+bool takeIrFrame(InputEvent& event) {
+    if (!irFrameReady) return false;
+    irFrameReady = false;
+    bool isNec = IrReceiver.decode() && IrReceiver.decodedIRData.protocol == NEC;
+    if (isNec) {
+        const IRData& data = IrReceiver.decodedIRData;
+        event.type = INPUT_IR;
+        event.flags = (data.flags & IRDATA_FLAGS_IS_REPEAT) ? INPUT_FLAG_REPEAT : 0;
+        event.value = (data.address & 0xFF) << 8 | (data.command & 0xFF);
+        event.timeMs = irFrameTimeMs;
+    }
+    IrReceiver.resume();
+    return isNec;
+}
+
+void startInputPipeline() {
+    pinMode(ENCODER_PIN_A, INPUT_PULLUP);
+    pinMode(ENCODER_PIN_B, INPUT_PULLUP);
+    pinMode(ENCODER_SWITCH_PIN, INPUT_PULLUP);
+    delayMicroseconds(10); // let the pull-ups charge the lines
+    uint8_t pins = PIND;
+    encoderState = ((pins & _BV(ENCODER_PIN_A)) ? 1 : 0) | ((pins & _BV(ENCODER_PIN_B)) ? 2 : 0);
+    buttonReportedUp = pins & INPUT_BUTTON_MASK;
+
+    PCMSK2 = INPUT_ENCODER_MASK | INPUT_BUTTON_MASK;
+    PCIFR = _BV(PCIF2);
+    PCICR |= _BV(PCIE2);
+    IrReceiver.registerReceiveCompleteCallback(irReceiveComplete);
+}
 
 
 // --- UI State Machine Definition ---
 enum LampMode {
   MODE_SMOOTH_DIM,
   MODE_PRESET_SELECT,
-  MODE_STATS
+  MODE_STATS,
+  MODE_COLOR_TEMP  // NEW: warm/cool mix
 };
 LampMode currentMode = MODE_SMOOTH_DIM;
 
@@ -73,462 +316,3747 @@ bool low10Handled = false;
 // NEW: track whether we've already signaled an overheat condition with the flash pattern
 bool overheatFlashDone = false;
 
-int highlightedPreset = 0;
-const int presets[] = {10, 25, 50, 100};
+int highlightedPreset = 0;   // MODIFIED: 0-3 presets, then the light scenes
+// MODIFIED: Presets are user-editable and persisted with the other settings
+int presets[] = {10, 25, 50, 100};
+bool isEditingPreset = false;
+const unsigned long PRESET_EDIT_HOLD_MS = 3000;
+// NEW: A saved preset is confirmed with a couple of blinks at its new level
+const uint8_t PRESET_SAVED_BLINKS = 2;
+const uint16_t PRESET_SAVED_BLINK_MS = 300;
+// NEW: Turning the encoder in stats mode flips to the hidden diagnostics page. It
+// takes several detents the same way, so a knock on the knob does not flip it.
+bool isShowingDiagnostics = false;
+const uint8_t DIAGNOSTICS_DETENTS = 3;
+
+// NEW: Fixed-point units. Battery voltage is kept in millivolts and temperature in
+// hundredths of a degree C, so sensor math, thresholds and display formatting are
+// all integer and the AVR soft-float library is not linked.
+typedef uint16_t millivolts_t;
+typedef int16_t centiC_t;
+// Compile-time conversion of a degree C literal; never use with runtime values
+#define DEG_C(c) ((centiC_t)((c) * 100))
+
+// Round to the 0.1 C / 0.01 V resolution the display shows
+int16_t centiCToDeciC(centiC_t value) {
+    return (value + (value < 0 ? -5 : 5)) / 10;
+}
+
+uint16_t millivoltsToCentiVolts(millivolts_t value) {
+    return (value + 5) / 10;
+}
+
+// Format a temperature with one decimal, e.g. "65.3"
+const uint8_t CENTI_C_TEXT_SIZE = 7;    // "-327.7" and the terminator
+void formatCentiC(char* out, centiC_t value) {
+    int16_t deci = centiCToDeciC(value);
+    const char* sign = deci < 0 ? "-" : "";
+    if (deci < 0) deci = -deci;
+    sprintf(out, "%s%d.%d", sign, deci / 10, deci % 10);
+}
+
+// Format a voltage with two decimals, e.g. "7.82"
+const uint8_t MILLIVOLTS_TEXT_SIZE = 7; // "655.35" and the terminator
+void formatMillivolts(char* out, millivolts_t value) {
+    uint16_t centiVolts = millivoltsToCentiVolts(value);
+    sprintf(out, "%u.%02u", centiVolts / 100, centiVolts % 100);
+}
 
 // Variables for battery monitoring
-float batteryVoltage = 0.0;
+millivolts_t batteryMillivolts = 0;
+millivolts_t batteryMeasuredMillivolts = 0; // NEW: before the end-of-charge calibration
+millivolts_t batteryFullChargeMv = 0;       // NEW: measured at the last end of charge, 0 = none
+millivolts_t batteryOcvMillivolts = 0; // NEW: with the load sag removed
 int batteryPercent = 0;
 
 // NEW: Variable for temperature monitoring
-float ledTemperature = 0.0;
+centiC_t ledTemperature = 0;
+bool ledTemperatureFresh = false; // set per new reading, consumed by the thermal governor
+// NEW: Interrupt-off time of the last DS18B20 transaction: total and longest slot
+uint16_t tempBusIrqOffUs = 0;
+uint8_t tempBusSlotMaxUs = 0;
+uint16_t tempBusTimingRevision = 0;   // bumped whenever either figure changes, for the display
+
+// NEW: Staged boot: what setup() leaves for loop() to start, and the boot timings
+enum BootStage : uint8_t {
+  BOOT_DISPLAY,
+  BOOT_IR,
+  BOOT_SENSOR,
+  BOOT_DONE
+};
+BootStage bootStage = BOOT_DISPLAY;
+bool displayReady = false;              // OLED initialized; pages may be sent
+volatile uint32_t bootFirstLightUs = 0; // sketch start until OCR1A first lit the LED
+uint32_t bootFirstFrameUs = 0;          // sketch start until the first frame was shown
+
+// Tenths below 100 ms, e.g. "3.2ms", whole ms (at most 9999) above
+const uint8_t BOOT_MS_TEXT_SIZE = 7;    // "9999ms" and the terminator
+void formatBootMs(char* out, uint32_t us) {
+    uint32_t tenths = us / 100;
+    if (tenths < 1000) sprintf(out, "%u.%ums", (uint16_t)(tenths / 10), (uint16_t)(tenths % 10));
+    else sprintf(out, "%ums", (uint16_t)min(us / 1000, 9999UL));
+}
+
+// NEW: Progress through the non-blocking low-battery shutdown sequence
+enum LowBatteryPhase {
+  LOW_BATTERY_START,
+  LOW_BATTERY_FLASHING,
+  LOW_BATTERY_DIMMING,
+  LOW_BATTERY_MESSAGE
+};
+LowBatteryPhase lowBatteryPhase = LOW_BATTERY_START;
+unsigned long lowBatteryPhaseStart = 0;
+const uint16_t LOW_BATTERY_DIM_MS = 2000;   // the light fades out after the flashes
+
+// Battery scale: 1.1V bandgap * 7.8 divider ratio, and the open-circuit voltage at 0%
+const uint16_t BATTERY_MV_PER_BANDGAP = 8580;
+const millivolts_t BATTERY_EMPTY_MV = 6400;
 
 // NEW: Overheat supervisory condition (two-level)
+// MODIFIED: Warn now means the thermal governor is limiting the output
 bool isOverheatWarn = false;
 bool isOverheatCritical = false;
+bool isChargeLimited = false;     // NEW: the charging cap, not the heat, is limiting the output
+uint8_t brightnessCeiling = 100;  // NEW: the highest brightness the output limits allow
 // Thresholds (safety oriented):
-const float TEMP_WARN_C = 65.0;      // Enter derate mode at or above this temp
-const float TEMP_OVERHEAT_C = 75.0;  // Enter hard cutoff at or above this temp
-const float TEMP_RECOVER_C = 55.0;   // Recover to normal below this temp
+const centiC_t TEMP_OVERHEAT_C = DEG_C(75);  // Enter hard cutoff at or above this temp
+const centiC_t TEMP_RECOVER_C = DEG_C(55);   // Recover to normal below this temp
+
+// NEW: --- RAM Instrumentation ---
+// Everything between the end of .bss and the initial stack pointer is painted with a
+// canary before constructors run. The stack grows down into that area, so the lowest
+// overwritten byte is the deepest the stack has ever reached. Nothing uses the heap.
+extern uint8_t __heap_start;  // provided by the linker: end of .data + .bss
+const uint8_t STACK_CANARY = 0xC5;
+const uint16_t SRAM_BYTES = RAMEND + 1 - RAMSTART;
+
+// Runs from .init3, after the stack pointer and zero register are set up
+void paintStack() __attribute__((naked, used, section(".init3")));
+void paintStack() {
+    uint8_t* p = &__heap_start;
+    while (p < (uint8_t*)(uintptr_t)SP) *p++ = STACK_CANARY;
+}
+
+uint16_t staticRamBytes() {
+    return (uint16_t)(uintptr_t)&__heap_start - RAMSTART;
+}
+
+// Bytes above .bss the stack has never touched
+uint16_t stackUntouchedBytes() {
+    const uint8_t* p = &__heap_start;
+    while (p <= (const uint8_t*)(uintptr_t)RAMEND && *p == STACK_CANARY) p++;
+    return p - &__heap_start;
+}
+
+uint16_t stackPeakBytes() {
+    return SRAM_BYTES - staticRamBytes() - stackUntouchedBytes();
+}
+
+// Sampled every battery tick; the scan is too long to repeat on every display pass
+uint16_t stackPeak = 0;
+
+// NEW: --- UART Driver ---
+// USART0 with its own interrupt-driven RX and TX rings (HardwareSerial is not linked).
+// uartWrite() never waits: callers check uartTxRoom() first. Text printed through
+// uartText (only the bench report) is the exception and waits for room.
+#define UART_RX_PIN 0
+const uint8_t UART_RX_SIZE = 32;  // powers of two
+const uint8_t UART_TX_SIZE = 64;
+uint8_t uartRxBuffer[UART_RX_SIZE];
+uint8_t uartTxBuffer[UART_TX_SIZE];
+volatile uint8_t uartRxHead = 0;
+volatile uint8_t uartRxTail = 0;
+volatile uint8_t uartTxHead = 0;
+volatile uint8_t uartTxTail = 0;
+volatile uint8_t uartRxDropped = 0;  // bytes lost to a full ring or a framing error
+
+void startUart(unsigned long baud) {
+    UCSR0A = _BV(U2X0);
+    UBRR0 = (F_CPU / 4 / baud - 1) / 2;
+    UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);  // 8N1
+    UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
+}
+
+ISR(USART_RX_vect) {
+    bool framingError = UCSR0A & _BV(FE0);
+    uint8_t value = UDR0;
+    uint8_t next = (uartRxHead + 1) & (UART_RX_SIZE - 1);
+    if (framingError || next == uartRxTail) {
+        if (uartRxDropped < 0xFF) uartRxDropped++;
+        return;
+    }
+    uartRxBuffer[uartRxHead] = value;
+    uartRxHead = next;
+}
+
+ISR(USART_UDRE_vect) {
+    if (uartTxTail == uartTxHead) {
+        UCSR0B &= ~_BV(UDRIE0);
+        return;
+    }
+    UDR0 = uartTxBuffer[uartTxTail];
+    uartTxTail = (uartTxTail + 1) & (UART_TX_SIZE - 1);
+}
+
+// Next received byte, or -1
+int uartRead() {
+    if (uartRxTail == uartRxHead) return -1;
+    uint8_t value = uartRxBuffer[uartRxTail];
+    uartRxTail = (uartRxTail + 1) & (UART_RX_SIZE - 1);
+    return value;
+}
+
+bool uartRxPending() {
+    return uartRxTail != uartRxHead;
+}
+
+uint8_t uartTxRoom() {
+    return (uartTxTail - uartTxHead - 1) & (UART_TX_SIZE - 1);
+}
+
+bool isUartTxIdle() {
+    return uartTxTail == uartTxHead;
+}
+
+// Caller has checked uartTxRoom()
+void uartWrite(uint8_t value) {
+    uartTxBuffer[uartTxHead] = value;
+    uartTxHead = (uartTxHead + 1) & (UART_TX_SIZE - 1);
+    UCSR0B |= _BV(UDRIE0);
+}
+
+class UartText : public Print {
+public:
+    size_t write(uint8_t value) override {
+        while (uartTxRoom() == 0) {}
+        uartWrite(value);
+        return 1;
+    }
+};
+UartText uartText;
+
+// Frames in both directions: 0xA5, type, payload length, payload, CRC-8 (the
+// settings journal's polynomial) over type, length and payload.
+const uint8_t FRAME_SYNC = 0xA5;
+const uint8_t FRAME_MAX_PAYLOAD = 16;
+const uint8_t FRAME_OVERHEAD = 4;
+
+enum FrameType : uint8_t {
+  // Host to lamp
+  FRAME_SET_BRIGHTNESS = 0x01,    // [percent]
+  FRAME_SELECT_PRESET = 0x02,     // [index 0-3]
+  FRAME_TOGGLE_POWER = 0x03,
+  FRAME_QUERY_STATE = 0x04,       // answered with FRAME_STATE
+  FRAME_TELEMETRY = 0x05,         // [period in 100 ms, 0 = stop]
+  FRAME_LOG_DUMP = 0x06,          // answered with FRAME_LOG_CHUNKs
+  FRAME_SET_FADE_RATE = 0x07,     // [percent per second, 1-1000 (word)], saved with the settings
+  // Lamp to host
+  FRAME_ACK = 0x80,               // [command, status]
+  FRAME_STATE = 0x81,
+  FRAME_TELEMETRY_SAMPLE = 0x82,
+  FRAME_LOG_CHUNK = 0x83          // up to 16 dump bytes, empty = end of dump
+};
+
+bool canSendFrame(uint8_t length) {
+    return uartTxRoom() >= FRAME_OVERHEAD + length;
+}
+
+// Caller has checked canSendFrame()
+void sendFrame(uint8_t type, const uint8_t* payload, uint8_t length) {
+    uint8_t crc = _crc8_ccitt_update(_crc8_ccitt_update(0, type), length);
+    uartWrite(FRAME_SYNC);
+    uartWrite(type);
+    uartWrite(length);
+    for (uint8_t i = 0; i < length; i++) {
+        uartWrite(payload[i]);
+        crc = _crc8_ccitt_update(crc, payload[i]);
+    }
+    uartWrite(crc);
+}
+
+
+// NEW: Cycle-accurate latency benchmark (built only in the [env:bench] environment).
+// Timer1 overflows are counted so overflows * (ICR1 + 1) + TCNT1 gives CPU cycles.
+// Each probe keeps its worst case exactly and a half-octave histogram for median/p99.
+#ifdef LAMP_BENCH
+enum BenchProbe {
+  BENCH_LOOP,
+  BENCH_DRAW,
+  BENCH_BATTERY,
+  BENCH_TEMP,
+  BENCH_INPUTS,
+  BENCH_FRAME,  // frame request until the last page has left the TWI driver
+  BENCH_PROBE_COUNT
+};
+const char* const benchProbeNames[BENCH_PROBE_COUNT] = {
+  "loop", "drawDisplay", "updateBatteryStats", "updateTemperature", "handleInputs",
+  "frameLatency"
+};
+const uint8_t BENCH_BUCKETS = 32;
+volatile uint32_t benchOverflows = 0;
+uint16_t benchHistogram[BENCH_PROBE_COUNT][BENCH_BUCKETS];
+uint32_t benchWorst[BENCH_PROBE_COUNT];
+uint16_t benchSamples[BENCH_PROBE_COUNT];
+uint32_t benchFrameStart = 0;
+// NEW: 1-Wire slot timing as the driver itself measured it, in cycles, over the run
+uint16_t benchWrite0MinCycles = 0xFFFF, benchWrite0MaxCycles = 0;
+uint16_t benchPresenceMinCycles = 0xFFFF, benchPresenceMaxCycles = 0, benchReadMaxCycles = 0;
+// Scripted stimulus state consumed by the input and sensor paths
+uint32_t benchPendingIrCode = 0;
+int benchBatteryOverrideMv = -1;
+int benchTempOverrideCentiC = INT16_MIN;
+
+uint32_t benchCycles() {
+  uint8_t sreg = SREG;
+  cli();
+  uint32_t overflows = benchOverflows;
+  uint16_t count = TCNT1;
+  // An overflow that is pending but not yet serviced belongs to this reading
+  if ((TIFR1 & _BV(TOV1)) && count < (ICR1 >> 1)) overflows++;
+  SREG = sreg;
+  return overflows * (ICR1 + 1UL) + count;
+}
+
+// Half-octave buckets: bucket 0 holds < 64 cycles, then two buckets per power of two.
+uint8_t benchBucket(uint32_t cycles) {
+  if (cycles < 64) return 0;
+  uint8_t msb = 31;
+  while (!(cycles & (1UL << msb))) msb--;
+  uint8_t bucket = (msb - 6) * 2 + ((cycles >> (msb - 1)) & 1) + 1;
+  return bucket < BENCH_BUCKETS ? bucket : BENCH_BUCKETS - 1;
+}
+
+uint32_t benchBucketUpperBound(uint8_t bucket) {
+  if (bucket == 0) return 63;
+  uint8_t msb = (bucket - 1) / 2 + 6;
+  return (1UL << msb) + ((bucket - 1) % 2 + 1) * (1UL << (msb - 1)) - 1;
+}
+
+void benchRecord(BenchProbe probe, uint32_t cycles) {
+  if (cycles > benchWorst[probe]) benchWorst[probe] = cycles;
+  uint16_t& slot = benchHistogram[probe][benchBucket(cycles)];
+  if (slot < 0xFFFF) slot++;
+  if (benchSamples[probe] < 0xFFFF) benchSamples[probe]++;
+}
+
+uint32_t benchPercentile(BenchProbe probe, uint8_t percent) {
+  uint32_t threshold = ((uint32_t)benchSamples[probe] * percent + 99) / 100;
+  uint32_t seen = 0;
+  for (uint8_t b = 0; b < BENCH_BUCKETS; b++) {
+    seen += benchHistogram[probe][b];
+    if (seen >= threshold && seen > 0) return benchBucketUpperBound(b);
+  }
+  return 0;
+}
+
+void benchReportPolls();
+
+void benchReport() {
+  for (uint8_t p = 0; p < BENCH_PROBE_COUNT; p++) {
+    uartText.print(benchProbeNames[p]);
+    uartText.print(F(": n="));
+    uartText.print(benchSamples[p]);
+    uartText.print(F(" worst="));
+    uartText.print(benchWorst[p]);
+    uartText.print(F(" median<="));
+    uartText.print(benchPercentile((BenchProbe)p, 50));
+    uartText.print(F(" p99<="));
+    uartText.println(benchPercentile((BenchProbe)p, 99));
+  }
+  uartText.print(F("ds18b20 irq-off us: total="));
+  uartText.print(tempBusIrqOffUs);
+  uartText.print(F(" slot max="));
+  uartText.println(tempBusSlotMaxUs);
+  // NEW: Slot timing against the DS18B20 limits: a "0" held 60..120 us, presence
+  // sampled inside 60..75 us, a read sampled before 15 us. Untested if the bus
+  // never got past a reset.
+  const uint16_t us = F_CPU / 1000000UL;
+  bool slotsPass = benchWrite0MinCycles >= 60 * us && benchWrite0MaxCycles <= 120 * us
+                   && benchPresenceMinCycles >= 60 * us && benchPresenceMaxCycles <= 75 * us
+                   && benchReadMaxCycles < 15 * us;
+  uartText.print(F("ds18b20 slot us: write0="));
+  uartText.print(benchWrite0MinCycles / us);
+  uartText.print(F(".."));
+  uartText.print(benchWrite0MaxCycles / us);
+  uartText.print(F(" presence="));
+  uartText.print(benchPresenceMinCycles / us);
+  uartText.print(F(".."));
+  uartText.print(benchPresenceMaxCycles / us);
+  uartText.print(F(" read="));
+  uartText.print(benchReadMaxCycles / us);
+  if (benchWrite0MaxCycles == 0) uartText.println(F(" UNTESTED"));
+  else uartText.println(slotsPass ? F(" PASS") : F(" FAIL"));
+  uartText.print(F("boot us: first light="));
+  uartText.print(bootFirstLightUs);
+  uartText.print(F(" first frame="));
+  uartText.println(bootFirstFrameUs);
+  uartText.print(F("ram: static="));
+  uartText.print(staticRamBytes());
+  uartText.print(F(" stack peak="));
+  uartText.print(stackPeakBytes());
+  uartText.print(F(" untouched="));
+  uartText.println(stackUntouchedBytes());
+  benchReportPolls();
+}
+
+#define BENCH_PROBE(probe, call) do { \
+    uint32_t _benchStart = benchCycles(); \
+    call; \
+    benchRecord(probe, benchCycles() - _benchStart); \
+  } while (0)
+
+// Scripted stimulus: encoder spins, IR frames, button presses and sensor readings
+// replayed against the real loop(). The report is printed when the script ends.
+enum BenchStimulusKind : uint8_t {
+  STIM_ENCODER,      // value: encoder counts to add
+  STIM_IR,           // value: raw NEC code
+  STIM_BUTTON,       // value: 1 = press, 0 = release
+  STIM_BATTERY_MV,   // value: battery voltage in mV
+  STIM_TEMP_CENTI_C, // value: LED temperature in 0.01 C
+  STIM_END
+};
+struct BenchStimulus {
+  uint32_t atMs;
+  uint8_t kind;
+  int32_t value;
+};
+const BenchStimulus benchScript[] PROGMEM = {
+  {   500, STIM_BATTERY_MV,  7800 },
+  {   500, STIM_TEMP_CENTI_C, 3500 },
+  {  1000, STIM_ENCODER,       20 },
+  {  1200, STIM_ENCODER,      -40 },
+  {  1400, STIM_ENCODER,       60 },
+  {  2000, STIM_IR, (int32_t)IR_CODE_UP },
+  {  2500, STIM_IR, (int32_t)IR_CODE_DOWN },
+  {  3000, STIM_IR, (int32_t)IR_CODE_PRESET_4 },
+  {  3500, STIM_IR, (int32_t)IR_CODE_PRESET_1 },
+  {  4000, STIM_BUTTON,         1 }, // short press: preset screen
+  {  4100, STIM_BUTTON,         0 },
+  {  4500, STIM_ENCODER,        8 },
+  {  5000, STIM_BUTTON,         1 }, // short press: stats screen
+  {  5100, STIM_BUTTON,         0 },
+  {  7000, STIM_BUTTON,         1 }, // short press: back to dimming
+  {  7100, STIM_BUTTON,         0 },
+  {  8000, STIM_BUTTON,         1 }, // long press: off
+  {  9500, STIM_BUTTON,         0 },
+  { 10000, STIM_BUTTON,         1 }, // long press: on
+  { 11500, STIM_BUTTON,         0 },
+  { 12000, STIM_TEMP_CENTI_C, 7100 }, // above target: thermal limiting
+  { 16000, STIM_ENCODER,       80 },
+  { 18000, STIM_TEMP_CENTI_C, 7600 }, // critical
+  { 24000, STIM_TEMP_CENTI_C, 5000 }, // recover
+  { 28000, STIM_BATTERY_MV,  6560 }, // ~8%: 10% warning bursts
+  { 70000, STIM_END,            0 }, // the smoothed charge estimate takes ~30 s to fall
+};
+
+void benchStimulate() {
+  static uint8_t step = 0;
+  BenchStimulus s;
+  memcpy_P(&s, &benchScript[step], sizeof(s));
+  if (millis() < s.atMs) return;
+
+  switch (s.kind) {
+    case STIM_ENCODER: encoderPosition += s.value; break;
+    case STIM_IR: benchPendingIrCode = s.value; break;
+    case STIM_BUTTON:
+      // Pull the switch input low ourselves to emulate a press
+      if (s.value) {
+        pinMode(ENCODER_SWITCH_PIN, OUTPUT);
+        digitalWrite(ENCODER_SWITCH_PIN, LOW);
+      } else {
+        pinMode(ENCODER_SWITCH_PIN, INPUT_PULLUP);
+      }
+      break;
+    case STIM_BATTERY_MV: benchBatteryOverrideMv = s.value; break;
+    case STIM_TEMP_CENTI_C: benchTempOverrideCentiC = s.value; break;
+    case STIM_END:
+      benchReport();
+      while (!isUartTxIdle()) {}
+      // Sleeping with interrupts off makes simavr exit cleanly
+      set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+      sleep_enable();
+      cli();
+      sleep_cpu();
+      return;
+  }
+  step++;
+}
+#else
+#define BENCH_PROBE(probe, call) call
+#endif
 
 
 // --- Forward Declarations ---
 void handleInputs();
-void handleIrInputs();
+void serviceSerial(unsigned long now);
+void recordLoopPass(unsigned long us);
+bool isSerialIdle();
+void resyncButton();
+void dispatchIrCommand(uint16_t command, bool repeat, uint16_t timeMs);
+void handleButtonPress(uint16_t timeMs);
+void handleButtonRelease(uint16_t timeMs);
 void handleRotaryEncoderInputs();
 void updateOutputs();
 void drawDisplay();
+void requestDisplayFrame();
+void invalidateDisplayRegion(uint8_t pages, uint8_t firstTile, uint8_t lastTile);
+void serviceDisplay();
+bool isDisplayFrameInFlight();
 void drawSmoothDimScreen();
 void drawPresetScreen();
 void drawStatsScreen();
 void updateBatteryStats();
-long readVcc();
+millivolts_t ocvMillivoltsPerTenPercent(millivolts_t ocv);
 // NEW: Forward declaration for temperature function
 void updateTemperature();
+bool isOneWireBusy();
+void oneWireTick();
 // Forward declaration for the new low battery screen function
 void drawLowBatteryScreen();
+void drawDiagnosticsScreen();
+void drawChargingScreen();
+void drawScenePage();
+void drawColorTempScreen();
+void resyncEncoder();
+void serviceScene();
+unsigned long msUntilNextRelease(unsigned long now);
+bool isValidFullChargeReading(millivolts_t measured);
 // NEW: Overheat warn screen declaration
 void drawOverheatWarnScreen();
-// NEW: Overheat warn rotary-only adjust helper
-void handleRotaryEncoderWarnTempAdjust();
-
-// Helper: flash the lamp in bursts. bursts x pulsesPerBurst, with on/off timings.
-void flashBurst(int bursts, int pulsesPerBurst, unsigned long onMs, unsigned long offMs, int flashBrightness) {
-    // Save state
-    int savedBrightness = brightness;
-    bool savedLampOn = isLampOn;
-    uint16_t savedOCR = OCR1A;
-    bool ocWasEnabled = (TCCR1A & _BV(COM1A1));
-
-    // Ensure PWM is connected for flashing
-    TCCR1A |= _BV(COM1A1);
-
-    int pwmFlash = map(constrain(flashBrightness, 0, 100), 0, 100, 0, 511);
-
-    for (int b = 0; b < bursts; ++b) {
-        for (int p = 0; p < pulsesPerBurst; ++p) {
-            OCR1A = pwmFlash;          // turn on
-            delay(onMs);
-            OCR1A = 0;                 // turn off
-            delay(offMs);
+
+// --- Perceptual Brightness Table ---
+// Brightness 0-100 is treated as perceived lightness (CIE 1931 L*) and mapped to a
+// duty in 1/16 of a Timer1 count (0..PWM_TOP*16). The integer part goes to OCR1A and
+// the fraction is dithered in the overflow ISR, giving ~14-bit effective resolution
+// where it matters: 1% is 18/16 counts instead of the old 5/511 steps.
+// Generated with: Y = L <= 8 ? L / 903.3 : ((L + 16) / 116)^3;  round(Y * 1023 * 16)
+const uint16_t brightnessDutyTable[101] PROGMEM = {
+      0,    18,    36,    54,    72,    91,   109,   127,   145,   164,
+    184,   206,   230,   256,   283,   312,   344,   377,   412,   450,
+    489,   531,   575,   622,   671,   723,   777,   834,   893,   956,
+   1021,  1089,  1160,  1234,  1311,  1391,  1474,  1561,  1651,  1745,
+   1842,  1942,  2046,  2154,  2265,  2380,  2499,  2622,  2749,  2880,
+   3015,  3154,  3297,  3445,  3597,  3753,  3914,  4079,  4249,  4424,
+   4603,  4787,  4976,  5170,  5369,  5573,  5782,  5996,  6215,  6440,
+   6670,  6905,  7146,  7393,  7645,  7902,  8166,  8435,  8710,  8991,
+   9278,  9571,  9870, 10175, 10486, 10804, 11128, 11459, 11796, 12139,
+  12489, 12846, 13210, 13580, 13957, 14341, 14732, 15131, 15536, 15948,
+  16368,
+};
+
+// percent must already be within 0-100
+uint16_t brightnessToDuty(uint8_t percent) {
+    return pgm_read_word(&brightnessDutyTable[percent]);
+}
+
+// Level in 1/256 of a brightness percent (0..100*256), interpolated between table entries
+uint16_t levelToDuty(uint16_t level) {
+    uint8_t index = level >> 8;
+    uint16_t duty = brightnessToDuty(index);
+    if (index >= 100) return duty;
+    uint16_t step = brightnessToDuty(index + 1) - duty;
+    return duty + (uint16_t)(((uint32_t)step * (level & 0xFF)) >> 8);
+}
+
+// --- Brightness Fade Engine ---
+// updateOutputs() only publishes a target level. The Timer1 overflow ISR slews the
+// actual level towards it at a set rate (in perceived brightness, so fades look
+// even) every ~1 ms, independent of how long a loop() pass takes. The host sets
+// the rate with FRAME_SET_FADE_RATE and it is saved with the settings.
+const uint8_t FADE_TICK_OVERFLOWS = 16;              // 1.024 ms at ICR1 = 1023
+const uint16_t FADE_RATE_PERCENT_PER_SEC = 200;      // full range in 0.5 s
+
+constexpr uint16_t fadeStepForRate(uint16_t percentPerSec) {
+    return (uint32_t)percentPerSec * 256 * FADE_TICK_OVERFLOWS * (PWM_TOP + 1UL) / F_CPU;
+}
+
+volatile uint16_t fadeTargetLevel = 0;
+// MODIFIED: The step is a byte, so the ISR reads it without an atomic block
+volatile uint8_t fadeStep = fadeStepForRate(FADE_RATE_PERCENT_PER_SEC);
+// ISR-owned: current level and the duty derived from it (1/16 counts)
+volatile uint16_t fadeLevel = 0;
+volatile uint16_t outputDuty = 0;
+
+void setFadeTarget(uint8_t percent) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        fadeTargetLevel = (uint16_t)percent << 8;
+    }
+}
+
+// Skip the fade, e.g. for the low-battery cut-off
+void setOutputImmediate(uint8_t percent) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        fadeTargetLevel = fadeLevel = (uint16_t)percent << 8;
+        outputDuty = brightnessToDuty(percent);
+    }
+}
+
+// Clamped to what one byte per tick can express (about 4 to 975 %/s). The rate is
+// capped first so the product in fadeStepForRate() stays inside 32 bits.
+void setFadeRate(uint16_t percentPerSec) {
+    uint16_t step = fadeStepForRate(min(percentPerSec, 1000));
+    fadeStep = constrain(step, 1, 255);
+}
+
+// One slew step (ISR context)
+void fadeTick() {
+    uint16_t level = fadeLevel;
+    uint16_t target = fadeTargetLevel;
+    if (level == target) return;
+    uint8_t step = fadeStep;
+    if (level < target) {
+        level = (target - level > step) ? level + step : target;
+    } else {
+        level = (level - target > step) ? level - step : target;
+    }
+    fadeLevel = level;
+    outputDuty = levelToDuty(level);
+}
+
+// --- Warm/Cool Colour Mixing ---
+// NEW: A warm white LED channel on OC1B (pin 10) sits next to the cool one on OC1A.
+// Both compare outputs run off the same Timer1 counter, so their PWM periods are
+// phase aligned, and the overflow ISR dithers both. Every duty in the firmware
+// (fade, patterns, scenes) stays a single light output; the ISR splits it into the
+// two channels with the coefficients of the selected colour temperature step.
+// The table is generated by tools/cct_tables.py. For each step it holds the mix
+// (within a few mired of the step) that needs the least LED power, scaled so 100 %
+// drives the brighter channel of the mix at full duty. colorMixPowerQ8 is the LED
+// power of the mix relative to one channel at the same duty. The current model and
+// the absolute power caps (charging cap, 10 % battery clamp) go through it.
+struct ColorMix {
+  uint8_t kelvinHundreds;
+  uint8_t cool;   // channel duty at full output, 255 = 100 %
+  uint8_t warm;
+};
+
+// BEGIN GENERATED COLOR MIX TABLE (tools/cct_tables.py)
+// cool 6500 K, warm 2700 K, same flux at full duty, +-5 mired;
+// 100% drives the brighter channel at full duty
+const ColorMix colorMixTable[] PROGMEM = {
+  { 27,   0, 255 },  // 2700 K: mix 2706 K, 1.00 x one channel's power
+  { 29,  29, 255 },  // 2900 K: mix 2900 K, 1.11 x one channel's power
+  { 31,  61, 255 },  // 3100 K: mix 3100 K, 1.24 x one channel's power
+  { 33,  97, 255 },  // 3300 K: mix 3300 K, 1.38 x one channel's power
+  { 35, 137, 255 },  // 3500 K: mix 3500 K, 1.54 x one channel's power
+  { 37, 182, 255 },  // 3700 K: mix 3700 K, 1.71 x one channel's power
+  { 39, 233, 255 },  // 3900 K: mix 3900 K, 1.91 x one channel's power
+  { 41, 255, 223 },  // 4100 K: mix 4100 K, 1.87 x one channel's power
+  { 43, 255, 180 },  // 4300 K: mix 4300 K, 1.71 x one channel's power
+  { 45, 255, 146 },  // 4500 K: mix 4500 K, 1.57 x one channel's power
+  { 47, 255, 119 },  // 4700 K: mix 4700 K, 1.47 x one channel's power
+  { 49, 255,  97 },  // 4900 K: mix 4900 K, 1.38 x one channel's power
+  { 51, 255,  78 },  // 5100 K: mix 5100 K, 1.31 x one channel's power
+  { 53, 255,  62 },  // 5300 K: mix 5300 K, 1.24 x one channel's power
+  { 55, 255,  48 },  // 5500 K: mix 5500 K, 1.19 x one channel's power
+  { 57, 255,  36 },  // 5700 K: mix 5700 K, 1.14 x one channel's power
+  { 59, 255,  26 },  // 5900 K: mix 5900 K, 1.10 x one channel's power
+  { 61, 255,  16 },  // 6100 K: mix 6100 K, 1.06 x one channel's power
+  { 63, 255,   8 },  // 6300 K: mix 6300 K, 1.03 x one channel's power
+  { 65, 255,   0 },  // 6500 K: mix 6500 K, 1.00 x one channel's power
+};
+const uint8_t CCT_STEPS = 20;
+const uint16_t CCT_WARM_KELVIN = 2700;  // ends of the display scale
+const uint16_t CCT_COOL_KELVIN = 6500;
+// END GENERATED COLOR MIX TABLE
+
+const uint8_t PWM_COMPARE_OUTPUTS = _BV(COM1A1) | _BV(COM1B1);
+
+uint8_t colorTempStep = CCT_STEPS - 1;  // persisted with the settings
+volatile uint16_t mixCoolQ8 = 256;      // 0..256, read by the ISR
+volatile uint16_t mixWarmQ8 = 0;
+uint16_t colorMixPowerQ8 = 256;
+
+void setColorTempStep(uint8_t step) {
+    ColorMix mix;
+    memcpy_P(&mix, &colorMixTable[step], sizeof(mix));
+    uint16_t cool = mix.cool + (mix.cool >> 7);
+    uint16_t warm = mix.warm + (mix.warm >> 7);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        mixCoolQ8 = cool;
+        mixWarmQ8 = warm;
+    }
+    colorMixPowerQ8 = cool + warm;
+    colorTempStep = step;
+}
+
+uint16_t colorTempKelvin() {
+    return pgm_read_byte(&colorMixTable[colorTempStep].kelvinHundreds) * 100;
+}
+
+// Highest brightness whose LED power (both channels) is at most that of one
+// channel at percent, and never above percent
+uint8_t brightnessForPower(uint8_t percent) {
+    uint32_t budget = (uint32_t)brightnessToDuty(percent) * 256;
+    uint8_t low = 0, high = percent;
+    while (low < high) {
+        uint8_t mid = (low + high + 1) / 2;
+        if ((uint32_t)brightnessToDuty(mid) * colorMixPowerQ8 <= budget) low = mid;
+        else high = mid - 1;
+    }
+    return low;
+}
+
+// Disconnects both channels from Timer1 and holds them off
+void disconnectOutputs() {
+    TCCR1A &= ~PWM_COMPARE_OUTPUTS;
+    digitalWrite(PWM_OUTPUT_PIN, LOW);
+    digitalWrite(PWM_WARM_PIN, LOW);
+}
+
+// --- Non-blocking Light Pattern Engine ---
+// Burst, blink and ramp sequences are stepped from the Timer1 overflow interrupt,
+// so loop() (inputs, sensors, display) keeps running while a pattern plays.
+// While a pattern is active its duty overrides the faded output duty; COM1A1
+// is saved on start and restored when it ends, like the old blocking flashBurst(),
+// and OCR1A returns to the output level on the next PWM cycle.
+enum PatternKind : uint8_t {
+  PATTERN_NONE,
+  PATTERN_BURST,  // bursts x pulses of on/off, then a gap after each burst
+  PATTERN_RAMP    // linear duty ramp from one level to another
+};
+enum PatternPhase : uint8_t {
+  PHASE_ON,
+  PHASE_OFF,
+  PHASE_GAP
+};
+
+// One engine tick every 125 Timer1 overflows (8 ms at ICR1 = 1023)
+const uint8_t PATTERN_TICK_OVERFLOWS = 125;
+const uint16_t PATTERN_TICK_MS = (uint16_t)(PATTERN_TICK_OVERFLOWS * (PWM_TOP + 1UL) * 1000UL / F_CPU);
+
+struct PatternState {
+  PatternKind kind;
+  PatternPhase phase;
+  uint8_t burstsLeft;
+  uint8_t pulsesPerBurst;
+  uint8_t pulsesLeft;
+  uint16_t onMs, offMs, gapMs;
+  uint16_t fromDuty, toDuty;  // 1/16 counts; burst: toDuty is the flash level
+  uint16_t elapsedMs;         // ramp progress
+  uint16_t msLeft;            // time left in the current phase
+};
+volatile PatternState pattern = {};
+volatile uint16_t patternDuty = 0;
+// NEW: The highest duty a pattern may flash at: the thermal ceiling and the
+// charging cap as applied by updateOutputs(), 0 at the hard cutoff
+volatile uint16_t patternCeilingDuty = PWM_TOP * 16;
+bool patternSavedOcEnabled = false;
+
+bool isPatternActive() {
+    return pattern.kind != PATTERN_NONE;
+}
+
+// Called from the ISR when the last phase has run out
+void finishPattern() {
+    if (!patternSavedOcEnabled) disconnectOutputs();
+    pattern.kind = PATTERN_NONE;
+}
+
+void startPattern(const PatternState& next) {
+    // MODIFIED: Restores the caller's interrupt state instead of enabling interrupts
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (!isPatternActive()) {
+            // Save state (a pattern replacing another keeps the original saved state)
+            patternSavedOcEnabled = (TCCR1A & _BV(COM1A1));
+        }
+        // Ensure PWM is connected for the pattern
+        TCCR1A |= PWM_COMPARE_OUTPUTS;
+        pattern.kind = next.kind;
+        pattern.phase = PHASE_ON;
+        pattern.burstsLeft = next.burstsLeft;
+        pattern.pulsesPerBurst = next.pulsesPerBurst;
+        pattern.pulsesLeft = next.pulsesPerBurst;
+        pattern.onMs = next.onMs;
+        pattern.offMs = next.offMs;
+        pattern.gapMs = next.gapMs;
+        pattern.fromDuty = next.fromDuty;
+        pattern.toDuty = next.toDuty;
+        pattern.elapsedMs = 0;
+        pattern.msLeft = next.onMs;
+        patternDuty = next.kind == PATTERN_RAMP ? next.fromDuty : next.toDuty;
+    }
+}
+
+// NEW: Ends the active pattern early and restores the outputs it saved
+void stopPattern() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (isPatternActive()) finishPattern();
+    }
+}
+
+// Flash the lamp in bursts: bursts x pulsesPerBurst, with on/off timings and a gap after each burst.
+void playBurstPattern(uint8_t bursts, uint8_t pulsesPerBurst, uint16_t onMs, uint16_t offMs, uint16_t gapMs, int flashBrightness) {
+    PatternState next = {};
+    next.kind = PATTERN_BURST;
+    next.burstsLeft = bursts;
+    next.pulsesPerBurst = pulsesPerBurst;
+    next.onMs = onMs;
+    next.offMs = offMs;
+    next.gapMs = gapMs;
+    next.toDuty = brightnessToDuty(constrain(flashBrightness, 0, 100));
+    startPattern(next);
+}
+
+// A single run of evenly spaced blinks
+void playBlinkPattern(uint8_t blinks, uint16_t periodMs, int blinkBrightness) {
+    playBurstPattern(1, blinks, periodMs / 2, periodMs / 2, 0, blinkBrightness);
+}
+
+// One linear duty ramp between two brightness levels
+void playRampPattern(int fromBrightness, int toBrightness, uint16_t durationMs) {
+    PatternState next = {};
+    next.kind = PATTERN_RAMP;
+    next.onMs = durationMs;
+    next.fromDuty = brightnessToDuty(constrain(fromBrightness, 0, 100));
+    next.toDuty = brightnessToDuty(constrain(toBrightness, 0, 100));
+    startPattern(next);
+}
+
+// Advance the active pattern by one engine tick (ISR context)
+void patternTick() {
+    if (pattern.kind == PATTERN_RAMP) {
+        pattern.elapsedMs += PATTERN_TICK_MS;
+        if (pattern.elapsedMs >= pattern.onMs) {
+            finishPattern();
+            return;
         }
-        delay(1000); // gap between bursts
+        long span = (long)pattern.toDuty - pattern.fromDuty;
+        patternDuty = pattern.fromDuty + span * pattern.elapsedMs / pattern.onMs;
+        return;
+    }
+
+    if (pattern.msLeft > PATTERN_TICK_MS) {
+        pattern.msLeft -= PATTERN_TICK_MS;
+        return;
+    }
+    switch (pattern.phase) {
+        case PHASE_ON:
+            patternDuty = 0;                 // turn off
+            pattern.phase = PHASE_OFF;
+            pattern.msLeft = pattern.offMs;
+            break;
+        case PHASE_OFF:
+            if (--pattern.pulsesLeft > 0) {
+                patternDuty = pattern.toDuty; // turn on
+                pattern.phase = PHASE_ON;
+                pattern.msLeft = pattern.onMs;
+            } else {
+                pattern.phase = PHASE_GAP; // gap between bursts
+                pattern.msLeft = pattern.gapMs;
+            }
+            break;
+        case PHASE_GAP:
+            if (--pattern.burstsLeft == 0) {
+                finishPattern();
+            } else {
+                patternDuty = pattern.toDuty;
+                pattern.phase = PHASE_ON;
+                pattern.pulsesLeft = pattern.pulsesPerBurst;
+                pattern.msLeft = pattern.onMs;
+            }
+            break;
+    }
+}
+
+// --- Light Scene Engine ---
+// NEW: Scenes (candle, sunrise, SOS, sleep timer) are small bytecode programs in
+// PROGMEM, stepped from the Timer1 overflow interrupt on the pattern engine's tick.
+// A scene sets an intensity (0-255) that scales the faded output level, so the
+// brightness setting, the thermal ceiling and the charging cap all still apply,
+// and a notification pattern still plays over it. Up to SCENE_STEPS_PER_TICK
+// instructions run per tick; a timed one (ramp, hold, flicker) takes effect from
+// the next tick. The programs are assembled from tools/scenes/ by tools/sceneasm.py,
+// which documents the instruction set and checks scene timing against the same
+// arithmetic as sceneTick().
+//
+// Time operands are 16-bit little-endian: engine ticks, or seconds when bit 15 is
+// set. Jump targets are byte offsets into the scene.
+enum SceneOpcode : uint8_t {
+  SCENE_END,      // steady light at the normal level from here
+  SCENE_OFF,      // switch the lamp off
+  SCENE_SET,      // level
+  SCENE_RAMP,     // level, time: linear from the current intensity
+  SCENE_HOLD,     // time
+  SCENE_FLICKER,  // low, high, time: smoothed random intensity between low and high
+  SCENE_LOOP,     // count, target: run from target to here count times (no nesting)
+  SCENE_JUMP,     // target
+  SCENE_WAIT,     // events: until one of them is posted
+  SCENE_JEV       // events, target: jump if one of them has been posted
+};
+enum SceneEvent : uint8_t {
+  SCENE_EVENT_INPUT = 0x01  // encoder, button or IR key
+};
+const uint8_t SCENE_STEPS_PER_TICK = 4;
+const uint16_t SCENE_TIME_SECONDS = 0x8000;
+const uint8_t SCENE_TICKS_PER_SECOND = 1000 / PATTERN_TICK_MS;
+const uint8_t SCENE_NAME_SIZE = 12;
+
+struct SceneDescriptor {
+  const uint8_t* program;
+  const char* name;
+};
+
+struct SceneState {
+  const uint8_t* program;   // NULL = no scene
+  uint8_t pc;
+  uint8_t op;               // the timed instruction in progress
+  uint8_t loopsLeft;
+  uint8_t flickerLow, flickerSpan;
+  uint8_t rampTarget;
+  uint32_t ticksLeft;
+  int32_t levelQ16;         // intensity << 16
+  int32_t stepQ16;          // ramp step per tick
+};
+volatile SceneState scene = {};
+volatile uint16_t sceneDuty = 0;
+volatile uint8_t sceneEvents = 0;
+volatile bool sceneRequestsOff = false;
+uint16_t sceneRandom = 0xACE1;  // xorshift state, ISR-owned
+uint8_t sceneIndex = 0;         // the scene running (or last run)
+
+// BEGIN GENERATED SCENES (tools/sceneasm.py c tools/scenes/candle.scene tools/scenes/sunrise.scene tools/scenes/sos.scene tools/scenes/sleep.scene)
+// Candle (candle.scene)
+const uint8_t sceneCandle[] PROGMEM = {
+  SCENE_SET, 170,                      //   0: set 170
+  SCENE_FLICKER, 130, 230, 232, 3,     //   2: flicker 130 230 8s
+  SCENE_FLICKER, 70, 190, 50, 0,       //   7: flicker 70 190 400ms
+  SCENE_FLICKER, 140, 220, 113, 2,     //  12: flicker 140 220 5s
+  SCENE_JUMP, 2,                       //  17: jump flame
+};
+const char sceneCandleName[] PROGMEM = "Candle";
+// Sunrise (sunrise.scene)
+const uint8_t sceneSunrise[] PROGMEM = {
+  SCENE_SET, 0,                        //   0: set 0
+  SCENE_RAMP, 40, 88, 130,             //   2: ramp 40 10min
+  SCENE_RAMP, 255, 176, 132,           //   6: ramp 255 20min
+  SCENE_RAMP, 170, 250, 0,             //  10: ramp 170 2s
+  SCENE_RAMP, 255, 250, 0,             //  14: ramp 255 2s
+  SCENE_JEV, 1, 26,                    //  18: jev input done
+  SCENE_LOOP, 75, 10,                  //  21: loop 75 pulse
+  SCENE_WAIT, 1,                       //  24: wait input
+  SCENE_END,                           //  26: end
+};
+const char sceneSunriseName[] PROGMEM = "Sunrise";
+// SOS (sos.scene)
+const uint8_t sceneSOS[] PROGMEM = {
+  SCENE_SET, 255,                      //   0: set 255
+  SCENE_HOLD, 25, 0,                   //   2: hold 200ms
+  SCENE_SET, 0,                        //   5: set 0
+  SCENE_HOLD, 25, 0,                   //   7: hold 200ms
+  SCENE_LOOP, 3, 0,                    //  10: loop 3 s1
+  SCENE_HOLD, 50, 0,                   //  13: hold 400ms
+  SCENE_SET, 255,                      //  16: set 255
+  SCENE_HOLD, 75, 0,                   //  18: hold 600ms
+  SCENE_SET, 0,                        //  21: set 0
+  SCENE_HOLD, 25, 0,                   //  23: hold 200ms
+  SCENE_LOOP, 3, 16,                   //  26: loop 3 o
+  SCENE_HOLD, 50, 0,                   //  29: hold 400ms
+  SCENE_SET, 255,                      //  32: set 255
+  SCENE_HOLD, 25, 0,                   //  34: hold 200ms
+  SCENE_SET, 0,                        //  37: set 0
+  SCENE_HOLD, 25, 0,                   //  39: hold 200ms
+  SCENE_LOOP, 3, 32,                   //  42: loop 3 s2
+  SCENE_HOLD, 150, 0,                  //  45: hold 1200ms
+  SCENE_JUMP, 0,                       //  48: jump s1
+};
+const char sceneSOSName[] PROGMEM = "SOS";
+// Sleep (sleep.scene)
+const uint8_t sceneSleep[] PROGMEM = {
+  SCENE_HOLD, 88, 130,                 //   0: hold 10min
+  SCENE_RAMP, 0, 176, 132,             //   3: ramp 0 20min
+  SCENE_OFF,                           //   7: off
+};
+const char sceneSleepName[] PROGMEM = "Sleep";
+const SceneDescriptor sceneTable[] PROGMEM = {
+  { sceneCandle, sceneCandleName },
+  { sceneSunrise, sceneSunriseName },
+  { sceneSOS, sceneSOSName },
+  { sceneSleep, sceneSleepName },
+};
+const uint8_t SCENE_COUNT = 4;
+// END GENERATED SCENES
+
+bool isSceneActive() {
+    bool active;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        active = scene.program != NULL;
+    }
+    return active;
+}
+
+void startScene(uint8_t index) {
+    SceneDescriptor desc;
+    memcpy_P(&desc, &sceneTable[index], sizeof(desc));
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        scene.pc = 0;
+        scene.op = SCENE_END;
+        scene.loopsLeft = 0;
+        scene.ticksLeft = 0;
+        scene.levelQ16 = 255L << 16;
+        scene.program = desc.program;
+        sceneDuty = outputDuty;
+        sceneEvents = 0;
+    }
+    sceneIndex = index;
+}
+
+void stopScene() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        scene.program = NULL;
+    }
+}
+
+void postSceneEvent(uint8_t event) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        sceneEvents |= event;
     }
+}
+
+// Copies the name of a built-in scene (SCENE_NAME_SIZE bytes)
+void sceneName(char* out, uint8_t index) {
+    SceneDescriptor desc;
+    memcpy_P(&desc, &sceneTable[index], sizeof(desc));
+    strcpy_P(out, desc.name);
+}
+
+uint8_t sceneFetch() {
+    return pgm_read_byte(scene.program + scene.pc++);
+}
+
+uint32_t sceneFetchTicks() {
+    uint16_t time = sceneFetch();
+    time |= (uint16_t)sceneFetch() << 8;
+    if (time & SCENE_TIME_SECONDS) return (uint32_t)(time & ~SCENE_TIME_SECONDS) * SCENE_TICKS_PER_SECOND;
+    return time;
+}
+
+uint8_t sceneRandomByte() {
+    sceneRandom ^= sceneRandom << 7;
+    sceneRandom ^= sceneRandom >> 9;
+    sceneRandom ^= sceneRandom << 8;
+    return sceneRandom;
+}
+
+// Runs instructions up to the next timed one (ISR context)
+void sceneRun() {
+    for (uint8_t steps = 0; steps < SCENE_STEPS_PER_TICK; steps++) {
+        uint8_t at = scene.pc;
+        uint8_t op = sceneFetch();
+        uint8_t count, mask, target;
+        scene.op = op;
+        switch (op) {
+            case SCENE_SET:
+                scene.levelQ16 = (int32_t)sceneFetch() << 16;
+                break;
+            case SCENE_RAMP: {
+                scene.rampTarget = sceneFetch();
+                uint32_t ticks = sceneFetchTicks();
+                if (ticks == 0) {
+                    scene.levelQ16 = (int32_t)scene.rampTarget << 16;
+                    break;
+                }
+                scene.stepQ16 = (((int32_t)scene.rampTarget << 16) - scene.levelQ16) / (int32_t)ticks;
+                scene.ticksLeft = ticks;
+                return;
+            }
+            case SCENE_HOLD:
+                scene.ticksLeft = sceneFetchTicks();
+                if (scene.ticksLeft != 0) return;
+                break;
+            case SCENE_FLICKER:
+                scene.flickerLow = sceneFetch();
+                scene.flickerSpan = sceneFetch() - scene.flickerLow;
+                scene.ticksLeft = sceneFetchTicks();
+                if (scene.ticksLeft != 0) return;
+                break;
+            case SCENE_LOOP:
+                count = sceneFetch();
+                target = sceneFetch();
+                if (scene.loopsLeft == 0) scene.loopsLeft = count;
+                if (--scene.loopsLeft != 0) scene.pc = target;
+                break;
+            case SCENE_JUMP:
+                scene.pc = sceneFetch();
+                break;
+            case SCENE_WAIT:
+                mask = sceneFetch();
+                if (!(sceneEvents & mask)) {
+                    scene.pc = at; // again on the next tick
+                    return;
+                }
+                sceneEvents &= ~mask;
+                break;
+            case SCENE_JEV:
+                mask = sceneFetch();
+                target = sceneFetch();
+                if (sceneEvents & mask) {
+                    sceneEvents &= ~mask;
+                    scene.pc = target;
+                }
+                break;
+            case SCENE_OFF:
+                sceneRequestsOff = true; // acted on by serviceScene()
+                scene.program = NULL;
+                return;
+            default: // SCENE_END
+                scene.program = NULL;
+                return;
+        }
+    }
+}
+
+// Advance the active scene by one engine tick (ISR context)
+void sceneTick() {
+    if (scene.ticksLeft != 0) {
+        if (scene.op == SCENE_RAMP) {
+            scene.levelQ16 += scene.stepQ16;
+            if (scene.ticksLeft == 1) scene.levelQ16 = (int32_t)scene.rampTarget << 16;
+        } else if (scene.op == SCENE_FLICKER) {
+            uint8_t target = scene.flickerLow + (((uint16_t)sceneRandomByte() * (scene.flickerSpan + 1)) >> 8);
+            scene.levelQ16 += (((int32_t)target << 16) - scene.levelQ16) >> 2;
+        }
+        scene.ticksLeft--;
+    }
+    if (scene.ticksLeft == 0) sceneRun();
+    if (scene.program == NULL) return;
+    uint8_t intensity = scene.levelQ16 >> 16;
+    uint16_t scale = intensity + (intensity >> 7); // 0..256
+    sceneDuty = levelToDuty(((uint32_t)fadeLevel * scale) >> 8);
+}
+
+// NEW: The duty the outputs are driven at: a pattern plays over a scene, which
+// replaces the steady output, and the output limits apply to patterns too (a
+// scene scales the already capped level). Call with interrupts off.
+inline uint16_t drivenDuty() {
+    uint16_t duty = pattern.kind != PATTERN_NONE ? patternDuty : (scene.program != NULL ? sceneDuty : outputDuty);
+    if (pattern.kind != PATTERN_NONE && duty > patternCeilingDuty) duty = patternCeilingDuty;
+    return duty;
+}
+
+ISR(TIMER1_OVF_vect) {
+    static uint8_t overflowCount = 0;
+    static uint8_t fadeOverflowCount = 0;
+    static uint8_t ditherError = 0;
+    static uint8_t warmDitherError = 0;
+#ifdef LAMP_BENCH
+    benchOverflows++;
+#endif
+    // MODIFIED: The 1-Wire slot goes first, so its edges follow the overflow closely
+    if (isOneWireBusy()) oneWireTick();
+    // First-order sigma-delta: the 4 fractional bits are spread over 16 PWM cycles.
+    // OCR1A is double-buffered, so the value takes effect at the next TOP.
+    // MODIFIED: A pattern or a scene instead of the steady output
+    uint16_t duty = drivenDuty();
+    // MODIFIED: Split into the cool (OC1A) and warm (OC1B) channel, each dithered
+    uint16_t coolDuty = ((uint32_t)duty * mixCoolQ8) >> 8;
+    uint16_t warmDuty = ((uint32_t)duty * mixWarmQ8) >> 8;
+    uint8_t sum = ditherError + (coolDuty & 0x0F);
+    OCR1A = (coolDuty >> 4) + (sum >> 4);
+    ditherError = sum & 0x0F;
+    sum = warmDitherError + (warmDuty & 0x0F);
+    OCR1B = (warmDuty >> 4) + (sum >> 4);
+    warmDitherError = sum & 0x0F;
+    // NEW: Boot timing
+    if (bootFirstLightUs == 0 && (OCR1A != 0 || OCR1B != 0)) bootFirstLightUs = micros();
+
+    if (++fadeOverflowCount >= FADE_TICK_OVERFLOWS) {
+        fadeOverflowCount = 0;
+        fadeTick();
+    }
+    if (++overflowCount >= PATTERN_TICK_OVERFLOWS) {
+        overflowCount = 0;
+        if (pattern.kind != PATTERN_NONE) patternTick();
+        if (scene.program != NULL) sceneTick();
+    }
+}
+
+// --- Thermal Governor ---
+// PI controller on the LED temperature, with the derivative taken on the
+// measurement so a fast rise is acted on before the error builds up. Its output
+// is a brightness ceiling that updateOutputs() applies on top of the user's
+// setting, so the lamp runs as bright as the heat sink allows at
+// THERMAL_TARGET_C instead of snapping to fixed caps. The integrator is clamped
+// to the output range and stops integrating while the output is saturated in
+// the direction of the error, so a cold lamp at 100% does not wind it up.
+// TEMP_OVERHEAT_C stays as the hard cutoff behind it.
+const centiC_t THERMAL_TARGET_C = DEG_C(72);
+const int16_t THERMAL_KP_Q8 = 26;                 // 10 % per degree (Q8 percent per 0.01 C)
+const int16_t THERMAL_KD_Q8 = 51;                 // 20 % per degree/second of rise
+const uint16_t THERMAL_KI_DIV = 3906;             // 0.1 % per degree-second: Q8 += error * ms / DIV
+const int32_t THERMAL_MAX_Q8 = 100L * 256;
+const int32_t THERMAL_RESTART_Q8 = 25L * 256;     // integrator after a hard cutoff
+
+int32_t thermalIntegralQ8 = THERMAL_MAX_Q8;
+int16_t thermalRate = 0;                          // smoothed rise, 0.01 C per second
+centiC_t thermalLastTemp = 0;
+unsigned long thermalLastTime = 0;
+bool thermalPrimed = false;
+uint8_t thermalCeiling = 100;                     // brightness limit, percent
+
+// Once per fresh temperature reading
+void updateThermalGovernor(centiC_t temp, unsigned long now) {
+    if (!thermalPrimed) {
+        thermalPrimed = true;
+    } else {
+        unsigned long dt = now - thermalLastTime;
+        if (dt == 0) return;
+        int16_t rate = (int32_t)(temp - thermalLastTemp) * 1000 / (long)dt;
+        thermalRate += (rate - thermalRate) / 2;
+
+        int16_t error = THERMAL_TARGET_C - temp; // positive = headroom
+        int32_t proportional = (int32_t)error * THERMAL_KP_Q8 - (int32_t)thermalRate * THERMAL_KD_Q8;
+        int32_t integralStep = (int32_t)error * (long)dt / THERMAL_KI_DIV;
+        int32_t output = proportional + thermalIntegralQ8;
+        if (!(output >= THERMAL_MAX_Q8 && integralStep > 0) && !(output <= 0 && integralStep < 0)) {
+            thermalIntegralQ8 = constrain(thermalIntegralQ8 + integralStep, 0, THERMAL_MAX_Q8);
+        }
+        output = constrain(proportional + thermalIntegralQ8, 0, THERMAL_MAX_Q8);
+        thermalCeiling = output >> 8;
+    }
+    thermalLastTemp = temp;
+    thermalLastTime = now;
+}
+
+// --- DS18B20 Driver ---
+// MODIFIED: Replaces OneWire/DallasTemperature. The bus is bit-banged one slot per
+// Timer1 overflow (64 us, the length of a 1-Wire time slot) from the overflow ISR,
+// so interrupts are only held off for the few microseconds a slot is timing
+// critical. It runs first in the overflow ISR, and every edge and sample is timed
+// against TCNT1 rather than against the interrupt's (jittery) entry.
+// MODIFIED: No step waits more than a few microseconds. An edge that starts a
+// timed span (a slot's fall, the reset release) is only made in an overflow
+// entered in the first 7 us of its period; a later one leaves the bus as it is
+// until the next overflow. The edge that ends the span, in the next overflow, is
+// then never more than 4 us early and waits out at most that on TCNT1:
+// - A "1" and a read slot drive the line low for ~1.5 us, and a read samples it
+//   6 us after the fall (the slave holds a 0 until 15 us; the short lead to the
+//   sensor is long back up through the pull-up by then).
+// - A "0" slot drives the line low in one overflow and releases it in the next,
+//   at least 61 us after the fall. The low time is at most 64 us plus however late
+//   the second overflow is entered, so it stays within 60..120 us as long as no
+//   other interrupt or atomic section holds the CPU for more than 56 us.
+// - Consecutive slots start at least 61 us apart in the same way, so a slot is
+//   over before the next one's fall (60 us slot, 1 us recovery).
+// - A bus reset is at least eight overflows low, released in the first prompt
+//   overflow after them (there is no upper limit with external power). Presence
+//   is sampled in the next overflow, 61..74 us after the release, inside every
+//   DS18B20's presence pulse (60..75 us at the extremes). One entered too late
+//   to sample in the window starts the reset over.
+// The ADC interrupt (due ~44 us into the period) is never held off past the next
+// conversion's trigger.
+// The sensor's ROM is read once (READ ROM, single-drop bus) and every later
+// transaction addresses it with MATCH ROM. The loop side sequences transactions:
+// configure resolution, convert, wait, read the scratchpad. The resolution
+// follows the temperature trend: 9 bits (94 ms) while heating fast, 12 bits
+// (750 ms) when stable. The sensor must be externally powered (no parasite
+// power). Pin 8 is PB0.
+const uint8_t ONEWIRE_MASK = _BV(0);
+const uint8_t ONEWIRE_RESET_OVERFLOWS = 8;     // full periods low before the release: >= 512 us
+const uint8_t ONEWIRE_RECOVER_OVERFLOWS = 8;   // rest of the 480 us presence window
+const uint8_t ONEWIRE_BUFFER_SIZE = 19;       // MATCH ROM + READ SCRATCHPAD: 10 out, 9 in
+const uint16_t ONEWIRE_EDGE_LATEST_COUNT = 7 * (F_CPU / 1000000UL);      // entered later: next period
+const uint16_t ONEWIRE_PERIOD_SLACK_CYCLES = 3 * (F_CPU / 1000000UL);    // an edge ends a span >= 61 us
+const uint16_t ONEWIRE_PRESENCE_LATEST_CYCLES = 74 * (F_CPU / 1000000UL);  // sampled just after
+const uint16_t ONEWIRE_READ_SAMPLE_CYCLES = 6 * (F_CPU / 1000000UL);    // the slave holds a 0 for >= 15 us
+
+const uint8_t DS18B20_FAMILY = 0x28;
+const uint8_t DS_READ_ROM = 0x33;
+const uint8_t DS_MATCH_ROM = 0x55;
+const uint8_t DS_CONVERT_T = 0x44;
+const uint8_t DS_WRITE_SCRATCHPAD = 0x4E;
+const uint8_t DS_READ_SCRATCHPAD = 0xBE;
+
+enum OneWireStep : uint8_t {
+  OW_IDLE,
+  OW_DONE,            // finished, result not collected yet
+  OW_RESET_LOW,       // from here on the overflow ISR drives the bus
+  OW_PRESENCE,
+  OW_RESET_RECOVER,
+  OW_BITS,
+  OW_WRITE0_RELEASE
+};
+
+volatile OneWireStep oneWireStep = OW_IDLE;
+uint8_t oneWireBuffer[ONEWIRE_BUFFER_SIZE];    // bytes to write, then bytes read
+uint8_t oneWireTxLength = 0;
+uint8_t oneWireTotalLength = 0;
+uint8_t oneWireByte = 0;
+uint8_t oneWireBit = 0;
+uint8_t oneWireCounter = 0;
+bool oneWirePresence = false;
+uint16_t oneWireIrqOffCycles = 0;              // this transaction, sum over slots
+uint16_t oneWireSlotMaxCycles = 0;             // this transaction, longest slot
+uint16_t oneWireEdgeCount = 0;                 // TCNT1 at the fall or reset release in the previous overflow, 0 = none
+
+inline void oneWireDriveLow() { DDRB |= ONEWIRE_MASK; }
+inline void oneWireRelease() { DDRB &= ~ONEWIRE_MASK; }
+
+bool isOneWireBusy() {
+    return oneWireStep >= OW_RESET_LOW;
+}
+
+// Timer1 cycles since count was read, in the overflow ISR, for spans of up to two
+// periods. The overflow after the one being serviced stays pending, so TOV1 says
+// whether TCNT1 has wrapped; a wrap between the two reads shows as the count
+// having gone backwards (count is never within the few cycles the reads take).
+uint16_t oneWireCyclesSince(uint16_t count) {
+    bool wrapped = TIFR1 & _BV(TOV1);
+    uint16_t now = TCNT1;
+    if (wrapped || now < count) now += PWM_TOP + 1;
+    return now - count;
+}
+
+// Until a period less ONEWIRE_PERIOD_SLACK_CYCLES has passed since the edge in the
+// previous overflow. That edge was made by ONEWIRE_EDGE_LATEST_COUNT, so this waits
+// at most 4 us, and not at all once the overflow after it is pending.
+void oneWireWaitForPeriod() {
+    while (TCNT1 + ONEWIRE_PERIOD_SLACK_CYCLES < oneWireEdgeCount && !(TIFR1 & _BV(TOV1))) {}
+}
+
+void oneWireAdvance() {
+    oneWireBit <<= 1;
+    if (oneWireBit == 0) {
+        oneWireBit = 1;
+        if (++oneWireByte == oneWireTotalLength) {
+            oneWireStep = OW_DONE;
+            return;
+        }
+    }
+    oneWireStep = OW_BITS;
+}
+
+// One step per Timer1 overflow (ISR context)
+void oneWireTick() {
+    uint16_t start = TCNT1;
+    uint16_t cycles;
+    bool prompt = start <= ONEWIRE_EDGE_LATEST_COUNT;
+    switch (oneWireStep) {
+        case OW_RESET_LOW:
+            if (oneWireCounter > 0) {
+                --oneWireCounter;
+                break;
+            }
+            if (!prompt) break;
+            oneWireRelease();
+            oneWireEdgeCount = start;
+            oneWireStep = OW_PRESENCE;
+            break;
+        case OW_PRESENCE:
+            oneWireWaitForPeriod();
+            // Since the release, a period and what has passed of this one
+            cycles = PWM_TOP + 1 - oneWireEdgeCount + oneWireCyclesSince(0);
+            oneWireEdgeCount = 0;
+            if (cycles >= ONEWIRE_PRESENCE_LATEST_CYCLES) {
+                // Too late to tell the pulse from its end
+                oneWireDriveLow();
+                oneWireCounter = ONEWIRE_RESET_OVERFLOWS;
+                oneWireStep = OW_RESET_LOW;
+                break;
+            }
+            oneWirePresence = !(PINB & ONEWIRE_MASK);
+#ifdef LAMP_BENCH
+            if (cycles < benchPresenceMinCycles) benchPresenceMinCycles = cycles;
+            if (cycles > benchPresenceMaxCycles) benchPresenceMaxCycles = cycles;
+#endif
+            oneWireCounter = ONEWIRE_RECOVER_OVERFLOWS;
+            oneWireStep = OW_RESET_RECOVER;
+            break;
+        case OW_RESET_RECOVER:
+            if (--oneWireCounter == 0) {
+                oneWireStep = (oneWirePresence && oneWireTotalLength > 0) ? OW_BITS : OW_DONE;
+            }
+            break;
+        case OW_BITS:
+            if (!prompt) {
+                oneWireEdgeCount = 0; // a full period since any earlier fall by the next overflow
+                break;
+            }
+            oneWireWaitForPeriod();
+            oneWireEdgeCount = TCNT1;
+            oneWireDriveLow();
+            if (oneWireByte < oneWireTxLength) {
+                if (!(oneWireBuffer[oneWireByte] & oneWireBit)) {
+                    oneWireStep = OW_WRITE0_RELEASE; // hold low until the next overflow
+                    break;
+                }
+                __builtin_avr_delay_cycles(24);
+                oneWireRelease();
+            } else {
+                __builtin_avr_delay_cycles(24);
+                oneWireRelease();
+                while ((cycles = oneWireCyclesSince(oneWireEdgeCount)) < ONEWIRE_READ_SAMPLE_CYCLES) {}
+                if (PINB & ONEWIRE_MASK) oneWireBuffer[oneWireByte] |= oneWireBit;
+#ifdef LAMP_BENCH
+                if (cycles > benchReadMaxCycles) benchReadMaxCycles = cycles;
+#endif
+            }
+            oneWireAdvance();
+            break;
+        case OW_WRITE0_RELEASE:
+            oneWireWaitForPeriod();
+            oneWireRelease();
+#ifdef LAMP_BENCH
+            cycles = PWM_TOP + 1 - oneWireEdgeCount + oneWireCyclesSince(0);
+            if (cycles < benchWrite0MinCycles) benchWrite0MinCycles = cycles;
+            if (cycles > benchWrite0MaxCycles) benchWrite0MaxCycles = cycles;
+#endif
+            oneWireEdgeCount = 0; // the next fall is an overflow away
+            oneWireAdvance();
+            break;
+        default:
+            break;
+    }
+    cycles = oneWireCyclesSince(start);
+    oneWireIrqOffCycles += cycles;
+    if (cycles > oneWireSlotMaxCycles) oneWireSlotMaxCycles = cycles;
+}
+
+// Reset, then write txLength bytes and read rxLength bytes. The reset pulse starts here.
+void oneWireStart(const uint8_t* tx, uint8_t txLength, uint8_t rxLength) {
+    memcpy(oneWireBuffer, tx, txLength);
+    memset(oneWireBuffer + txLength, 0, rxLength);
+    oneWireTxLength = txLength;
+    oneWireTotalLength = txLength + rxLength;
+    oneWireByte = 0;
+    oneWireBit = 1;
+    oneWirePresence = false;
+    oneWireIrqOffCycles = 0;
+    oneWireSlotMaxCycles = 0;
+    oneWireCounter = ONEWIRE_RESET_OVERFLOWS;
+    oneWireDriveLow();
+    oneWireStep = OW_RESET_LOW;
+}
+
+// Starts the transaction on the first call and returns true once it has finished.
+// The read bytes are then at oneWireBuffer[txLength].
+bool oneWireTransaction(const uint8_t* tx, uint8_t txLength, uint8_t rxLength) {
+    if (oneWireStep == OW_IDLE) {
+        oneWireStart(tx, txLength, rxLength);
+        return false;
+    }
+    if (oneWireStep != OW_DONE) return false;
+    oneWireStep = OW_IDLE;
+    uint16_t irqOffUs = oneWireIrqOffCycles / (F_CPU / 1000000UL);
+    uint8_t slotMaxUs = oneWireSlotMaxCycles / (F_CPU / 1000000UL);
+    if (irqOffUs != tempBusIrqOffUs || slotMaxUs != tempBusSlotMaxUs) tempBusTimingRevision++;
+    tempBusIrqOffUs = irqOffUs;
+    tempBusSlotMaxUs = slotMaxUs;
+    return true;
+}
+
+uint8_t dallasCrc(const uint8_t* data, uint8_t length) {
+    uint8_t crc = 0;
+    while (length--) crc = _crc_ibutton_update(crc, *data++);
+    return crc;
+}
+
+enum TempSensorPhase : uint8_t {
+  TEMP_IDLE,
+  TEMP_READ_ROM,
+  TEMP_CONFIGURE,
+  TEMP_CONVERT,
+  TEMP_CONVERTING,
+  TEMP_READ_SCRATCHPAD
+};
+
+TempSensorPhase tempPhase = TEMP_IDLE;
+uint8_t ledSensorRom[8];
+bool ledSensorFound = false;
+uint8_t tempResolutionBits = 0;     // as configured in the sensor, 0 = unknown
+uint8_t tempWantedBits = 12;
+uint8_t tempAlarmHigh = 0x7F;       // TH/TL are rewritten along with the resolution
+uint8_t tempAlarmLow = 0x80;
+unsigned long tempConvertStart = 0;
+
+// Faster, coarser conversions while the LED is heating up quickly
+uint8_t chooseTemperatureResolution() {
+    if (thermalRate >= 10) return 9;   // >= 0.1 C/s
+    if (thermalRate >= 5) return 10;
+    if (thermalRate >= 2) return 11;
+    return 12;
+}
+
+uint16_t conversionTimeMs(uint8_t bits) {
+    return (750 >> (12 - bits)) + 5;
+}
+
+// MATCH ROM + command, for the cached sensor
+uint8_t addressSensor(uint8_t* tx, uint8_t command) {
+    tx[0] = DS_MATCH_ROM;
+    memcpy(tx + 1, ledSensorRom, 8);
+    tx[9] = command;
+    return 10;
+}
+
+// Per pass: moves the current sequence on by at most one transaction
+void serviceTemperatureSensor() {
+    if (tempPhase == TEMP_IDLE) return;
+    uint8_t tx[ONEWIRE_BUFFER_SIZE];
+    uint8_t length;
+
+    switch (tempPhase) {
+        case TEMP_READ_ROM:
+            tx[0] = DS_READ_ROM;
+            if (!oneWireTransaction(tx, 1, 8)) return;
+            if (oneWirePresence && oneWireBuffer[1] == DS18B20_FAMILY && dallasCrc(oneWireBuffer + 1, 7) == oneWireBuffer[8]) {
+                memcpy(ledSensorRom, oneWireBuffer + 1, 8);
+                ledSensorFound = true;
+                tempPhase = tempWantedBits != tempResolutionBits ? TEMP_CONFIGURE : TEMP_CONVERT;
+            } else {
+                tempPhase = TEMP_IDLE; // retried on the next temperature task run
+            }
+            break;
+
+        case TEMP_CONFIGURE:
+            length = addressSensor(tx, DS_WRITE_SCRATCHPAD);
+            tx[length++] = tempAlarmHigh;
+            tx[length++] = tempAlarmLow;
+            tx[length++] = ((tempWantedBits - 9) << 5) | 0x1F;
+            if (!oneWireTransaction(tx, length, 0)) return;
+            if (!oneWirePresence) {
+                ledSensorFound = false;
+                tempPhase = TEMP_IDLE;
+                break;
+            }
+            tempResolutionBits = tempWantedBits;
+            tempPhase = TEMP_CONVERT;
+            break;
+
+        case TEMP_CONVERT:
+            length = addressSensor(tx, DS_CONVERT_T);
+            if (!oneWireTransaction(tx, length, 0)) return;
+            if (!oneWirePresence) {
+                ledSensorFound = false;
+                tempPhase = TEMP_IDLE;
+                break;
+            }
+            tempConvertStart = millis();
+            tempPhase = TEMP_CONVERTING;
+            break;
+
+        case TEMP_CONVERTING:
+            if (millis() - tempConvertStart >= conversionTimeMs(tempResolutionBits)) tempPhase = TEMP_READ_SCRATCHPAD;
+            break;
+
+        case TEMP_READ_SCRATCHPAD: {
+            length = addressSensor(tx, DS_READ_SCRATCHPAD);
+            if (!oneWireTransaction(tx, length, 9)) return;
+            tempPhase = TEMP_IDLE;
+            const uint8_t* pad = oneWireBuffer + length;
+            if (!oneWirePresence) {
+                ledSensorFound = false;
+            } else if (dallasCrc(pad, 8) == pad[8]) {
+                tempAlarmHigh = pad[2];
+                tempAlarmLow = pad[3];
+                tempResolutionBits = ((pad[4] >> 5) & 0x03) + 9;
+                // Bits below the resolution are undefined
+                int16_t raw = (int16_t)(pad[1] << 8 | pad[0]) & ~((1 << (12 - tempResolutionBits)) - 1);
+                ledTemperature = ((int32_t)raw * 25) >> 2; // 1/16 C -> 1/100 C
+                ledTemperatureFresh = true;
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+void startTemperatureSensor() {
+    PORTB &= ~ONEWIRE_MASK;  // driving the bus only ever means pulling it low
+    oneWireRelease();
+}
+
+// NEW: Full-screen overheat message (avoids overlapping headers)
+void drawOverheatScreen() {
+    u8g2.setFont(u8g2_font_7x13B_tr);
+    u8g2_uint_t w = u8g2.getStrWidth("Overheat Danger!");
+    u8g2.drawStr((128 - w) / 2, 26, "Overheat Danger!");
+    // Show current temperature
+    char tempStr[CENTI_C_TEXT_SIZE];
+    formatCentiC(tempStr, ledTemperature);
+    u8g2.setFont(u8g2_font_ncenB14_tr);
+    w = u8g2.getStrWidth(tempStr);
+    u8g2.drawStr((128 - w) / 2, 46, tempStr);
+    u8g2.setFont(u8g2_font_6x12_tr);
+    const char* msg = "Cooling...";
+    w = u8g2.getStrWidth(msg);
+    u8g2.drawStr((128 - w) / 2, 62, msg);
+}
+
+// NEW: Overheat warn screen with capped power and temperature
+// MODIFIED: Also shown for the charging cap, under its own title
+void drawOverheatWarnScreen() {
+    u8g2.setFont(u8g2_font_7x13B_tr);
+    const char* title = isOverheatWarn ? "Thermal Limit" : "Charge Limit";
+    u8g2_uint_t w = u8g2.getStrWidth(title);
+    u8g2.drawStr((128 - w) / 2, 18, title);
+    // Show the actual (limited) output
+    u8g2.setFont(u8g2_font_ncenB14_tr);
+    char buf[12];
+    // MODIFIED: The ceilings are LED power; shown as the brightness they allow
+    uint8_t limit = brightnessCeiling;
+    uint8_t shown = brightness > limit ? limit : brightness;
+    snprintf(buf, sizeof(buf), "%u%%", shown);
+    w = u8g2.getStrWidth(buf);
+    u8g2.drawStr((128 - w) / 2, 38, buf);
+    // Show temperature
+    char tempStr[CENTI_C_TEXT_SIZE];
+    formatCentiC(tempStr, ledTemperature);
+    u8g2.setFont(u8g2_font_6x12_tr);
+    char tline[22];
+    snprintf(tline, sizeof(tline), "Temp: %s C", tempStr);
+    w = u8g2.getStrWidth(tline);
+    u8g2.drawStr((128 - w) / 2, 52, tline);
+    char msg[22];
+    snprintf(msg, sizeof(msg), "Set %u%%  Max %u%%", (uint8_t)brightness, limit);
+    w = u8g2.getStrWidth(msg);
+    u8g2.drawStr((128 - w) / 2, 64, msg);
+}
+
+
+// --- Background ADC Acquisition Pipeline ---
+// The ADC is auto-triggered by the Timer1 overflow, so every conversion samples
+// at the same point of the LED PWM cycle (2 ADC clocks after BOTTOM; the trigger
+// resets the prescaler) instead of at random phases. The interrupt walks a fixed
+// slot sequence: battery divider samples go into a ring buffer with a running sum,
+// the internal 1.1 V bandgap is sampled at the end of each round, and both are
+// IIR-filtered once per round.
+// The Timer1 overflow interrupt clears TOV1, which re-arms the trigger.
+const uint8_t ADC_SEQ_SLOTS = 16;            // conversions per round (power of two)
+const uint8_t ADC_BANDGAP_FIRST_SLOT = 12;   // slots 12..15 sample the bandgap
+const uint8_t ADC_BATTERY_SETTLE_SLOTS = 1;  // samples dropped after switching to the divider
+const uint8_t ADC_BANDGAP_SETTLE_SLOTS = 2;  // samples dropped while the bandgap input settles
+const uint8_t ADC_RING_SIZE = 8;             // power of two
+const uint8_t ADC_FILTER_SHIFT = 3;          // IIR weight 1/8 per round
+const uint8_t ADC_FILTER_EXTRA_SHIFT = 3;    // filter state kept at 64x a sample
+const uint16_t ADC_SAMPLE_COUNT = 2 * 128;   // Timer1 count at the sample and hold
+// AVcc reference; MUX selects A1 or the 1.1 V bandgap (MUX3..1)
+const uint8_t ADMUX_BATTERY = _BV(REFS0) | (VOLTAGE_SENSE_PIN - A0);
+const uint8_t ADMUX_BANDGAP = _BV(REFS0) | _BV(MUX3) | _BV(MUX2) | _BV(MUX1);
+
+volatile uint8_t adcSlot = 0;
+uint16_t adcBatteryRing[ADC_RING_SIZE];
+uint8_t adcBatteryRingIndex = 0;
+uint16_t adcBatteryRingSum = 0;       // sum of the ring = 8x the mean sample
+uint16_t adcBandgapRoundSum = 0;
+// Filtered readings, both scaled to 64x a single 10-bit sample (1023 * 64 still fits),
+// so the 1/8 steps keep fractions of an LSB. 0 = not primed yet.
+volatile uint16_t adcBatteryFiltered = 0;
+volatile uint16_t adcBandgapFiltered = 0;
+
+void startAdcPipeline() {
+    ADMUX = ADMUX_BATTERY;
+    DIDR0 |= _BV(ADC1D);                           // no digital input buffer on the sense pin
+    ADCSRB = _BV(ADTS2) | _BV(ADTS1);              // trigger: Timer1 overflow
+    ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) |  // auto-trigger, interrupt on completion
+             _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0); // 125 kHz ADC clock
+}
+
+// One round of the IIR filter: filtered moves 1/8 of the way to input. filtered is
+// at 64x a sample, input at 8x a sample (a ring or round sum). The step is rounded:
+// truncated, it has a dead band of a whole 1/8 step on the rising side only, and the
+// bandgap reading (about 225) would sit anywhere in it, half a percent of the battery
+// reading.
+uint16_t filterStep(uint16_t filtered, uint16_t input) {
+    input <<= ADC_FILTER_EXTRA_SHIFT;
+    if (filtered == 0) return input;
+    int32_t step = ((int32_t)input - filtered + (1 << (ADC_FILTER_SHIFT - 1))) >> ADC_FILTER_SHIFT;
+    return filtered + (int16_t)step;
+}
+
+ISR(ADC_vect) {
+    uint16_t sample = ADC;
+    uint8_t slot = adcSlot;
+    uint8_t next = (slot + 1) & (ADC_SEQ_SLOTS - 1);
+    // The next conversion starts at the next overflow, so the mux can change now
+    ADMUX = next >= ADC_BANDGAP_FIRST_SLOT ? ADMUX_BANDGAP : ADMUX_BATTERY;
+    adcSlot = next;
+
+    if (slot >= ADC_BANDGAP_FIRST_SLOT + ADC_BANDGAP_SETTLE_SLOTS) {
+        adcBandgapRoundSum += sample;
+    } else if (slot >= ADC_BATTERY_SETTLE_SLOTS && slot < ADC_BANDGAP_FIRST_SLOT) {
+        adcBatteryRingSum += sample - adcBatteryRing[adcBatteryRingIndex];
+        adcBatteryRing[adcBatteryRingIndex] = sample;
+        adcBatteryRingIndex = (adcBatteryRingIndex + 1) & (ADC_RING_SIZE - 1);
+    }
+
+    if (next == 0) {
+        const uint8_t bandgapSamples = ADC_SEQ_SLOTS - ADC_BANDGAP_FIRST_SLOT - ADC_BANDGAP_SETTLE_SLOTS;
+        adcBatteryFiltered = filterStep(adcBatteryFiltered, adcBatteryRingSum);
+        adcBandgapFiltered = filterStep(adcBandgapFiltered, adcBandgapRoundSum * (ADC_RING_SIZE / bandgapSamples));
+        adcBandgapRoundSum = 0;
+    }
+}
+
+// --- Journaled Settings ---
+// The user's state lives in EEPROM 0..127 as a journal of eight 16-byte slots.
+// Every save goes to the slot after the newest one with the sequence number
+// bumped, so wear is spread over all slots and a save torn by a power loss only
+// costs that record: its CRC fails and the previous slot is still the newest.
+// Changes are saved once they have been stable for SETTINGS_SETTLE_MS, not on
+// every encoder tick. The bytes go out through the same one-byte-per-pass
+// EEPROM writer as the telemetry log.
+//
+// Slot layout: magic, sequence, brightness, lastBrightness, mode, presets[4],
+// lamp on, full-charge reading in mV (lo, hi; 0 = not calibrated), colour
+// temperature step, fade step (0 = the default rate), 1 reserved byte (0), CRC-8
+// over the first 15 bytes.
+const uint8_t SETTINGS_SLOTS = 8;
+const uint8_t SETTINGS_SLOT_SIZE = 16;
+const uint8_t SETTINGS_MAGIC = 0x5A;
+const unsigned long SETTINGS_SETTLE_MS = 5000;
+
+// MODIFIED: Packed: it is compared and stored byte for byte, so it must not have
+// padding (none on AVR, but the host build aligns fullChargeMv)
+struct __attribute__((packed)) SettingsImage {
+  uint8_t brightness;
+  uint8_t lastBrightness;
+  uint8_t mode;
+  uint8_t presets[4];
+  uint8_t lampOn;
+  uint16_t fullChargeMv; // NEW: battery calibration, see Charging
+  uint8_t colorTempStep; // NEW: warm/cool mix
+  uint8_t fadeStep;      // NEW: fade speed, see setFadeRate()
+};
+
+uint8_t settingsSlot = SETTINGS_SLOTS - 1; // slot of the newest record
+uint8_t settingsSeq = 0;
+SettingsImage settingsSaved;               // what the newest record holds (or will)
+SettingsImage settingsSeen;                // live settings as of settingsChangedAt
+unsigned long settingsChangedAt = 0;
+bool settingsFlushRequested = false;
+uint8_t settingsJob[SETTINGS_SLOT_SIZE];
+uint8_t settingsJobIndex = SETTINGS_SLOT_SIZE; // == size: no save in flight
+
+uint8_t* settingsSlotAddress(uint8_t slot) {
+    return (uint8_t*)(uintptr_t)((uint16_t)slot * SETTINGS_SLOT_SIZE);
+}
+
+uint8_t settingsCrc(const uint8_t* data, uint8_t length) {
+    uint8_t crc = 0;
+    while (length--) crc = _crc8_ccitt_update(crc, *data++);
+    return crc;
+}
+
+void captureSettings(SettingsImage& image) {
+    image.brightness = brightness;
+    image.lastBrightness = lastBrightness;
+    image.mode = currentMode;
+    for (uint8_t i = 0; i < 4; i++) image.presets[i] = presets[i];
+    image.lampOn = isLampOn;
+    image.fullChargeMv = batteryFullChargeMv;
+    image.colorTempStep = colorTempStep;
+    image.fadeStep = fadeStep;
+}
+
+// Load the newest valid record. Runs first thing in setup() so the outputs and
+// the encoder start from the restored values.
+void restoreSettings() {
+    uint8_t record[SETTINGS_SLOT_SIZE];
+    bool found = false;
+    for (uint8_t slot = 0; slot < SETTINGS_SLOTS; slot++) {
+        eeprom_read_block(record, settingsSlotAddress(slot), SETTINGS_SLOT_SIZE);
+        if (record[0] != SETTINGS_MAGIC) continue;
+        if (settingsCrc(record, SETTINGS_SLOT_SIZE - 1) != record[SETTINGS_SLOT_SIZE - 1]) continue;
+        // Sequence numbers wrap, so compare them as a signed distance
+        if (found && (int8_t)(record[1] - settingsSeq) <= 0) continue;
+        found = true;
+        settingsSlot = slot;
+        settingsSeq = record[1];
+        memcpy(&settingsSaved, &record[2], sizeof(settingsSaved));
+    }
+
+    if (found) {
+        brightness = constrain(settingsSaved.brightness, 0, 100);
+        lastBrightness = constrain(settingsSaved.lastBrightness, 0, 100);
+        currentMode = settingsSaved.mode <= MODE_COLOR_TEMP ? (LampMode)settingsSaved.mode : MODE_SMOOTH_DIM;
+        for (uint8_t i = 0; i < 4; i++) presets[i] = constrain(settingsSaved.presets[i], 1, 100);
+        isLampOn = settingsSaved.lampOn != 0;
+        if (isValidFullChargeReading(settingsSaved.fullChargeMv)) batteryFullChargeMv = settingsSaved.fullChargeMv;
+        // An image from before the colour mix has 0 here: the warmest step
+        if (settingsSaved.colorTempStep < CCT_STEPS) colorTempStep = settingsSaved.colorTempStep;
+        // An image from before the fade setting has 0 here: the default rate
+        if (settingsSaved.fadeStep != 0) fadeStep = settingsSaved.fadeStep;
+    }
+    captureSettings(settingsSaved);
+    settingsSeen = settingsSaved;
+}
+
+// Skip the settle delay and save now (used before powering down)
+void requestSettingsFlush() {
+    settingsFlushRequested = true;
+}
+
+void serviceSettings(unsigned long now) {
+    SettingsImage current;
+    captureSettings(current);
+    if (memcmp(&current, &settingsSeen, sizeof(current)) != 0) {
+        settingsSeen = current;
+        settingsChangedAt = now;
+    }
+
+    if (settingsJobIndex < SETTINGS_SLOT_SIZE) return; // previous save still going out
+    if (memcmp(&settingsSeen, &settingsSaved, sizeof(settingsSeen)) == 0) {
+        settingsFlushRequested = false;
+        return;
+    }
+    if (!settingsFlushRequested && now - settingsChangedAt < SETTINGS_SETTLE_MS) return;
+
+    settingsSlot = (settingsSlot + 1) % SETTINGS_SLOTS;
+    settingsSaved = settingsSeen;
+    memset(settingsJob, 0, sizeof(settingsJob));
+    settingsJob[0] = SETTINGS_MAGIC;
+    settingsJob[1] = ++settingsSeq;
+    memcpy(&settingsJob[2], &settingsSaved, sizeof(settingsSaved));
+    settingsJob[SETTINGS_SLOT_SIZE - 1] = settingsCrc(settingsJob, SETTINGS_SLOT_SIZE - 1);
+    settingsJobIndex = 0;
+}
+
+// --- EEPROM Telemetry Log ---
+// A ring of 4-byte records in EEPROM above the settings area, appended from the
+// battery task. The first record of a boot and any change too large for a delta
+// is written as a pair of keyframes; after that each interval costs one delta
+// record. State changes between intervals add an event record. Wear leveling
+// comes from the ring itself: every slot is written once per lap.
+//
+// Record layout, header byte first:
+//   header  [7] lap epoch  [6:5] kind  [4:3] state  [2] critical  [1] warn  [0] lamp on
+//   KEY_BATTERY  battery 10 mV (hi, lo), brightness | 0x80 on the first record after boot
+//   KEY_TEMP     temperature 0.1 C (hi, lo), brightness
+//   DELTA        battery delta 10 mV (int8), temperature delta 0.1 C (int8), brightness
+//   EVENT        seconds since the last interval record (hi, lo), brightness
+// The state field never holds 3, so a written header is never 0xFF (erased).
+// The write position is found at boot as the first slot whose epoch differs
+// from slot 0. Bytes go out one per pass whenever the EEPROM is ready, header
+// last, so a reset mid-record never moves the write position.
+const uint16_t LOG_EEPROM_BASE = 128;        // 0..127 reserved for settings
+const uint8_t LOG_RECORD_SIZE = 4;
+const uint8_t LOG_SLOTS = (E2END + 1 - LOG_EEPROM_BASE) / LOG_RECORD_SIZE;
+const unsigned long LOG_INTERVAL_MS = 300000UL; // 5 minutes: 224 slots hold ~18 hours
+const unsigned long LOG_FIRST_RECORD_MS = 6000; // let both sensors produce a reading first
+const uint8_t LOG_QUEUE_RECORDS = 4;
+const uint8_t LOG_FORMAT_VERSION = 1;
+
+enum LogRecordKind : uint8_t {
+  LOG_KEY_BATTERY,
+  LOG_KEY_TEMP,
+  LOG_DELTA,
+  LOG_EVENT
+};
+
+uint8_t logHead = 0;          // next slot to write
+uint8_t logEpoch = 0;         // epoch bit of the current lap (0 or 0x80)
+uint8_t logQueue[LOG_QUEUE_RECORDS][LOG_RECORD_SIZE];
+uint8_t logQueueFirst = 0;
+uint8_t logQueueCount = 0;
+uint8_t logWriteStep = 0;     // bytes of the front record already written
+uint16_t logDropped = 0;
+bool logBooted = false;       // boot keyframes written
+bool logNeedsKeyframe = true;
+uint16_t logLastBattery = 0;  // 10 mV, as reconstructed by the decoder
+int16_t logLastTemp = 0;      // 0.1 C, as reconstructed by the decoder
+uint8_t logLastFlags = 0;
+unsigned long logLastIntervalRecord = 0;
+
+// Streaming dump state; the write position is frozen while a dump runs
+bool logDumpActive = false;
+uint16_t logDumpIndex = 0;
+
+uint8_t* logSlotAddress(uint8_t slot) {
+    return (uint8_t*)(uintptr_t)(LOG_EEPROM_BASE + (uint16_t)slot * LOG_RECORD_SIZE);
+}
+
+void initTelemetryLog() {
+    uint8_t firstEpoch = eeprom_read_byte(logSlotAddress(0)) & 0x80;
+    uint8_t slot = 1;
+    while (slot < LOG_SLOTS && (eeprom_read_byte(logSlotAddress(slot)) & 0x80) == firstEpoch) slot++;
+    if (slot == LOG_SLOTS) {
+        // Every slot is on the same lap (or erased): start the next lap at slot 0
+        logHead = 0;
+        logEpoch = firstEpoch ^ 0x80;
+    } else {
+        logHead = slot;
+        logEpoch = firstEpoch;
+    }
+}
+
+uint8_t logStateFlags() {
+    uint8_t state = 0;
+    if (currentState == STATE_CHARGING) state = 1;
+    else if (currentState == STATE_LOW_BATTERY) state = 2;
+    return (state << 3) | (isOverheatCritical ? 0x04 : 0) | (isOverheatWarn ? 0x02 : 0) | (isLampOn ? 0x01 : 0);
+}
+
+void logAppend(LogRecordKind kind, uint8_t flags, uint8_t a, uint8_t b, uint8_t c) {
+    if (logQueueCount == LOG_QUEUE_RECORDS) {
+        logDropped++;
+        return;
+    }
+    uint8_t* record = logQueue[(logQueueFirst + logQueueCount) % LOG_QUEUE_RECORDS];
+    record[0] = (kind << 5) | flags; // epoch is added when the slot is written
+    record[1] = a;
+    record[2] = b;
+    record[3] = c;
+    logQueueCount++;
+}
+
+void logTelemetry(unsigned long now) {
+    if (now < LOG_FIRST_RECORD_MS) return;
+    uint8_t flags = logStateFlags();
+    bool intervalDue = !logBooted || now - logLastIntervalRecord >= LOG_INTERVAL_MS;
+
+    if (!intervalDue) {
+        if (flags != logLastFlags) {
+            uint16_t seconds = (now - logLastIntervalRecord) / 1000;
+            logAppend(LOG_EVENT, flags, seconds >> 8, seconds & 0xFF, brightness);
+            logLastFlags = flags;
+        }
+        return;
+    }
+
+    uint16_t battery = millivoltsToCentiVolts(batteryMillivolts);
+    int16_t temp = centiCToDeciC(ledTemperature);
+    int16_t batteryDelta = (int16_t)(battery - logLastBattery);
+    int16_t tempDelta = temp - logLastTemp;
+    if (logNeedsKeyframe || batteryDelta < INT8_MIN || batteryDelta > INT8_MAX ||
+        tempDelta < INT8_MIN || tempDelta > INT8_MAX) {
+        logAppend(LOG_KEY_BATTERY, flags, battery >> 8, battery & 0xFF, brightness | (logBooted ? 0 : 0x80));
+        logAppend(LOG_KEY_TEMP, flags, (uint16_t)temp >> 8, temp & 0xFF, brightness);
+        logNeedsKeyframe = false;
+        logLastBattery = battery;
+        logLastTemp = temp;
+    } else {
+        logAppend(LOG_DELTA, flags, (int8_t)batteryDelta, (int8_t)tempDelta, brightness);
+        logLastBattery += batteryDelta;
+        logLastTemp += tempDelta;
+    }
+    logBooted = true;
+    logLastFlags = flags;
+    logLastIntervalRecord = now;
+}
+
+// One EEPROM byte per call, and only when the previous write has finished.
+// A settings save goes first: it is short and holds the user's state.
+void serviceEeprom() {
+    if (!eeprom_is_ready()) return;
+    if (settingsJobIndex < SETTINGS_SLOT_SIZE) {
+        eeprom_update_byte(settingsSlotAddress(settingsSlot) + settingsJobIndex, settingsJob[settingsJobIndex]);
+        settingsJobIndex++;
+        return;
+    }
+    if (logQueueCount == 0 || logDumpActive) return;
+
+    const uint8_t* record = logQueue[logQueueFirst];
+    uint8_t* address = logSlotAddress(logHead);
+    if (logWriteStep < LOG_RECORD_SIZE - 1) {
+        uint8_t index = logWriteStep + 1;
+        eeprom_update_byte(address + index, record[index]);
+        logWriteStep++;
+        return;
+    }
+
+    eeprom_update_byte(address, record[0] | logEpoch);
+    logWriteStep = 0;
+    logQueueFirst = (logQueueFirst + 1) % LOG_QUEUE_RECORDS;
+    logQueueCount--;
+    if (++logHead == LOG_SLOTS) {
+        logHead = 0;
+        logEpoch ^= 0x80;
+    }
+}
+
+// Nothing queued for the EEPROM and no settings save pending
+bool isEepromIdle() {
+    return logQueueCount == 0 && settingsJobIndex == SETTINGS_SLOT_SIZE && !settingsFlushRequested;
+}
+
+// Dump stream: "TLOG", version, slot count, interval seconds (hi, lo), then every
+// slot oldest first. Sent in LOG_CHUNK frames as fast as the UART drains, and
+// ended by an empty chunk.
+const uint8_t LOG_DUMP_HEADER_SIZE = 8;
+const uint16_t LOG_DUMP_SIZE = LOG_DUMP_HEADER_SIZE + (uint16_t)LOG_SLOTS * LOG_RECORD_SIZE;
+
+uint8_t logDumpByte(uint16_t index) {
+    if (index < LOG_DUMP_HEADER_SIZE) {
+        const uint16_t intervalSeconds = LOG_INTERVAL_MS / 1000;
+        switch (index) {
+            case 0: return 'T';
+            case 1: return 'L';
+            case 2: return 'O';
+            case 3: return 'G';
+            case 4: return LOG_FORMAT_VERSION;
+            case 5: return LOG_SLOTS;
+            case 6: return intervalSeconds >> 8;
+            default: return intervalSeconds & 0xFF;
+        }
+    }
+    index -= LOG_DUMP_HEADER_SIZE;
+    uint8_t slot = (logHead + index / LOG_RECORD_SIZE) % LOG_SLOTS;
+    return eeprom_read_byte(logSlotAddress(slot) + index % LOG_RECORD_SIZE);
+}
+
+// MODIFIED: Started by the LOG_DUMP command of the serial protocol
+void startLogDump() {
+    logDumpActive = true;
+    logDumpIndex = 0;
+}
+
+// MODIFIED: A chunk only goes out while a reply would still fit behind it, so the
+// serial protocol keeps reading and answering commands during a dump
+void serviceLogDump() {
+    if (!logDumpActive || !canSendFrame(FRAME_MAX_PAYLOAD + FRAME_OVERHEAD + FRAME_MAX_PAYLOAD)) return;
+    uint8_t chunk[FRAME_MAX_PAYLOAD];
+    uint8_t length = 0;
+    while (length < FRAME_MAX_PAYLOAD && logDumpIndex < LOG_DUMP_SIZE) {
+        chunk[length++] = logDumpByte(logDumpIndex++);
+    }
+    sendFrame(FRAME_LOG_CHUNK, chunk, length);
+    if (length == 0) logDumpActive = false;
+}
+
+// --- Idle Power Management ---
+// After each loop() pass the MCU sleeps until the next interrupt. While the LED
+// is lit (or anything is still in motion) that is SLEEP_MODE_IDLE: Timer1, Timer0,
+// the ADC and the TWI keep running and wake it. Once the lamp is off and fully
+// settled it uses standby instead. It then wakes on a pin change on the
+// encoder, button or IR receiver, or on a 1 s watchdog tick that keeps the
+// battery and temperature tasks polling. millis() does not run in standby.
+// MODIFIED: Standby rather than power-down, for the IR receiver. It samples the
+// line from Timer2, which stops in both. Waking from power-down takes the crystal
+// start-up time (16K CK, 1 ms with the Nano's fuses) before Timer2 runs again,
+// and that much of the leader mark of the frame that woke the MCU goes unseen.
+// Standby keeps the oscillator running and wakes in 6 cycles, so that frame is
+// received in full. The cost is the running oscillator, about 0.2 mA.
+// The watchdog period is added back on a tick wake. A pin wake cannot know how
+// far into the tick it came, so millis() can lose up to one tick per pin wake.
+// MODIFIED: When no task is due for a while (idle sensor polling) the tick is 8 s.
+const unsigned long WDT_TICK_MS = 1000;            // WDP2|WDP1, nominal
+const unsigned long WDT_LONG_TICK_MS = 8000;       // WDP3|WDP0, nominal
+const unsigned long POWER_DOWN_HOLD_MS = 1000;     // stay up after a pin wake: debounce, encoder, IR frame
+const unsigned long POWER_STATS_WINDOW_MS = 10000;
+// ATmega328P supply current at 16 MHz / 5 V (datasheet typicals)
+const uint16_t MCU_ACTIVE_UA = 9500;
+const uint16_t MCU_IDLE_UA = 2500;
+const uint16_t MCU_STANDBY_UA = 200;     // estimate: low-power crystal oscillator kept running
+
+extern volatile unsigned long timer0_millis; // Arduino core (wiring.c)
+
+unsigned long lastPinWake = 0;
+unsigned long powerIdleUs = 0;       // time asleep in idle, current window
+unsigned long powerDownMs = 0;       // time asleep in standby, current window
+unsigned long powerWindowStart = 0;
+uint8_t awakePercent = 100;          // last window: share of time the CPU was running
+uint16_t savedMicroamps = 0;         // last window: MCU current saved vs. never sleeping
+
+ISR(WDT_vect) {
+    // Wake only
+}
+
+void updatePowerStats(unsigned long now) {
+    unsigned long window = now - powerWindowStart;
+    if (window < POWER_STATS_WINDOW_MS) return;
+    unsigned long idleMs = powerIdleUs / 1000;
+    unsigned long asleepMs = min(idleMs + powerDownMs, window);
+    awakePercent = 100 - asleepMs * 100 / window;
+    savedMicroamps = (idleMs * (MCU_ACTIVE_UA - MCU_IDLE_UA) +
+                      powerDownMs * (MCU_ACTIVE_UA - MCU_STANDBY_UA)) / window;
+    powerIdleUs = 0;
+    powerDownMs = 0;
+    powerWindowStart = now;
+}
+
+bool canPowerDown(unsigned long now) {
+#ifdef LAMP_BENCH
+    return false; // the benchmark clock is Timer1, which stops in standby
+#else
+    if (isLampOn || currentState != STATE_OPERATING) return false;
+    uint16_t level;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        level = fadeLevel;
+    }
+    if (level != 0 || isPatternActive()) return false;
+    if (isDisplayFrameInFlight() || !isEepromIdle() || logDumpActive || isOneWireBusy()) return false;
+    if (!isSerialIdle() || bootStage != BOOT_DONE) return false;
+    if (!IrReceiver.isIdle() || irFrameReady || digitalRead(ENCODER_SWITCH_PIN) == LOW) return false;
+    return now - lastPinWake >= POWER_DOWN_HOLD_MS;
+#endif
+}
+
+void powerDown() {
+    uint8_t adcsra = ADCSRA;
+    ADCSRA = adcsra & ~_BV(ADEN);
+    // Timer1 stops wherever it is, so make sure OC1A/OC1B cannot be left high
+    disconnectOutputs();
+
+    // The input pins already raise PCINT2; the IR and UART RX lines only need to while
+    // asleep. The UART byte that wakes the MCU is lost, so the host client retries
+    // once. The IR frame that wakes it is not (see above).
+    PCMSK2 |= _BV(digitalPinToPCMSKbit(IR_RECEIVE_PIN)) | _BV(digitalPinToPCMSKbit(UART_RX_PIN));
+    wokeByPin = false;
+
+    bool isLongTick = msUntilNextRelease(millis()) >= WDT_LONG_TICK_MS;
+    // MODIFIED: Standby, so the IR receiver runs again within cycles of a wake
+    set_sleep_mode(SLEEP_MODE_STANDBY);
+    noInterrupts();
+    // Watchdog in interrupt-only mode (no reset)
+    MCUSR &= ~_BV(WDRF);
+    WDTCSR = _BV(WDCE) | _BV(WDE);
+    WDTCSR = _BV(WDIE) | (isLongTick ? _BV(WDP3) | _BV(WDP0) : _BV(WDP2) | _BV(WDP1));
+    sleep_enable();
+    sleep_bod_disable();
+    interrupts();
+    sleep_cpu();
+    sleep_disable();
+    wdt_disable();
+    PCMSK2 &= ~(_BV(digitalPinToPCMSKbit(IR_RECEIVE_PIN)) | _BV(digitalPinToPCMSKbit(UART_RX_PIN)));
+
+    unsigned long slept = wokeByPin ? 0 : (isLongTick ? WDT_LONG_TICK_MS : WDT_TICK_MS);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        timer0_millis += slept;
+    }
+    powerDownMs += slept;
+    if (wokeByPin) lastPinWake = millis();
+
+    TCCR1A |= PWM_COMPARE_OUTPUTS;
+    ADCSRA = adcsra;
+}
+
+// Called at the end of every loop() pass
+void idleSleep() {
+    unsigned long now = millis();
+    updatePowerStats(now);
+    if (canPowerDown(now)) {
+        powerDown();
+        return;
+    }
+    if (displayDirtyPages != 0) return; // more OLED pages to render right away
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    unsigned long start = micros();
+    noInterrupts();
+    sleep_enable();
+    interrupts();
+    sleep_cpu();
+    sleep_disable();
+    powerIdleUs += micros() - start;
+}
+
+// --- Remaining Runtime Estimator ---
+// Minutes left = remaining charge / current at a given brightness. The current
+// model is the system draw plus the LED current scaled by the PWM duty from the
+// brightness table. The remaining charge comes from batteryPercent and the pack
+// capacity. The model is corrected by a factor learned from the battery itself:
+// each window times a fixed fall in open-circuit voltage, converts it to percent
+// through the discharge curve and compares that rate with the model's at the
+// window's average current; the ratio is slowly averaged in. Timing a fixed fall,
+// rather than sampling a slope over a fixed time, keeps ADC noise from biasing the
+// trend where the curve is flat. Each sensor tick costs a few multiplies,
+// independent of history length.
+const uint16_t BATTERY_CAPACITY_MAH = 2600;   // 2S pack of 2600 mAh cells
+const uint16_t LED_CURRENT_FULL_MA = 1200;    // LED driver draw at 100% duty, per channel
+const uint16_t SYSTEM_CURRENT_MA = 15;        // MCU, OLED and sensors
+const millivolts_t RUNTIME_TREND_DROP_MV = 60; // several ADC steps
+const unsigned long RUNTIME_TREND_MAX_MS = 4 * 3600000UL; // slower falls are not a discharge trend
+const uint16_t RUNTIME_GAIN_ONE = 256;        // correction factor, Q8
+const uint16_t RUNTIME_MAX_MINUTES = 99 * 60 + 59;
+
+uint16_t runtimeGain = RUNTIME_GAIN_ONE;      // trend / model, clamped to 0.5..2
+int32_t runtimeOcvQ4 = 0;                     // NEW: smoothed open-circuit voltage, mV Q4
+millivolts_t runtimeWindowStartMv = 0;
+unsigned long runtimeWindowStart = 0;
+uint32_t runtimeWindowCurrentSum = 0;         // sum of per-tick current, mA
+uint16_t runtimeWindowTicks = 0;
+uint16_t runtimeMinutes = 0;                  // at the current setting
+uint16_t presetRuntimeMinutes[4];
+uint16_t presetRuntimeRevision = 0;           // bumped whenever one of them changes, for the display
+
+uint16_t currentForDutyMa(uint16_t duty) {
+    // MODIFIED: Both channels, as split by the colour mix
+    uint32_t channelDuty = ((uint32_t)duty * colorMixPowerQ8) >> 8;
+    return SYSTEM_CURRENT_MA + (uint32_t)LED_CURRENT_FULL_MA * channelDuty / ((PWM_TOP + 1UL) * 16);
+}
+
+uint16_t estimateRuntimeMinutes(uint8_t percent) {
+    uint32_t remainingMah = (uint32_t)batteryPercent * BATTERY_CAPACITY_MAH / 100;
+    uint32_t minutes = remainingMah * 60 * runtimeGain / RUNTIME_GAIN_ONE / currentForDutyMa(brightnessToDuty(percent));
+    return min(minutes, (uint32_t)RUNTIME_MAX_MINUTES);
+}
+
+// Once per battery task, after updateBatteryStats()
+void updateRuntimeEstimate(unsigned long now) {
+    uint16_t duty;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        duty = drivenDuty();
+    }
+    // NEW: The fall is timed on a smoothed voltage. On the raw one the first noisy
+    // low reading ends a window, so every window would come out short.
+    if (runtimeOcvQ4 == 0) runtimeOcvQ4 = (int32_t)batteryOcvMillivolts << 4;
+    else runtimeOcvQ4 += (((int32_t)batteryOcvMillivolts << 4) - runtimeOcvQ4) >> 4;
+    millivolts_t ocv = runtimeOcvQ4 >> 4;
+    // A window starts on the first tick, and again after a charge or a stall
+    if (runtimeWindowTicks == 0 || ocv > runtimeWindowStartMv + RUNTIME_TREND_DROP_MV
+            || now - runtimeWindowStart > RUNTIME_TREND_MAX_MS || currentState != STATE_OPERATING) {
+        runtimeWindowStart = now;
+        runtimeWindowStartMv = ocv;
+        runtimeWindowCurrentSum = 0;
+        runtimeWindowTicks = 0;
+    }
+    runtimeWindowCurrentSum += currentForDutyMa(duty);
+    runtimeWindowTicks++;
+
+    if (ocv + RUNTIME_TREND_DROP_MV <= runtimeWindowStartMv) {
+        uint16_t averageMa = runtimeWindowCurrentSum / runtimeWindowTicks;
+        // Percent used over the window, x100: by the curve at the window's middle, and by
+        // the model. Above the top of the curve the gradient is unknown.
+        millivolts_t gradientMv = ocvMillivoltsPerTenPercent(runtimeWindowStartMv - RUNTIME_TREND_DROP_MV / 2);
+        uint32_t trendUsed = gradientMv ? (uint32_t)RUNTIME_TREND_DROP_MV * 1000 / gradientMv : 0;
+        uint32_t modelUsed = (uint32_t)averageMa * ((now - runtimeWindowStart) / 1000) / 36 * 100 / BATTERY_CAPACITY_MAH;
+        if (trendUsed > 0 && modelUsed > 0) {
+            uint32_t ratio = constrain(modelUsed * RUNTIME_GAIN_ONE / trendUsed,
+                                       RUNTIME_GAIN_ONE / 2, RUNTIME_GAIN_ONE * 2);
+            runtimeGain += ((int16_t)ratio - (int16_t)runtimeGain) / 8;
+        }
+        runtimeWindowTicks = 0;
+    }
+
+    // MODIFIED: At the level the output limits allow, not the level asked for
+    runtimeMinutes = estimateRuntimeMinutes(isLampOn && !isOverheatCritical ? min(brightness, (int)brightnessCeiling) : 0);
+    for (uint8_t i = 0; i < 4; i++) {
+        uint16_t minutes = estimateRuntimeMinutes(min(presets[i], (int)brightnessCeiling));
+        if (minutes != presetRuntimeMinutes[i]) presetRuntimeRevision++;
+        presetRuntimeMinutes[i] = minutes;
+    }
+}
+
+// "9h59" below ten hours, "14h" above: fits a 30-pixel preset column
+const uint8_t RUNTIME_TEXT_SIZE = 6;    // "1092h" and the terminator
+void formatRuntime(char* out, uint16_t minutes) {
+    if (minutes < 600) sprintf(out, "%ch%02u", '0' + minutes / 60, minutes % 60); // one hour digit
+    else sprintf(out, "%uh", minutes / 60);
+}
+
+// --- State of Charge Estimator ---
+// NEW: The pack voltage is read under LED load, so it sags with brightness. The sag
+// is removed using the pack's internal resistance, which is learned whenever the
+// LED current steps between two settled readings (R = -dV/dI). The resulting
+// open-circuit voltage is mapped through a 2S Li-ion discharge curve. The published
+// percentage is smoothed and only falls while discharging, so a brightness change
+// cannot make it jump, and the 10% and 0% triggers do not fire early at high output.
+const uint16_t PACK_RESISTANCE_DEFAULT_MOHM = 150;
+const uint16_t PACK_RESISTANCE_MIN_MOHM = 30;
+const uint16_t PACK_RESISTANCE_MAX_MOHM = 1000;
+const uint16_t SOC_LEARN_MIN_STEP_MA = 150;     // smaller steps are lost in ADC noise
+const unsigned long SOC_LEARN_MAX_AGE_MS = 10000; // older references have discharged since
+const uint8_t SOC_RISE_PERCENT = 10;            // a rise this large: pack charged or swapped
+const millivolts_t BATTERY_CUTOFF_MV = 6000;    // loaded voltage that forces 0% (3.0 V per cell)
+const uint8_t SOC_CURVE_POINTS = 11;
+
+// Open-circuit pack voltage at 0%, 10%, ... 100%
+const millivolts_t SOC_CURVE_MV[SOC_CURVE_POINTS] PROGMEM = {
+  6400, 6900, 7100, 7240, 7340, 7440, 7560, 7700, 7860, 8060, 8300
+};
+
+uint16_t packResistanceMohm = PACK_RESISTANCE_DEFAULT_MOHM;
+uint16_t socChargeCurrentMa = 0;      // NEW: set while a charger is feeding the pack
+uint16_t socFilteredQ8 = 0;           // percent, Q8
+bool socPrimed = false;
+uint16_t socLastDuty = 0xFFFF;        // output duty at the previous battery tick
+millivolts_t socRefMv = 0;            // last settled reading, for resistance learning
+uint16_t socRefMa = 0;
+unsigned long socRefAt = 0;
+
+// NEW: The pack current at the point of the PWM cycle the ADC samples. A channel
+// is either fully on or off there, so this, not the average, is what the loaded
+// reading sags by. The dither moves OCR1x by one count, hence the partial step.
+uint16_t currentAtAdcSampleMa() {
+    uint16_t duty, cool, warm;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        duty = drivenDuty();
+        cool = mixCoolQ8;
+        warm = mixWarmQ8;
+    }
+    uint16_t channelDuty[2] = { (uint16_t)(((uint32_t)duty * cool) >> 8), (uint16_t)(((uint32_t)duty * warm) >> 8) };
+    uint16_t currentMa = SYSTEM_CURRENT_MA;
+    for (uint8_t i = 0; i < 2; i++) {
+        // Sixteenths of the PWM cycles in which OCR1x is past the sample
+        int32_t onQ4 = (int32_t)channelDuty[i] - ADC_SAMPLE_COUNT * 16;
+        currentMa += (uint32_t)LED_CURRENT_FULL_MA * constrain(onQ4, 0, 16) / 16;
+    }
+    return currentMa;
+}
+
+uint8_t ocvToPercent(millivolts_t ocv) {
+    if (ocv <= pgm_read_word(&SOC_CURVE_MV[0])) return 0;
+    for (uint8_t i = 1; i < SOC_CURVE_POINTS; i++) {
+        millivolts_t upper = pgm_read_word(&SOC_CURVE_MV[i]);
+        if (ocv < upper) {
+            millivolts_t lower = pgm_read_word(&SOC_CURVE_MV[i - 1]);
+            return (i - 1) * 10 + (uint32_t)(ocv - lower) * 10 / (upper - lower);
+        }
+    }
+    return 100;
+}
+
+// The discharge curve's gradient around ocv, for the runtime estimator's trend;
+// 0 above the top of the curve, where it is unknown
+millivolts_t ocvMillivoltsPerTenPercent(millivolts_t ocv) {
+    if (ocv >= pgm_read_word(&SOC_CURVE_MV[SOC_CURVE_POINTS - 1])) return 0;
+    uint8_t i = 1;
+    while (i < SOC_CURVE_POINTS - 1 && ocv >= pgm_read_word(&SOC_CURVE_MV[i])) i++;
+    return pgm_read_word(&SOC_CURVE_MV[i]) - pgm_read_word(&SOC_CURVE_MV[i - 1]);
+}
+
+// Once per battery task, with the loaded voltage just measured
+void updateStateOfCharge(millivolts_t loadedMv, unsigned long now) {
+    uint16_t duty;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        duty = drivenDuty();
+    }
+    // MODIFIED: The current the reading was taken under, patterns and scenes included
+    uint16_t currentMa = currentAtAdcSampleMa();
+
+    // Settled: the same output since the previous tick, so the ADC filter has caught up.
+    // MODIFIED: The charger's current is not steady enough to learn from.
+    bool settled = duty == socLastDuty && !isPatternActive() && !isSceneActive() && currentState != STATE_CHARGING;
+    socLastDuty = duty;
+    if (settled) {
+        int16_t stepMa = (int16_t)(currentMa - socRefMa);
+        if (socRefMv != 0 && now - socRefAt <= SOC_LEARN_MAX_AGE_MS && abs(stepMa) >= SOC_LEARN_MIN_STEP_MA) {
+            int32_t sampleMohm = (int32_t)(int16_t)(socRefMv - loadedMv) * 1000 / stepMa;
+            if (sampleMohm >= PACK_RESISTANCE_MIN_MOHM && sampleMohm <= PACK_RESISTANCE_MAX_MOHM) {
+                packResistanceMohm += ((int16_t)sampleMohm - (int16_t)packResistanceMohm) / 4;
+            }
+        }
+        socRefMv = loadedMv;
+        socRefMa = currentMa;
+        socRefAt = now;
+    }
+
+    // MODIFIED: While charging the pack current flows the other way and lifts the reading
+    int32_t packCurrentMa = (int32_t)currentMa - socChargeCurrentMa;
+    batteryOcvMillivolts = (int32_t)loadedMv + packCurrentMa * packResistanceMohm / 1000;
+    uint16_t rawQ8 = (uint16_t)ocvToPercent(batteryOcvMillivolts) << 8;
+    if (!socPrimed) {
+        socFilteredQ8 = rawQ8;
+    } else {
+        socFilteredQ8 += ((int32_t)rawQ8 - (int32_t)socFilteredQ8) / 4;
+    }
+    int estimate = (socFilteredQ8 + 128) >> 8;
+    // MODIFIED: Only rises while charging, only falls otherwise
+    bool charging = currentState == STATE_CHARGING;
+    if (!socPrimed || (charging ? estimate > batteryPercent : estimate < batteryPercent) ||
+        estimate >= batteryPercent + SOC_RISE_PERCENT) {
+        batteryPercent = estimate;
+    }
+    if (loadedMv < BATTERY_CUTOFF_MV) batteryPercent = 0;
+    socPrimed = true;
+}
+
+// NEW: Known state of charge (end of a charge)
+void setStateOfCharge(uint8_t percent) {
+    socFilteredQ8 = (uint16_t)percent << 8;
+    batteryPercent = percent;
+}
+
+// --- Charging ---
+// NEW: This board has no charger sense line (define CHARGER_SENSE_PIN to use one),
+// so plugging a charger in is recognized from the pack voltage at a steady LED
+// load: the charge current lifts it by CHARGER_STEP_MV or more between two battery
+// ticks, and unplugging drops it by as much. While charging the sensors are polled
+// slowly, the OLED is dimmed and its charge screen is only refreshed every few
+// seconds, and the LED output is capped because the charger heats the pack too.
+//
+// The end of a charge (voltage flat near the top after a long rise) is the one time
+// the pack voltage is known: the charger's 8.4 V constant-voltage level. The reading
+// taken then is saved with the settings and scales every later reading, which
+// calibrates out the bandgap and divider tolerances the state of charge relies on.
+// The charging state then ends; the log keeps the charge curve at its usual interval.
+// A charging pack only rises or holds, so a fall at a steady load also ends it (a
+// missed unplug step, a charger that stopped early or cannot carry the load), and
+// the cutoff voltage still shuts the lamp down while charging.
+const int16_t CHARGER_STEP_MV = 80;
+const uint16_t CHARGE_CURRENT_MA = 1000;          // constant-current phase, nominal
+const millivolts_t CHARGE_VOLTAGE_MV = 8400;      // constant-voltage level, 2 x 4.2 V
+const uint8_t CHARGE_CALIBRATION_PERCENT = 2;     // accepted reading error at full
+const unsigned long CHARGE_WINDOW_MS = 60000;
+const int16_t CHARGE_FULL_FLAT_MV = 5;            // per window, either way: the charger holds CV
+// Near CV: the bottom of the calibration window, so an uncalibrated reading gets there too
+const millivolts_t CHARGE_FULL_MIN_MV = (uint32_t)CHARGE_VOLTAGE_MV * (100 - CHARGE_CALIBRATION_PERCENT) / 100;
+const int16_t CHARGE_FALL_MV = 30;                // below the peak at this load: no charge current
+const int16_t CHARGE_FULL_MIN_RISE_MV = 200;      // since the start of the charge
+const unsigned long CHARGE_FULL_MIN_MS = 1800000; // 30 minutes
+const uint16_t CHARGE_ETA_UNKNOWN = 0xFFFF;
+const uint16_t CHARGING_SENSOR_INTERVAL = 10000;  // polling ceiling
+const unsigned long CHARGING_DISPLAY_REFRESH_MS = 5000;
+const uint8_t CHARGING_OUTPUT_CAP = 50;           // percent
+const uint8_t CHARGING_CONTRAST = 8;
+const uint8_t NORMAL_CONTRAST = 0xCF;             // U8g2's SSD1306 init value
+
+uint16_t chargeEtaMinutes = CHARGE_ETA_UNKNOWN;
+millivolts_t chargerLastMv = 0;
+uint16_t chargerLastDuty = 0xFFFF;
+unsigned long chargeWindowStart = 0;
+uint32_t chargeWindowSumMv = 0;                   // NEW: readings in the current window
+uint8_t chargeWindowReadings = 0;
+millivolts_t chargeLastWindowMv = 0;              // NEW: mean of the previous window, 0 = none
+millivolts_t chargeStartMv = 0;
+millivolts_t chargePeakMv = 0;                    // NEW: highest reading since the load last changed
+unsigned long chargeStartMs = 0;
+uint8_t chargeStartPercent = 0;
+
+void retuneSensorPolling();
+
+// Scale a raw reading by the last end-of-charge calibration
+millivolts_t calibrateBatteryReading(millivolts_t measured) {
+    if (batteryFullChargeMv == 0) return measured;
+    return (uint32_t)measured * CHARGE_VOLTAGE_MV / batteryFullChargeMv;
+}
+
+bool isValidFullChargeReading(millivolts_t measured) {
+    uint16_t tolerance = (uint32_t)CHARGE_VOLTAGE_MV * CHARGE_CALIBRATION_PERCENT / 100;
+    return measured >= CHARGE_VOLTAGE_MV - tolerance && measured <= CHARGE_VOLTAGE_MV + tolerance;
+}
+
+void restartChargeWindow(unsigned long now) {
+    chargeWindowStart = now;
+    chargeWindowSumMv = 0;
+    chargeWindowReadings = 0;
+    chargeLastWindowMv = 0;
+}
+
+void startCharging(unsigned long now) {
+    currentState = STATE_CHARGING;
+    socChargeCurrentMa = CHARGE_CURRENT_MA;
+    chargeStartMv = batteryMillivolts;
+    chargeStartMs = now;
+    chargeStartPercent = batteryPercent;
+    restartChargeWindow(now);
+    chargePeakMv = batteryMillivolts;
+    chargeEtaMinutes = CHARGE_ETA_UNKNOWN;
+    retuneSensorPolling();
+    if (displayReady) u8g2.setContrast(CHARGING_CONTRAST);
+}
+
+void stopCharging() {
+    currentState = STATE_OPERATING;
+    socChargeCurrentMa = 0;
+    retuneSensorPolling();
+    if (displayReady) u8g2.setContrast(NORMAL_CONTRAST);
+    if (batteryPercent > 10) low10Handled = false;
+}
+
+void completeCharge(millivolts_t measured) {
+    if (isValidFullChargeReading(measured)) batteryFullChargeMv = measured;
+    setStateOfCharge(100);
+    stopCharging();
+}
+
+// Once per battery task, after updateBatteryStats(). measured is the raw reading.
+void updateCharging(unsigned long now, millivolts_t measured) {
+    uint16_t duty;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        duty = outputDuty;
+    }
+    bool steady = duty == chargerLastDuty && !isPatternActive() && !isSceneActive() && chargerLastMv != 0;
+    int16_t stepMv = (int16_t)(batteryMillivolts - chargerLastMv);
+    chargerLastMv = batteryMillivolts;
+    // NEW: A reading under a pattern or scene is no reference for the next one
+    chargerLastDuty = isPatternActive() || isSceneActive() ? 0xFFFF : duty;
+
+#ifdef CHARGER_SENSE_PIN
+    bool plugged = digitalRead(CHARGER_SENSE_PIN) == HIGH;
+#else
+    bool plugged = currentState == STATE_CHARGING;
+    if (steady && stepMv >= CHARGER_STEP_MV) plugged = true;
+    if (steady && stepMv <= -CHARGER_STEP_MV) plugged = false;
+#endif
+    if (currentState == STATE_OPERATING && plugged) startCharging(now);
+    if (currentState != STATE_CHARGING) return;
+    if (!plugged) {
+        stopCharging();
+        return;
+    }
+
+    // ETA from the rate the state of charge has risen so far
+    uint8_t gained = batteryPercent - chargeStartPercent;
+    if (batteryPercent > chargeStartPercent + 1) {
+        uint32_t elapsedMinutes = (now - chargeStartMs) / 60000;
+        chargeEtaMinutes = min((100 - batteryPercent) * elapsedMinutes / gained, (uint32_t)RUNTIME_MAX_MINUTES);
+    }
+
+    if (!steady) {
+        // A load change moves the voltage; start the flatness windows and the peak over
+        restartChargeWindow(now);
+        chargePeakMv = batteryMillivolts;
+        return;
+    }
+    // NEW: Falling at a steady load: no charge current flows
+    if (batteryMillivolts > chargePeakMv) chargePeakMv = batteryMillivolts;
+    if ((int16_t)(chargePeakMv - batteryMillivolts) >= CHARGE_FALL_MV) {
+        stopCharging();
+        return;
+    }
+    // MODIFIED: Window means, not single readings: a reading is a few mV either way,
+    // as much as the constant-current rise over a window near the top
+    chargeWindowSumMv += batteryMillivolts;
+    chargeWindowReadings++;
+    if (now - chargeWindowStart < CHARGE_WINDOW_MS) return;
+    millivolts_t windowMeanMv = chargeWindowSumMv / chargeWindowReadings;
+    int16_t windowMv = (int16_t)(windowMeanMv - chargeLastWindowMv);
+    bool compared = chargeLastWindowMv != 0;
+    chargeWindowStart = now;
+    chargeWindowSumMv = 0;
+    chargeWindowReadings = 0;
+    chargeLastWindowMv = windowMeanMv;
+    // MODIFIED: Flat either way, and at the charger's voltage
+    if (compared && now - chargeStartMs >= CHARGE_FULL_MIN_MS && abs(windowMv) < CHARGE_FULL_FLAT_MV &&
+        (int16_t)(windowMeanMv - chargeStartMv) >= CHARGE_FULL_MIN_RISE_MV && windowMeanMv >= CHARGE_FULL_MIN_MV) {
+        completeCharge(measured);
+    }
+}
+
+// --- Cooperative Task Scheduler ---
+// Tasks are registered at compile time in the table below. Every pass runs the
+// per-pass tasks (period 0) first so input handling is never starved, then at
+// most one released periodic task: the one with the earliest deadline, where
+// deadline = release time + jitter budget. A task that starts after its deadline
+// counts as an overrun. Run time and overruns are shown on the stats screen.
+const unsigned long SENSOR_UPDATE_INTERVAL = 2000; // 2 seconds
+
+struct Task {
+  void (*run)();
+  uint16_t periodMs;       // 0 = run on every pass
+  uint16_t jitterMs;       // allowed start lateness before it counts as an overrun
+  unsigned long nextDue;   // release time (millis)
+  unsigned long totalUs;   // cumulative run time
+  unsigned long maxUs;     // longest single run
+  uint16_t overruns;
+  unsigned long runs;      // NEW: number of runs
+};
+
+void taskInputs();
+void taskBattery();
+void taskTemperature();
+void taskDisplay();
+void taskTemperatureBus();
+
+enum TaskId {
+  TASK_INPUTS,
+  TASK_BATTERY,
+  TASK_TEMPERATURE,
+  TASK_TEMPERATURE_BUS,
+  TASK_DISPLAY,
+  TASK_COUNT
+};
+
+Task tasks[TASK_COUNT] = {
+  // run              period                  jitter  first release                    statistics
+  { taskInputs,       0,                      20,     0,                               0, 0, 0, 0 },
+  { taskBattery,      SENSOR_UPDATE_INTERVAL, 500,    SENSOR_UPDATE_INTERVAL,          0, 0, 0, 0 },
+  // Temperature is released half a period after the battery so they never share a pass
+  { taskTemperature,  SENSOR_UPDATE_INTERVAL, 500,    SENSOR_UPDATE_INTERVAL * 3 / 2,  0, 0, 0, 0 },
+  { taskTemperatureBus, 0,                    20,     0,                               0, 0, 0, 0 },
+  // Last, so it sees what the other tasks changed before the pass can end in sleep
+  { taskDisplay,      0,                      20,     0,                               0, 0, 0, 0 },
+};
+
+uint16_t totalTaskOverruns() {
+    uint16_t total = 0;
+    for (uint8_t i = 0; i < TASK_COUNT; i++) total += tasks[i].overruns;
+    return total;
+}
+
+void runTask(Task& task, unsigned long now) {
+    if (task.periodMs != 0) {
+        if (now - task.nextDue > task.jitterMs) task.overruns++;
+        task.nextDue += task.periodMs;
+        // After a long stall, re-phase instead of replaying every missed release
+        if ((long)(now - task.nextDue) >= 0) task.nextDue = now + task.periodMs;
+    }
+    unsigned long start = micros();
+    task.run();
+    task.runs++;
+    unsigned long elapsed = micros() - start;
+    task.totalUs += elapsed;
+    if (elapsed > task.maxUs) task.maxUs = elapsed;
+}
+
+// NEW: Time until the next periodic task is released (0 = already due)
+unsigned long msUntilNextRelease(unsigned long now) {
+    unsigned long soonest = UINT32_MAX;
+    for (uint8_t i = 0; i < TASK_COUNT; i++) {
+        if (tasks[i].periodMs == 0) continue;
+        long remaining = (long)(tasks[i].nextDue - now);
+        soonest = min(soonest, (unsigned long)max(remaining, 0L));
+    }
+    return soonest;
+}
+
+// --- Adaptive Sensor Polling ---
+// NEW: The battery and temperature periods follow their readings. Each sensor is
+// polled often enough that its reading moves by about one step between polls,
+// judged from how fast it has been moving, but never less often than a ceiling:
+// SENSOR_UPDATE_INTERVAL with the lamp lit, CHARGING_SENSOR_INTERVAL while
+// charging and SENSOR_IDLE_INTERVAL with the lamp off. Close to a threshold
+// (a few degrees below the thermal target, a few percent above the 10 % warning
+// or empty) the ceiling drops to SENSOR_ALERT_INTERVAL. A shorter period pulls the
+// pending release in, so switching the lamp on does not wait out an idle period.
+const uint16_t SENSOR_IDLE_INTERVAL = 30000;
+const uint16_t SENSOR_ALERT_INTERVAL = 1000;
+const uint16_t SENSOR_MIN_INTERVAL = 250;     // a 9-bit DS18B20 conversion plus bus time
+const centiC_t TEMP_POLL_STEP_C = 25;         // 0.25 C per poll
+const millivolts_t BATTERY_POLL_STEP_MV = 20;
+const centiC_t TEMP_ALERT_MARGIN_C = DEG_C(5);
+const uint8_t BATTERY_ALERT_MARGIN_PERCENT = 3;
+
+int16_t batteryRate = 0;                      // smoothed change, mV per second
+millivolts_t batteryRateLastMv = 0;
+unsigned long batteryRateLastTime = 0;
+
+// Once per battery reading
+void updateBatteryRate(unsigned long now) {
+    unsigned long dt = now - batteryRateLastTime;
+    if (batteryRateLastMv != 0 && dt != 0) {
+        int32_t rate = (int32_t)(batteryMillivolts - batteryRateLastMv) * 1000 / (long)dt;
+        batteryRate += (constrain(rate, -INT16_MAX / 2, INT16_MAX / 2) - batteryRate) / 2;
+    }
+    batteryRateLastMv = batteryMillivolts;
+    batteryRateLastTime = now;
+}
+
+uint16_t adaptivePeriod(uint16_t step, int16_t ratePerSecond, uint16_t ceiling) {
+    uint16_t speed = abs(ratePerSecond);
+    if (speed == 0) return ceiling;
+    uint32_t period = (uint32_t)step * 1000 / speed;
+    return constrain(period, (uint32_t)SENSOR_MIN_INTERVAL, (uint32_t)ceiling);
+}
+
+void setTaskPeriod(Task& task, uint16_t periodMs, unsigned long now) {
+    task.periodMs = periodMs;
+    if ((long)(task.nextDue - (now + periodMs)) > 0) task.nextDue = now + periodMs;
+}
+
+// After every reading and whenever the lamp or charging state changes
+void retuneSensorPolling() {
+    unsigned long now = millis();
+    uint16_t ceiling = SENSOR_IDLE_INTERVAL;
+    if (currentState == STATE_CHARGING) ceiling = CHARGING_SENSOR_INTERVAL;
+    else if (isLampOn) ceiling = SENSOR_UPDATE_INTERVAL;
+
+    uint16_t tempCeiling = ceiling;
+    if (isOverheatCritical || ledTemperature >= THERMAL_TARGET_C - TEMP_ALERT_MARGIN_C) {
+        tempCeiling = min(ceiling, SENSOR_ALERT_INTERVAL);
+    }
+    uint16_t batteryCeiling = ceiling;
+    bool nearWarning = !low10Handled && batteryPercent <= 10 + BATTERY_ALERT_MARGIN_PERCENT;
+    if (currentState == STATE_OPERATING && (nearWarning || batteryPercent <= BATTERY_ALERT_MARGIN_PERCENT)) {
+        batteryCeiling = min(ceiling, SENSOR_ALERT_INTERVAL);
+    }
+    setTaskPeriod(tasks[TASK_TEMPERATURE], adaptivePeriod(TEMP_POLL_STEP_C, thermalRate, tempCeiling), now);
+    setTaskPeriod(tasks[TASK_BATTERY], adaptivePeriod(BATTERY_POLL_STEP_MV, batteryRate, batteryCeiling), now);
+}
+
+#ifdef LAMP_BENCH
+// Sensor transactions per hour of (virtual) run time
+void benchReportPolls() {
+    unsigned long hundredthHours = max(millis() / 36000, 1UL);
+    uartText.print(F("polls/h: battery="));
+    uartText.print(tasks[TASK_BATTERY].runs * 100 / hundredthHours);
+    uartText.print(F(" temperature="));
+    uartText.println(tasks[TASK_TEMPERATURE].runs * 100 / hundredthHours);
+}
+#endif
+
+void runScheduler() {
+    OperationalState state = currentState;
+    for (uint8_t i = 0; i < TASK_COUNT; i++) {
+        if (tasks[i].periodMs == 0) {
+            runTask(tasks[i], millis());
+            if (currentState != state) return; // Exit IMMEDIATELY to prevent inconsistent state
+        }
+    }
+
+    unsigned long now = millis();
+    Task* next = NULL;
+    for (uint8_t i = 0; i < TASK_COUNT; i++) {
+        Task& task = tasks[i];
+        if (task.periodMs == 0 || (long)(now - task.nextDue) < 0) continue;
+        if (next == NULL || (long)((task.nextDue + task.jitterMs) - (next->nextDue + next->jitterMs)) < 0) {
+            next = &task;
+        }
+    }
+    if (next != NULL) {
+        runTask(*next, now);
+        // MODIFIED: With the lamp off the pass may end in an 8 s power-down, so show
+        // the new reading now rather than on the next wake
+        runTask(tasks[TASK_DISPLAY], millis());
+    }
+}
+
+void taskInputs() {
+    BENCH_PROBE(BENCH_INPUTS, handleInputs());
+    serviceScene();
+    updateOutputs();
+    // NEW: Switching the lamp changes the sensor polling ceilings
+    static bool wasLampOn = false;
+    if (isLampOn != wasLampOn) {
+        wasLampOn = isLampOn;
+        retuneSensorPolling();
+    }
+}
+
+void taskBattery() {
+    BENCH_PROBE(BENCH_BATTERY, updateBatteryStats());
+    // NEW: Refresh the stack high-water mark shown on the diagnostics page
+    stackPeak = stackPeakBytes();
+    // NEW: Fold this tick into the runtime estimate
+    updateRuntimeEstimate(millis());
+    // NEW: Charger plugged in or out, charge progress
+    updateCharging(millis(), batteryMeasuredMillivolts);
+    bool discharging = socPrimed && currentState == STATE_OPERATING;
+    // Handle 10% notification once (clamp brightness afterward)
+    // MODIFIED: Both triggers run from the state-of-charge estimate, and not while charging
+    if (discharging && !low10Handled && batteryPercent <= 10 && batteryPercent > 0) {
+        // Clamp brightness to 10%
+        // MODIFIED: 10% of one channel's power, whatever the colour mix
+        brightness = brightnessForPower(10);
+        resyncEncoder();
+        // Short bursts: 3 bursts of 5 pulses, 50ms on/off (plays in the background)
+        // MODIFIED: At the clamped level, not the one the pack can no longer carry
+        playBurstPattern(3, 5, 50, 50, 1000, brightness);
+        low10Handled = true;
+    }
+
+    // Enter low-battery state when reaching 0%
+    // MODIFIED: Or below the cutoff voltage in any state: a charger that cannot hold
+    // the pack above it does not make it safe to keep running
+    if ((discharging && batteryPercent <= 0) || batteryMillivolts < BATTERY_CUTOFF_MV) {
+        if (currentState == STATE_CHARGING) stopCharging();
+        currentState = STATE_LOW_BATTERY;
+    }
+    // NEW: Below the cutoff voltage the pack cannot carry a flash at any level
+    if (batteryMillivolts < BATTERY_CUTOFF_MV) stopPattern();
+
+    // NEW: Telemetry log follows the sensor cadence
+    logTelemetry(millis());
+    // NEW: Next poll from how fast the voltage moves
+    updateBatteryRate(millis());
+    retuneSensorPolling();
+}
+
+void taskTemperature() {
+    BENCH_PROBE(BENCH_TEMP, updateTemperature());
+}
+
+// NEW: Runs the DS18B20 sequence and reacts to each reading as soon as it is in
+void taskTemperatureBus() {
+    serviceTemperatureSensor();
+    if (!ledTemperatureFresh) return;
+    ledTemperatureFresh = false;
 
-    // Restore previous state
-    if (!ocWasEnabled) {
-        TCCR1A &= ~_BV(COM1A1);
-        pinMode(PWM_OUTPUT_PIN, OUTPUT);
-        digitalWrite(PWM_OUTPUT_PIN, LOW);
-    } else {
-        OCR1A = savedOCR;
+    // MODIFIED: The hard cutoff with hysteresis stays as a backstop
+    if (isOverheatCritical) {
+        if (ledTemperature <= TEMP_RECOVER_C) isOverheatCritical = false;
+    } else if (ledTemperature >= TEMP_OVERHEAT_C) {
+        isOverheatCritical = true;
+        thermalIntegralQ8 = THERMAL_RESTART_Q8;
     }
-    brightness = savedBrightness;
-    isLampOn = savedLampOn;
+    // NEW: Continuous derating below it
+    updateThermalGovernor(ledTemperature, millis());
+    // NEW: Next poll from the new rate of rise
+    retuneSensorPolling();
 }
 
-// NEW: Full-screen overheat message (avoids overlapping headers)
-void drawOverheatScreen() {
-    u8g2.firstPage();
-    do {
-        u8g2.setFont(u8g2_font_7x13B_tr);
-        u8g2_uint_t w = u8g2.getStrWidth("Overheat Danger!");
-        u8g2.drawStr((128 - w) / 2, 26, "Overheat Danger!");
-        // Show current temperature
-        char tempStr[10];
-        dtostrf(ledTemperature, 4, 1, tempStr);
-        u8g2.setFont(u8g2_font_ncenB14_tr);
-        w = u8g2.getStrWidth(tempStr);
-        u8g2.drawStr((128 - w) / 2, 46, tempStr);
-        u8g2.setFont(u8g2_font_6x12_tr);
-        const char* msg = "Cooling...";
-        w = u8g2.getStrWidth(msg);
-        u8g2.drawStr((128 - w) / 2, 62, msg);
-    } while (u8g2.nextPage());
+void taskDisplay() {
+    BENCH_PROBE(BENCH_DRAW, drawDisplay());
 }
 
-// NEW: Overheat warn screen with capped power and temperature
-void drawOverheatWarnScreen() {
-    u8g2.setFont(u8g2_font_7x13B_tr);
-    u8g2_uint_t w = u8g2.getStrWidth("Overheat Warning!");
-    u8g2.drawStr((128 - w) / 2, 18, "Overheat Warning!");
-    // Show current (capped) power
-    u8g2.setFont(u8g2_font_ncenB14_tr);
-    char buf[12];
-    int shown = brightness > 50 ? 50 : brightness;
-    sprintf(buf, "%d%%", shown);
-    w = u8g2.getStrWidth(buf);
-    u8g2.drawStr((128 - w) / 2, 38, buf);
-    // Show temperature
-    char tempStr[16];
-    dtostrf(ledTemperature, 4, 1, tempStr);
-    u8g2.setFont(u8g2_font_6x12_tr);
-    char tline[22];
-    snprintf(tline, sizeof(tline), "Temp: %s C", tempStr);
-    w = u8g2.getStrWidth(tline);
-    u8g2.drawStr((128 - w) / 2, 52, tline);
-    const char* msg = "Max 50%  Cooling...";
-    w = u8g2.getStrWidth(msg);
-    u8g2.drawStr((128 - w) / 2, 64, msg);
+
+// --- Staged Boot ---
+// NEW: setup() only restores the settings and gets the light on: Timer1 and the
+// restored output level first, then the cheap interrupt-driven inputs. The OLED,
+// the IR receiver and the temperature sensor are started from loop(), one per pass.
+// The OLED is initialized in power save and only switched on once its first full
+// frame has been sent, which replaces U8g2's blocking clear of the display RAM.
+void serviceBoot() {
+    switch (bootStage) {
+        case BOOT_DISPLAY:
+            u8g2.initDisplay();
+            displayReady = true;
+            requestDisplayFrame();
+            break;
+        case BOOT_IR:
+            IrReceiver.begin(IR_RECEIVE_PIN, DISABLE_LED_FEEDBACK);
+            break;
+        case BOOT_SENSOR:
+            // MODIFIED: The DS18B20 ROM is found by the first temperature task run
+            startTemperatureSensor();
+            break;
+        case BOOT_DONE:
+            return;
+    }
+    bootStage = (BootStage)(bootStage + 1);
 }
 
+// Called when a frame has been sent completely
+void onDisplayFrameSent() {
+    if (bootFirstFrameUs != 0) return;
+    bootFirstFrameUs = micros();
+    u8g2.setPowerSave(0);
+}
 
 void setup() {
-    IrReceiver.begin(IR_RECEIVE_PIN, DISABLE_LED_FEEDBACK);
-    // MODIFIED: Serial communication removed
-    u8g2.begin();
-
-    analogReference(DEFAULT);
-
-    debouncer.attach(ENCODER_SWITCH_PIN, INPUT_PULLUP);
-    debouncer.interval(25);
-
-    // NEW: Initialize the temperature sensor
-    sensors.begin();
-    // NEW: Set the sensor to non-blocking mode
-    sensors.setWaitForConversion(false);
+    // NEW: Restore the saved settings before anything drives the outputs
+    restoreSettings();
 
+    // MODIFIED: Light first: Timer1 starts at the restored level, no fade-in
     pinMode(PWM_OUTPUT_PIN, OUTPUT);
+    pinMode(PWM_WARM_PIN, OUTPUT);
+    setColorTempStep(colorTempStep);
 
-    TCCR1A = _BV(COM1A1) | _BV(WGM11);
+    TCCR1A = PWM_COMPARE_OUTPUTS | _BV(WGM11);
     TCCR1B = _BV(WGM13) | _BV(WGM12) | _BV(CS10);
-    ICR1 = 511;
+    ICR1 = PWM_TOP;
     OCR1A = 0;
+    OCR1B = 0;
+    if (isLampOn) setOutputImmediate(brightness);
+    // NEW: Overflow interrupt drives the light pattern engine
+    TIMSK1 |= _BV(TOIE1);
+
+    // MODIFIED: Battery sensing runs in the background from here on
+    startAdcPipeline();
+
+    // MODIFIED: Encoder, button and IR feed the input event ring from their interrupts
+    startInputPipeline();
+
+    resyncEncoder();
 
-    myEncoder.write(brightness * rotaryScaleFactor);
+    // NEW: Find the telemetry log write position
+    initTelemetryLog();
 
-    // MODIFIED: Serial communication removed
+    // MODIFIED: Interrupt-driven UART for the binary serial protocol (and bench reports)
+    startUart(115200);
+
+#ifdef CHARGER_SENSE_PIN
+    pinMode(CHARGER_SENSE_PIN, INPUT); // NEW: Optional charger sense line, high while charging
+#endif
 }
 
 void loop() {
     // MODIFIED: Main loop is now controlled by the master state machine
-    // Move periodic task timers out here so all states can access them.
-    static unsigned long lastBatteryCheckTime = 0;
-    static unsigned long lastTempCheckTime = 1000; // Offset by 1 second to prevent collision
+#ifdef LAMP_BENCH
+    benchStimulate();
+    uint32_t benchLoopStart = benchCycles();
+#endif
+    unsigned long passStart = micros();
 
-    const unsigned long SENSOR_UPDATE_INTERVAL = 2000; // 2 seconds
+    // NEW: Start what setup() deferred, one component per pass
+    serviceBoot();
 
-    unsigned long currentTime = millis();
+    // NEW: Background EEPROM writes, the serial protocol and the log dump run in every state
+    serviceSettings(millis());
+    serviceEeprom();
+    serviceSerial(millis());
+    serviceLogDump();
 
     switch (currentState) {
         case STATE_OPERATING:
-            // Check and run the battery update task
-            if (currentTime - lastBatteryCheckTime > SENSOR_UPDATE_INTERVAL) {
-                lastBatteryCheckTime = currentTime;
-                updateBatteryStats();
-                // Handle 10% notification once (clamp brightness afterward)
-                if (!low10Handled && batteryPercent <= 10 && batteryPercent > 0) {
-                    // Short bursts: 3 bursts of 5 pulses, 50ms on/off
-                    flashBurst(3, 5, 50, 50, brightness);
-                    // Clamp brightness to 10%
-                    brightness = 10;
-                    myEncoder.write(brightness * rotaryScaleFactor);
-                    low10Handled = true;
-                }
-
-                // Enter low-battery state when reaching 0%
-                if (batteryPercent <= 0) {
-                    currentState = STATE_LOW_BATTERY;
-                    break; // Exit IMMEDIATELY to prevent inconsistent state
-                }
-            }
-
-            // Check and run the temperature update task on a different, offset schedule
-            if (currentTime - lastTempCheckTime > SENSOR_UPDATE_INTERVAL) {
-                lastTempCheckTime = currentTime;
-                updateTemperature();
-                // Two-level overheat handling with hysteresis
-                if (isOverheatCritical) {
-                    if (ledTemperature <= TEMP_RECOVER_C) {
-                        isOverheatCritical = false;
-                        isOverheatWarn = false;
-                    }
-                } else if (isOverheatWarn) {
-                    if (ledTemperature >= TEMP_OVERHEAT_C) {
-                        isOverheatCritical = true; // escalate to hard cutoff
-                    } else if (ledTemperature <= TEMP_RECOVER_C) {
-                        isOverheatWarn = false; // recover to normal
-                    }
-                } else {
-                    if (ledTemperature >= TEMP_OVERHEAT_C) {
-                        isOverheatCritical = true;
-                        isOverheatWarn = true;
-                    } else if (ledTemperature >= TEMP_WARN_C) {
-                        isOverheatWarn = true;
-                        // Immediately cap brightness to 25% if above
-                        if (brightness > 25) {
-                            brightness = 25;
-                            myEncoder.write(brightness * rotaryScaleFactor);
-                        }
-                    }
-                }
-            }
-
-            // If all checks pass, proceed with normal operation.
-            handleInputs();
-            updateOutputs();
-            drawDisplay();
+            // MODIFIED: Sensor reads, input handling and display refresh run from the task table
+            runScheduler();
             break;
 
         case STATE_CHARGING:
-            // Placeholder for charging logic
+            // MODIFIED: The same tasks at the charging cadence (see Charging)
+            runScheduler();
             break;
 
         case STATE_LOW_BATTERY:
-            // At 0%: flash longer bursts, then show message and power down
-            // Long bursts: 3 bursts of 5 pulses, 200ms on/off
-            flashBurst(3, 5, 200, 200, brightness);
+            // MODIFIED: Non-blocking sequence: flash, show the message for 10 seconds, power down
+            drawDisplay();
+            switch (lowBatteryPhase) {
+                case LOW_BATTERY_START:
+                    // At 0%: flash longer bursts, then show message and power down
+                    // Long bursts: 3 bursts of 5 pulses, 200ms on/off
+                    // MODIFIED: At no more than the 10% level, and not at all below the cutoff
+                    if (batteryMillivolts >= BATTERY_CUTOFF_MV) {
+                        playBurstPattern(3, 5, 200, 200, 1000, min(brightness, (int)brightnessForPower(10)));
+                    }
+                    lowBatteryPhase = LOW_BATTERY_FLASHING;
+                    break;
+
+                case LOW_BATTERY_FLASHING:
+                    if (isPatternActive()) break;
+                    // NEW: Then dim out, so the end is not taken for a fault
+                    if (batteryMillivolts >= BATTERY_CUTOFF_MV && brightness > 0) {
+                        playRampPattern(min(brightness, (int)brightnessForPower(10)), 0, LOW_BATTERY_DIM_MS);
+                    }
+                    lowBatteryPhase = LOW_BATTERY_DIMMING;
+                    break;
+
+                case LOW_BATTERY_DIMMING:
+                    if (isPatternActive()) break;
+                    // Shut LED off and ensure timer cannot drive the pin
+                    setOutputImmediate(0);
+                    disconnectOutputs();
 
-            // Shut LED off and ensure timer cannot drive the pin
-            OCR1A = 0;
-            TCCR1A &= ~_BV(COM1A1);
-            pinMode(PWM_OUTPUT_PIN, OUTPUT);
-            digitalWrite(PWM_OUTPUT_PIN, LOW);
+                    // Keep the low battery message up for 10 seconds
+                    lowBatteryPhaseStart = millis();
+                    // NEW: Save the user's state before powering down
+                    requestSettingsFlush();
+                    lowBatteryPhase = LOW_BATTERY_MESSAGE;
+                    break;
 
-            // Show persistent low battery message for 10 seconds
-            drawLowBatteryScreen();
-            delay(10000);
+                case LOW_BATTERY_MESSAGE:
+                    if (millis() - lowBatteryPhaseStart < 10000 || isDisplayFrameInFlight() || !isEepromIdle()) break;
 
-            // Put OLED into power-save so it stops drawing
-            u8g2.setPowerSave(1);
+                    // Put OLED into power-save so it stops drawing
+                    u8g2.setPowerSave(1);
 
-            // Enter power-down sleep (board will only wake on reset/power-cycle or configured external wake sources)
-            set_sleep_mode(SLEEP_MODE_PWR_DOWN);
-            noInterrupts();
-            sleep_enable();
-            interrupts();
-            sleep_cpu();
-            sleep_disable();
+                    // Enter power-down sleep (board will only wake on reset/power-cycle or configured external wake sources)
+                    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+                    noInterrupts();
+                    sleep_enable();
+                    interrupts();
+                    sleep_cpu();
+                    sleep_disable();
 
-            // On wake (usually a reset/power cycle), restore display and state
-            u8g2.setPowerSave(0);
-            low10Handled = false; // reset the 10% handler
-            currentState = STATE_OPERATING;
+                    // On wake (usually a reset/power cycle), restore display and state
+                    u8g2.setPowerSave(0);
+                    TCCR1A |= PWM_COMPARE_OUTPUTS;
+                    low10Handled = false; // reset the 10% handler
+                    lowBatteryPhase = LOW_BATTERY_START;
+                    currentState = STATE_OPERATING;
+                    break;
+            }
             break;
 
         case STATE_OVERHEAT:
             // Placeholder for overheat logic
             break;
     }
+#ifdef LAMP_BENCH
+    benchRecord(BENCH_LOOP, benchCycles() - benchLoopStart);
+#endif
+    // NEW: Loop timing for the telemetry stream
+    recordLoopPass(micros() - passStart);
+
+    // NEW: Sleep until the next interrupt (idle, or standby when off and settled)
+    idleSleep();
 }
 
 void handleInputs() {
+    // MODIFIED: Drain the input event ring; while critical, inputs are discarded
+    InputEvent event;
+    while (popInputEvent(event) || takeIrFrame(event)) {
+        if (isOverheatCritical) continue;
+        // NEW: Any touch (but not a held IR key) is an input event for the running scene
+        if (!(event.type == INPUT_IR && (event.flags & INPUT_FLAG_REPEAT))) postSceneEvent(SCENE_EVENT_INPUT);
+        switch (event.type) {
+            case INPUT_ENCODER: encoderPosition += (int8_t)event.value; break;
+            case INPUT_BUTTON_DOWN: handleButtonPress(event.timeMs); break;
+            case INPUT_BUTTON_UP: handleButtonRelease(event.timeMs); break;
+            case INPUT_IR: dispatchIrCommand(event.value, event.flags & INPUT_FLAG_REPEAT, event.timeMs); break;
+        }
+    }
+    int16_t overflowSteps;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        overflowSteps = inputEncoderOverflow;
+        inputEncoderOverflow = 0;
+    }
+
     // Critical: block all user inputs
     if (isOverheatCritical) {
         return;
     }
-    // Warn: disable IR and push; allow only rotary brightness changes (capped)
-    if (isOverheatWarn) {
-        handleRotaryEncoderWarnTempAdjust();
-        return;
+    // MODIFIED: Thermal limiting no longer restricts inputs; the governor caps the output
+    encoderPosition += overflowSteps;
+    resyncButton();
+#ifdef LAMP_BENCH
+    if (benchPendingIrCode) {
+        dispatchIrCommand(IR_COMMAND(benchPendingIrCode), false, millis());
+        benchPendingIrCode = 0;
     }
-    // Normal
-    handleIrInputs();
+#endif
     handleRotaryEncoderInputs();
 }
 
-// Read only rotary rotation; cap brightness to 50% and keep encoder in sync
-void handleRotaryEncoderWarnTempAdjust() {
-    long newEncoderValue = myEncoder.read() / rotaryScaleFactor;
-    int capped = constrain((int)newEncoderValue, 0, 50);
-    if (capped != brightness) {
-        brightness = capped;
+// The ISR drops edges inside the debounce lockout. If the button settled on the
+// other level during one, report that edge from here.
+void resyncButton() {
+    bool up;
+    uint16_t now = millis();
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        up = PIND & INPUT_BUTTON_MASK;
+        if (inputHead != inputTail || up == buttonReportedUp || (uint16_t)(now - buttonLastEdge) < BUTTON_DEBOUNCE_MS) return;
+        buttonReportedUp = up;
+        buttonLastEdge = now;
+    }
+    if (up) handleButtonRelease(now);
+    else handleButtonPress(now);
+}
+
+// --- IR Command Dispatch ---
+// NEW: Decoded commands are looked up in a PROGMEM table instead of a switch on raw
+// codes. NEC repeat frames (sent every ~108 ms while a key is held) only reach
+// actions that want them: UP/DOWN ramp at a steady rate based on the time between
+// frames, so a lost repeat does not slow the ramp down.
+const uint16_t IR_RAMP_PERCENT_PER_SEC = 40;
+const uint16_t IR_REPEAT_MAX_GAP_MS = 250;   // longer gaps: a frame was lost, don't jump
+
+typedef void (*IrAction)(int8_t arg, bool repeat, uint16_t sinceLastMs);
+
+struct IrBinding {
+  uint16_t command;
+  IrAction action;
+  int8_t arg;
+};
+
+void irTogglePower(int8_t, bool repeat, uint16_t) {
+    if (repeat) return;
+    isLampOn = !isLampOn;
+    if (isLampOn) {
+        brightness = lastBrightness;
+        if (brightness < 10) brightness = 10;
+        currentMode = MODE_SMOOTH_DIM;
+    } else {
+        lastBrightness = brightness;
+    }
+}
+
+void irStepBrightness(int8_t direction, bool repeat, uint16_t sinceLastMs) {
+    static uint16_t rampRemainder = 0; // percent * ms carried to the next frame
+    if (!isLampOn) return;
+    if (!repeat) {
+        brightness += 5 * direction;
+        rampRemainder = 0;
+        return;
+    }
+    uint32_t ramp = rampRemainder + (uint32_t)min(sinceLastMs, IR_REPEAT_MAX_GAP_MS) * IR_RAMP_PERCENT_PER_SEC;
+    brightness += direction * (int)(ramp / 1000);
+    rampRemainder = ramp % 1000;
+}
+
+void irSelectPreset(int8_t index, bool repeat, uint16_t) {
+    if (repeat || !isLampOn) return;
+    stopScene();
+    brightness = presets[index];
+}
+
+// NEW: One colour temperature step per press, and a few per second while held
+const uint16_t IR_COLOR_TEMP_REPEAT_MS = 250;
+
+void irStepColorTemp(int8_t direction, bool repeat, uint16_t sinceLastMs) {
+    static uint16_t heldMs = 0;
+    if (!isLampOn) return;
+    if (repeat) {
+        heldMs += min(sinceLastMs, IR_REPEAT_MAX_GAP_MS);
+        if (heldMs < IR_COLOR_TEMP_REPEAT_MS) return;
+        heldMs -= IR_COLOR_TEMP_REPEAT_MS;
+    } else {
+        heldMs = 0;
+    }
+    setColorTempStep(constrain(colorTempStep + direction, 0, CCT_STEPS - 1));
+}
+
+// NEW: Starts a scene (switching the lamp on if needed); the same key again stops it
+void irToggleScene(int8_t index, bool repeat, uint16_t) {
+    if (repeat) return;
+    if (!isLampOn) irTogglePower(0, false, 0);
+    if (isSceneActive() && sceneIndex == index) stopScene();
+    else startScene(index);
+}
+
+const IrBinding irBindings[] PROGMEM = {
+  { IR_COMMAND(IR_CODE_POWER),    irTogglePower,    0 },
+  { IR_COMMAND(IR_CODE_UP),       irStepBrightness, 1 },
+  { IR_COMMAND(IR_CODE_DOWN),     irStepBrightness, -1 },
+  { IR_COMMAND(IR_CODE_PRESET_1), irSelectPreset,   0 },
+  { IR_COMMAND(IR_CODE_PRESET_2), irSelectPreset,   1 },
+  { IR_COMMAND(IR_CODE_PRESET_3), irSelectPreset,   2 },
+  { IR_COMMAND(IR_CODE_PRESET_4), irSelectPreset,   3 },
+  { IR_COMMAND(IR_CODE_SCENE_1),  irToggleScene,    0 },
+  { IR_COMMAND(IR_CODE_SCENE_2),  irToggleScene,    1 },
+  { IR_COMMAND(IR_CODE_SCENE_3),  irToggleScene,    2 },
+  { IR_COMMAND(IR_CODE_SCENE_4),  irToggleScene,    3 },
+  { IR_COMMAND(IR_CODE_WARMER),   irStepColorTemp,  -1 },
+  { IR_COMMAND(IR_CODE_COOLER),   irStepColorTemp,  1 },
+};
+
+// Apply one decoded IR command (also used by the benchmark stimulus)
+void dispatchIrCommand(uint16_t command, bool repeat, uint16_t timeMs) {
+    static uint16_t lastCommand = 0;
+    static uint16_t lastTimeMs = 0;
+    if (repeat && command != lastCommand) return; // repeat of a frame we never saw
+    uint16_t sinceLastMs = timeMs - lastTimeMs;
+    lastCommand = command;
+    lastTimeMs = timeMs;
+
+    for (uint8_t i = 0; i < sizeof(irBindings) / sizeof(irBindings[0]); i++) {
+        if (pgm_read_word(&irBindings[i].command) != command) continue;
+        IrBinding binding;
+        memcpy_P(&binding, &irBindings[i], sizeof(binding));
+        binding.action(binding.arg, repeat, sinceLastMs);
+        break;
+    }
+    brightness = constrain(brightness, 0, 100);
+    resyncEncoder();
+}
+
+// NEW: Acts on a scene's OFF instruction, and ends the scene when the lamp goes off
+void serviceScene() {
+    bool switchOff;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        switchOff = sceneRequestsOff;
+        sceneRequestsOff = false;
+    }
+    if (switchOff && isLampOn) {
+        lastBrightness = brightness;
+        isLampOn = false;
+    }
+    if (!isLampOn) stopScene();
+}
+
+// --- Serial Protocol ---
+// NEW: Command frames (see the UART driver) are applied between loop passes, the
+// same way as IR commands, and refused while the lamp is not operating or is in
+// the overheat cutoff. Bytes are only taken from the RX ring while a whole reply
+// fits in the TX ring, so replies are never dropped. Telemetry samples are skipped
+// instead when the host does not keep up.
+enum FrameStatus : uint8_t {
+  FRAME_STATUS_OK,
+  FRAME_STATUS_BAD_ARGUMENT,
+  FRAME_STATUS_REFUSED,
+  FRAME_STATUS_UNKNOWN
+};
+enum FrameParseStep : uint8_t {
+  PARSE_SYNC,
+  PARSE_TYPE,
+  PARSE_LENGTH,
+  PARSE_PAYLOAD,
+  PARSE_CRC
+};
+const unsigned long FRAME_BYTE_TIMEOUT_MS = 100; // a partial frame is dropped after this gap
+const uint8_t STATE_PAYLOAD_SIZE = 13;
+const uint8_t TELEMETRY_PAYLOAD_SIZE = 14;
+
+FrameParseStep parseStep = PARSE_SYNC;
+uint8_t parseType = 0;
+uint8_t parseLength = 0;
+uint8_t parseIndex = 0;
+uint8_t parseCrc = 0;
+uint8_t parsePayload[FRAME_MAX_PAYLOAD];
+unsigned long parseLastByteAt = 0;
+uint8_t serialBadFrames = 0;
+
+uint8_t telemetryPeriod = 0;         // in 100 ms, 0 = stream off
+unsigned long telemetryLastSent = 0;
+uint16_t loopWorstUs = 0;            // longest loop pass since the last sample
+uint16_t loopPasses = 0;             // loop passes since the last sample
+
+void recordLoopPass(unsigned long us) {
+    if (us > loopWorstUs) loopWorstUs = min(us, 0xFFFFUL);
+    if (loopPasses < 0xFFFF) loopPasses++;
+}
+
+bool isSerialIdle() {
+    return telemetryPeriod == 0 && parseStep == PARSE_SYNC && !uartRxPending() && isUartTxIdle();
+}
+
+// Multi-byte fields are little-endian
+void putWord(uint8_t* out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+// FRAME_STATE: state, mode, flags (lamp on, limiting, cutoff, editing preset, charge limited),
+// brightness, thermal ceiling, preset, battery %, battery mV, temperature in
+// 0.01 C, runtime left in minutes
+void sendState() {
+    uint8_t payload[STATE_PAYLOAD_SIZE];
+    payload[0] = currentState;
+    payload[1] = currentMode;
+    payload[2] = isLampOn | isOverheatWarn << 1 | isOverheatCritical << 2 | isEditingPreset << 3 | isChargeLimited << 4;
+    payload[3] = brightness;
+    payload[4] = thermalCeiling;
+    payload[5] = highlightedPreset;
+    payload[6] = batteryPercent;
+    putWord(payload + 7, batteryMillivolts);
+    putWord(payload + 9, ledTemperature);
+    putWord(payload + 11, runtimeMinutes);
+    sendFrame(FRAME_STATE, payload, sizeof(payload));
+}
+
+// FRAME_TELEMETRY_SAMPLE: millis (32 bit), battery mV, temperature in 0.01 C, fade
+// level (percent Q8, i.e. the duty before dithering), longest loop pass in us and
+// the number of loop passes since the previous sample
+void serviceTelemetryStream(unsigned long now) {
+    if (telemetryPeriod == 0 || now - telemetryLastSent < telemetryPeriod * 100UL) return;
+    if (!canSendFrame(TELEMETRY_PAYLOAD_SIZE)) return;
+    uint16_t level;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        level = fadeLevel;
+    }
+    uint8_t payload[TELEMETRY_PAYLOAD_SIZE];
+    putWord(payload, now & 0xFFFF);
+    putWord(payload + 2, now >> 16);
+    putWord(payload + 4, batteryMillivolts);
+    putWord(payload + 6, ledTemperature);
+    putWord(payload + 8, level);
+    putWord(payload + 10, loopWorstUs);
+    putWord(payload + 12, loopPasses);
+    sendFrame(FRAME_TELEMETRY_SAMPLE, payload, sizeof(payload));
+    telemetryLastSent = now;
+    loopWorstUs = 0;
+    loopPasses = 0;
+}
+
+FrameStatus applyFrame() {
+    bool accepting = currentState == STATE_OPERATING && !isOverheatCritical;
+    switch (parseType) {
+        case FRAME_SET_BRIGHTNESS:
+            if (parseLength != 1 || parsePayload[0] > 100) return FRAME_STATUS_BAD_ARGUMENT;
+            if (!accepting || !isLampOn) return FRAME_STATUS_REFUSED;
+            brightness = parsePayload[0];
+            break;
+        case FRAME_SELECT_PRESET:
+            if (parseLength != 1 || parsePayload[0] > 3) return FRAME_STATUS_BAD_ARGUMENT;
+            if (!accepting || !isLampOn) return FRAME_STATUS_REFUSED;
+            irSelectPreset(parsePayload[0], false, 0);
+            break;
+        case FRAME_TOGGLE_POWER:
+            if (!accepting) return FRAME_STATUS_REFUSED;
+            irTogglePower(0, false, 0);
+            break;
+        case FRAME_TELEMETRY:
+            if (parseLength != 1) return FRAME_STATUS_BAD_ARGUMENT;
+            telemetryPeriod = parsePayload[0];
+            telemetryLastSent = millis();
+            loopWorstUs = 0;
+            loopPasses = 0;
+            return FRAME_STATUS_OK;
+        case FRAME_LOG_DUMP:
+            startLogDump();
+            return FRAME_STATUS_OK;
+        case FRAME_SET_FADE_RATE: {
+            if (parseLength != 2) return FRAME_STATUS_BAD_ARGUMENT;
+            uint16_t rate = parsePayload[0] | parsePayload[1] << 8;
+            if (rate == 0 || rate > 1000) return FRAME_STATUS_BAD_ARGUMENT;
+            setFadeRate(rate);
+            return FRAME_STATUS_OK;
+        }
+        default:
+            return FRAME_STATUS_UNKNOWN;
     }
-    // Keep encoder in sync so there is no "empty" scrolling above 50%
-    if (newEncoderValue != capped) {
-        myEncoder.write(capped * rotaryScaleFactor);
+    resyncEncoder();
+    return FRAME_STATUS_OK;
+}
+
+void handleFrame() {
+    if (parseType == FRAME_QUERY_STATE) {
+        sendState();
+        return;
     }
+    uint8_t ack[2] = { parseType, applyFrame() };
+    sendFrame(FRAME_ACK, ack, sizeof(ack));
 }
 
-void handleIrInputs() {
-    if (IrReceiver.decode()) {
-        switch (IrReceiver.decodedIRData.decodedRawData) {
-            case IR_CODE_POWER:
-                isLampOn = !isLampOn;
-                if (isLampOn) {
-                    brightness = lastBrightness;
-                    if (brightness < 10) brightness = 10;
-                    currentMode = MODE_SMOOTH_DIM;
-                } else {
-                    lastBrightness = brightness;
+void serviceSerial(unsigned long now) {
+    if (parseStep != PARSE_SYNC && now - parseLastByteAt > FRAME_BYTE_TIMEOUT_MS) {
+        parseStep = PARSE_SYNC;
+        if (serialBadFrames < 0xFF) serialBadFrames++;
+    }
+    while (uartRxPending() && canSendFrame(FRAME_MAX_PAYLOAD)) {
+        uint8_t value = uartRead();
+        parseLastByteAt = now;
+        switch (parseStep) {
+            case PARSE_SYNC:
+                if (value == FRAME_SYNC) parseStep = PARSE_TYPE;
+                break;
+            case PARSE_TYPE:
+                parseType = value;
+                parseCrc = _crc8_ccitt_update(0, value);
+                parseStep = PARSE_LENGTH;
+                break;
+            case PARSE_LENGTH:
+                if (value > FRAME_MAX_PAYLOAD) {
+                    parseStep = PARSE_SYNC;
+                    if (serialBadFrames < 0xFF) serialBadFrames++;
+                    break;
+                }
+                parseLength = value;
+                parseIndex = 0;
+                parseCrc = _crc8_ccitt_update(parseCrc, value);
+                parseStep = value ? PARSE_PAYLOAD : PARSE_CRC;
+                break;
+            case PARSE_PAYLOAD:
+                parsePayload[parseIndex++] = value;
+                parseCrc = _crc8_ccitt_update(parseCrc, value);
+                if (parseIndex == parseLength) parseStep = PARSE_CRC;
+                break;
+            case PARSE_CRC:
+                parseStep = PARSE_SYNC;
+                if (value == parseCrc) {
+                    handleFrame();
+                } else if (serialBadFrames < 0xFF) {
+                    serialBadFrames++;
                 }
                 break;
-            case IR_CODE_UP: if (isLampOn) brightness += 5; break;
-            case IR_CODE_DOWN: if (isLampOn) brightness -= 5; break;
-            case IR_CODE_PRESET_1: if (isLampOn) brightness = 10; break;
-            case IR_CODE_PRESET_2: if (isLampOn) brightness = 25; break;
-            case IR_CODE_PRESET_3: if (isLampOn) brightness = 50; break;
-            case IR_CODE_PRESET_4: if (isLampOn) brightness = 100; break;
         }
-        brightness = constrain(brightness, 0, 100);
-        myEncoder.write(brightness * rotaryScaleFactor);
-        IrReceiver.resume();
     }
+    serviceTelemetryStream(now);
+}
+
+// MODIFIED: Button handling is split into edge handlers fed by input events
+bool buttonIsDown = false;
+uint16_t buttonDownAt = 0;
+
+void handleButtonPress(uint16_t timeMs) {
+    buttonIsDown = true;
+    buttonDownAt = timeMs;
+}
+
+void handleButtonRelease(uint16_t timeMs) {
+    if (!buttonIsDown) return; // the press was discarded (overheat cutoff)
+    buttonIsDown = false;
+    uint16_t heldMs = timeMs - buttonDownAt;
+
+    if (isEditingPreset) {
+        // NEW: A press while editing confirms the value and returns to selecting
+        if (!longPressActionTaken) {
+            isEditingPreset = false;
+            encoderPosition = highlightedPreset * 4;
+            if (isLampOn) playBlinkPattern(PRESET_SAVED_BLINKS, PRESET_SAVED_BLINK_MS, presets[highlightedPreset]);
+        }
+    } else if (currentMode == MODE_PRESET_SELECT && !longPressActionTaken && heldMs > 1000) {
+        // MODIFIED: The entries after the presets start a light scene
+        if (highlightedPreset < 4) {
+            stopScene();
+            brightness = presets[highlightedPreset];
+        } else if (isLampOn) {
+            startScene(highlightedPreset - 4);
+        }
+        currentMode = MODE_SMOOTH_DIM;
+        encoderPosition = brightness * rotaryScaleFactor;
+    } else if (!longPressActionTaken) {
+        currentMode = (LampMode)((currentMode + 1) % (MODE_COLOR_TEMP + 1));
+        switch(currentMode) {
+            case MODE_SMOOTH_DIM: encoderPosition = brightness * rotaryScaleFactor; break;
+            case MODE_PRESET_SELECT: encoderPosition = highlightedPreset * 4; break;
+            case MODE_STATS: encoderPosition = 0; break;
+            case MODE_COLOR_TEMP: encoderPosition = colorTempStep * 4; break;
+        }
+    }
+    longPressActionTaken = false;
 }
 
 void handleRotaryEncoderInputs() {
-    debouncer.update();
+    // NEW: Leaving preset select (e.g. by IR) ends an unfinished edit
+    if (currentMode != MODE_PRESET_SELECT) isEditingPreset = false;
 
-    if (debouncer.read() == LOW) {
-        if (debouncer.duration() > 1000 && !longPressActionTaken) {
-            if (currentMode == MODE_PRESET_SELECT) {
-                brightness = presets[highlightedPreset];
+    if (buttonIsDown) {
+        uint16_t heldMs = (uint16_t)millis() - buttonDownAt;
+        if (currentMode == MODE_PRESET_SELECT) {
+            // MODIFIED: In preset select a long press acts on release; holding on enters preset edit
+            if (isLampOn && !isEditingPreset && highlightedPreset < 4 && heldMs > PRESET_EDIT_HOLD_MS && !longPressActionTaken) {
+                isEditingPreset = true;
+                encoderPosition = presets[highlightedPreset] * rotaryScaleFactor;
+                longPressActionTaken = true;
+            }
+        } else if (heldMs > 1000 && !longPressActionTaken) {
+            isLampOn = !isLampOn;
+            if (isLampOn) {
+                brightness = lastBrightness;
+                if (brightness < 10) brightness = 10;
                 currentMode = MODE_SMOOTH_DIM;
-                myEncoder.write(brightness * rotaryScaleFactor);
+                encoderPosition = brightness * rotaryScaleFactor;
             } else {
-                isLampOn = !isLampOn;
-                if (isLampOn) {
-                    brightness = lastBrightness;
-                    if (brightness < 10) brightness = 10;
-                    currentMode = MODE_SMOOTH_DIM;
-                    myEncoder.write(brightness * rotaryScaleFactor);
-                } else {
-                    lastBrightness = brightness;
-                }
+                lastBrightness = brightness;
             }
             longPressActionTaken = true;
         }
     }
 
-    if (debouncer.rose()) {
-        if (!longPressActionTaken) {
-            currentMode = (LampMode)((currentMode + 1) % 3);
-            switch(currentMode) {
-                case MODE_SMOOTH_DIM: myEncoder.write(brightness * rotaryScaleFactor); break;
-                case MODE_PRESET_SELECT: myEncoder.write(highlightedPreset * 4); break;
-                case MODE_STATS: break;
-            }
-        }
-        longPressActionTaken = false;
-    }
-
     if (isLampOn) {
         long newEncoderValue;
         switch(currentMode) {
             case MODE_SMOOTH_DIM:
-                newEncoderValue = myEncoder.read() / rotaryScaleFactor;
+                newEncoderValue = encoderPosition / rotaryScaleFactor;
                 brightness = constrain(newEncoderValue, 0, 100);
-                if (brightness != newEncoderValue) myEncoder.write(brightness * rotaryScaleFactor);
+                if (brightness != newEncoderValue) encoderPosition = brightness * rotaryScaleFactor;
                 break;
             case MODE_PRESET_SELECT:
-                newEncoderValue = myEncoder.read() / 4;
-                highlightedPreset = (newEncoderValue % 4 + 4) % 4;
+                if (isEditingPreset) {
+                    newEncoderValue = encoderPosition / rotaryScaleFactor;
+                    presets[highlightedPreset] = constrain(newEncoderValue, 1, 100);
+                    if (presets[highlightedPreset] != newEncoderValue) encoderPosition = presets[highlightedPreset] * rotaryScaleFactor;
+                    break;
+                }
+                newEncoderValue = encoderPosition / 4;
+                highlightedPreset = (newEncoderValue % (4 + SCENE_COUNT) + 4 + SCENE_COUNT) % (4 + SCENE_COUNT);
+                break;
+            case MODE_STATS:
+                // NEW: The page flips at either end of a few detents' travel, and
+                // a detent back from the end keeps the page it shows
+                newEncoderValue = constrain(encoderPosition / 4, 0, DIAGNOSTICS_DETENTS);
+                if (newEncoderValue == DIAGNOSTICS_DETENTS) isShowingDiagnostics = true;
+                else if (newEncoderValue == 0) isShowingDiagnostics = false;
+                if (encoderPosition / 4 != newEncoderValue) encoderPosition = newEncoderValue * 4;
+                break;
+            case MODE_COLOR_TEMP:
+                // NEW: One colour temperature step per detent
+                newEncoderValue = encoderPosition / 4;
+                if (newEncoderValue != colorTempStep) setColorTempStep(constrain(newEncoderValue, 0, CCT_STEPS - 1));
+                if (colorTempStep != newEncoderValue) encoderPosition = colorTempStep * 4;
                 break;
-            case MODE_STATS: break;
         }
     } else {
         brightness = 0;
     }
 }
 
-void updateBatteryStats() {
-    // Step 1: Measure the true VCC voltage in millivolts
-    long vcc_mV = readVcc();
+// NEW: Encoder position for the value the current mode adjusts, after it was
+// changed some other way (IR, serial, battery clamp)
+void resyncEncoder() {
+    switch (currentMode) {
+        case MODE_PRESET_SELECT: encoderPosition = isEditingPreset ? presets[highlightedPreset] * rotaryScaleFactor : highlightedPreset * 4; break;
+        case MODE_STATS: break;
+        case MODE_COLOR_TEMP: encoderPosition = colorTempStep * 4; break;
+        default: encoderPosition = brightness * rotaryScaleFactor; break;
+    }
+}
 
-    // Step 2: Read the averaged value from our voltage divider
-    long rawValueSum = 0;
-    const int numReadings = 10;
-    for (int i = 0; i < numReadings; i++) {
-        rawValueSum += analogRead(VOLTAGE_SENSE_PIN);
+void updateBatteryStats() {
+    // MODIFIED: O(1) read of the filtered values maintained by the ADC interrupt
+    uint16_t batteryRaw, bandgapRaw;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        batteryRaw = adcBatteryFiltered;
+        bandgapRaw = adcBandgapFiltered;
     }
-    float averageRawValue = (float)rawValueSum / numReadings;
+    if (bandgapRaw == 0) return; // Pipeline not primed yet
 
-    // Step 3: Calculate the true voltage at the pin
-    // V_pin = (ADC reading / ADC max) * Vcc
-    float pinVoltage = (averageRawValue / 1023.0) * (vcc_mV / 1000.0);
+    // Step 1: Calculate the true battery voltage in millivolts
+    // V_pin = (raw / 1023) * Vcc and Vcc = 1.1V * 1023 / bandgap, so V_pin = 1.1V * raw / bandgap.
+    // Divider ratio for 68k/10k is (68+10)/10 = 7.8, so V_batt = 8580mV * raw / bandgap.
+    batteryMeasuredMillivolts = (uint32_t)batteryRaw * BATTERY_MV_PER_BANDGAP / bandgapRaw;
+#ifdef LAMP_BENCH
+    if (benchBatteryOverrideMv >= 0) batteryMeasuredMillivolts = benchBatteryOverrideMv;
+#endif
+    // NEW: Scaled by the reading at the last end of charge
+    batteryMillivolts = calibrateBatteryReading(batteryMeasuredMillivolts);
 
-    // Step 4: Convert back to the real battery voltage
-    // Divider ratio for 68k/10k is (68+10)/10 = 7.8
-    batteryVoltage = pinVoltage * 7.8;
-    
-    // Step 5: Calculate percentage
-    batteryPercent = map(batteryVoltage * 100, 640, 830, 0, 100);
-    batteryPercent = constrain(batteryPercent, 0, 100);
+    // MODIFIED: Step 2: Load-compensated state of charge instead of a linear voltage map
+    updateStateOfCharge(batteryMillivolts, millis());
 }
 
 
 void updateOutputs() {
-    // Apply overheat policies: hard-off at critical, cap at 50% in warn
-    int effectiveBrightness = isLampOn ? brightness : 0;
+    // MODIFIED: Hard-off at critical, otherwise never above the thermal governor's ceiling
+    int requestedBrightness = isLampOn ? brightness : 0;
+    int effectiveBrightness = requestedBrightness;
+    // NEW: The governor's ceiling is a share of the mix's full output, so it scales
+    // both channels; the charging cap is LED power, and the brightness it allows
+    // depends on the colour mix
+    int thermalLimit = thermalCeiling;
+    int ceiling = thermalLimit;
+    // NEW: The charger heats the pack as well, so charging caps the output further
+    if (currentState == STATE_CHARGING && thermalCeiling > CHARGING_OUTPUT_CAP) ceiling = brightnessForPower(CHARGING_OUTPUT_CAP);
+    brightnessCeiling = ceiling;
     if (isOverheatCritical) {
         effectiveBrightness = 0;
-    } else if (isOverheatWarn) {
-        if (effectiveBrightness > 50) effectiveBrightness = 50;
+        // NEW: No notification flashes at the hard cutoff either
+        stopPattern();
+    } else if (effectiveBrightness > ceiling) {
+        effectiveBrightness = ceiling;
+    }
+    // NEW: The same ceiling for the pattern engine
+    uint16_t patternCeiling = isOverheatCritical ? 0 : brightnessToDuty(ceiling);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        patternCeilingDuty = patternCeiling;
+    }
+    // MODIFIED: Each flag for its own limit
+    isOverheatWarn = !isOverheatCritical && requestedBrightness > thermalLimit;
+    isChargeLimited = !isOverheatCritical && ceiling < thermalLimit && requestedBrightness > ceiling;
+    // MODIFIED: Only publish the target; the Timer1 ISR fades to it and dithers it onto OCR1A
+    setFadeTarget(constrain(effectiveBrightness, 0, 100));
+}
+
+// --- Screen Descriptors ---
+// Each screen declares the values it shows, quantized to the resolution it shows them
+// at, and where on the glass they are drawn (8-row pages and an 8-pixel tile column
+// range). drawDisplay() redraws everything when the screen changes, otherwise only
+// the regions whose displayed value actually changed.
+enum DisplayField : uint8_t {
+  FIELD_BRIGHTNESS,
+  FIELD_PRESET,
+  FIELD_BATTERY_PERCENT,
+  FIELD_BATTERY_VOLTS,
+  FIELD_TEMPERATURE,
+  FIELD_OVERRUNS,
+  FIELD_AWAKE,
+  FIELD_RUNTIME,
+  FIELD_PRESET_RUNTIME,
+  FIELD_THERMAL_CEILING,
+  FIELD_STACK,
+  FIELD_TEMP_BUS_TIMING,
+  FIELD_BOOT_TIMING,
+  FIELD_CHARGE_ETA,
+  FIELD_PRESET_PAGE,
+  FIELD_SCENE,
+  FIELD_COLOR_TEMP,
+  FIELD_LIMIT_REASON,
+  FIELD_COUNT
+};
+
+enum ScreenId : uint8_t {
+  SCREEN_OFF,
+  SCREEN_SMOOTH_DIM,
+  SCREEN_PRESET,
+  SCREEN_STATS,
+  SCREEN_OVERHEAT_WARN,
+  SCREEN_OVERHEAT,
+  SCREEN_LOW_BATTERY,
+  SCREEN_DIAGNOSTICS,
+  SCREEN_CHARGING,
+  SCREEN_COLOR_TEMP,
+  SCREEN_COUNT
+};
+
+struct ScreenField {
+  DisplayField field;
+  uint8_t pages;      // bit n = page n (rows 8n..8n+7)
+  uint8_t firstTile;  // columns firstTile*8 ..
+  uint8_t lastTile;   // .. lastTile*8+7
+};
+
+struct ScreenDescriptor {
+  void (*draw)();
+  const ScreenField* fields;
+  uint8_t fieldCount;
+};
+
+void drawOffScreen();
+
+const ScreenField smoothDimFields[] PROGMEM = {
+  { FIELD_BRIGHTNESS, 0x38, 3, 12 },
+  { FIELD_SCENE,      0xC0, 0, 15 },
+};
+const ScreenField presetFields[] PROGMEM = {
+  { FIELD_PRESET_PAGE,    0x03, 0, 15 },
+  { FIELD_PRESET,         0xF8, 0, 15 },
+  { FIELD_PRESET_RUNTIME, 0x60, 0, 15 },
+};
+const ScreenField statsFields[] PROGMEM = {
+  { FIELD_BATTERY_PERCENT, 0x0C, 3, 15 },
+  { FIELD_BATTERY_VOLTS,   0x0C, 3, 15 },
+  { FIELD_RUNTIME,         0x0C, 3, 15 },
+  { FIELD_TEMPERATURE,     0x38, 3, 15 },
+  { FIELD_AWAKE,           0x60, 4, 15 },
+  { FIELD_OVERRUNS,        0xC0, 3, 15 },
+};
+const ScreenField overheatWarnFields[] PROGMEM = {
+  { FIELD_LIMIT_REASON,     0x07, 0, 15 },
+  { FIELD_BRIGHTNESS,       0xF8, 0, 15 },
+  { FIELD_THERMAL_CEILING, 0xF8, 0, 15 },
+  { FIELD_TEMPERATURE,      0x60, 0, 15 },
+};
+const ScreenField diagnosticsFields[] PROGMEM = {
+  { FIELD_STACK,            0x0C, 0, 15 },
+  { FIELD_BOOT_TIMING,      0x38, 0, 15 },
+  { FIELD_TEMP_BUS_TIMING,  0x60, 0, 15 },
+};
+const ScreenField chargingFields[] PROGMEM = {
+  { FIELD_BATTERY_PERCENT, 0x78, 0, 15 },
+  { FIELD_BATTERY_VOLTS,   0xC0, 0, 15 },
+  { FIELD_CHARGE_ETA,      0xC0, 0, 15 },
+};
+const ScreenField colorTempFields[] PROGMEM = {
+  { FIELD_COLOR_TEMP, 0x7C, 0, 15 },
+};
+const ScreenField overheatFields[] PROGMEM = {
+  { FIELD_TEMPERATURE, 0x70, 3, 12 },
+};
+
+#define SCREEN_FIELDS(list) list, sizeof(list) / sizeof(list[0])
+const ScreenDescriptor screens[SCREEN_COUNT] PROGMEM = {
+  { drawOffScreen,          NULL, 0 },
+  { drawSmoothDimScreen,    SCREEN_FIELDS(smoothDimFields) },
+  { drawPresetScreen,       SCREEN_FIELDS(presetFields) },
+  { drawStatsScreen,        SCREEN_FIELDS(statsFields) },
+  { drawOverheatWarnScreen, SCREEN_FIELDS(overheatWarnFields) },
+  { drawOverheatScreen,     SCREEN_FIELDS(overheatFields) },
+  { drawLowBatteryScreen,   NULL, 0 },
+  { drawDiagnosticsScreen,  SCREEN_FIELDS(diagnosticsFields) },
+  { drawChargingScreen,     SCREEN_FIELDS(chargingFields) },
+  { drawColorTempScreen,    SCREEN_FIELDS(colorTempFields) },
+};
+
+// The screen every page of the current frame is rendered from
+ScreenId displayedScreen = SCREEN_COUNT;
+
+ScreenId currentScreen() {
+    if (currentState == STATE_LOW_BATTERY) return SCREEN_LOW_BATTERY;
+    if (isOverheatCritical) return SCREEN_OVERHEAT;
+    // NEW: Charge progress while the lamp is off
+    if (currentState == STATE_CHARGING && !isLampOn) return SCREEN_CHARGING;
+    if (!isLampOn) return SCREEN_OFF;
+    switch (currentMode) {
+        case MODE_PRESET_SELECT: return SCREEN_PRESET;
+        case MODE_STATS: return isShowingDiagnostics ? SCREEN_DIAGNOSTICS : SCREEN_STATS;
+        case MODE_COLOR_TEMP: return SCREEN_COLOR_TEMP;
+        // MODIFIED: While limited, the dimming screen shows the limit and the temperature
+        default: return isOverheatWarn || isChargeLimited ? SCREEN_OVERHEAT_WARN : SCREEN_SMOOTH_DIM;
+    }
+}
+
+// The value of a field exactly as the screens print it. A field that prints several
+// values returns a revision counter that moves on every change of any of them, so
+// two different sets of values can never compare equal.
+uint16_t quantizedField(DisplayField field) {
+    switch (field) {
+        case FIELD_BRIGHTNESS: return brightness;
+        case FIELD_PRESET: return highlightedPreset | (isEditingPreset << 3) | ((highlightedPreset < 4 ? presets[highlightedPreset] : 0) << 4);
+        case FIELD_PRESET_PAGE: return highlightedPreset >= 4;
+        case FIELD_SCENE: return isSceneActive() ? sceneIndex + 1 : 0;
+        case FIELD_COLOR_TEMP: return colorTempStep;
+        case FIELD_BATTERY_PERCENT: return batteryPercent;
+        case FIELD_BATTERY_VOLTS: return millivoltsToCentiVolts(batteryMillivolts);
+        case FIELD_TEMPERATURE: return centiCToDeciC(ledTemperature);
+        case FIELD_OVERRUNS: return totalTaskOverruns();
+        case FIELD_AWAKE: return awakePercent | (savedMicroamps / 100) << 7;
+        case FIELD_RUNTIME: return runtimeMinutes;
+        // MODIFIED: The limit screen prints the brightness the limits allow
+        case FIELD_THERMAL_CEILING: return brightnessCeiling;
+        case FIELD_LIMIT_REASON: return isOverheatWarn;
+        case FIELD_STACK: return stackPeak;
+        case FIELD_TEMP_BUS_TIMING: return tempBusTimingRevision;
+        case FIELD_BOOT_TIMING: return bootFirstFrameUs != 0;
+        case FIELD_CHARGE_ETA: return chargeEtaMinutes;
+        case FIELD_PRESET_RUNTIME: return presetRuntimeRevision;
+        default: return 0;
     }
-    int pwmValue = map(effectiveBrightness, 0, 100, 0, 511);
-    OCR1A = pwmValue;
 }
 
 void drawDisplay() {
-    static int lastDisplayedBrightness = -1;
-    static bool lastDisplayedState = !isLampOn;
-    static LampMode lastUpdatedMode = (LampMode)-1;
-    static int lastHighlightedPreset = -1;
-    static int lastBatteryPercent = -1;
-    // NEW: Track temperature for redraws
-    static float lastTemperature = -999; 
-    // NEW: Track overheat flags for redraws
-    static bool lastIsOverheatWarn = false;
-    static bool lastIsOverheatCritical = false;
-
-    // NEW: The 'if' condition now includes the temperature
-    if (brightness != lastDisplayedBrightness ||
-         isLampOn != lastDisplayedState ||
-          currentMode != lastUpdatedMode ||
-           highlightedPreset != lastHighlightedPreset ||
-          batteryPercent != lastBatteryPercent ||
-           ledTemperature != lastTemperature ||
-           isOverheatWarn != lastIsOverheatWarn ||
-           isOverheatCritical != lastIsOverheatCritical) {
-        u8g2.firstPage();
-        do {
-            if (isOverheatCritical) {
-                drawOverheatScreen();
-            } else if (isOverheatWarn) {
-                drawOverheatWarnScreen();
-            } else if (!isLampOn) {
-                u8g2.setFont(u8g2_font_ncenB14_tr);
-                u8g2_uint_t textWidth = u8g2.getStrWidth("OFF");
-                u8g2.drawStr((128 - textWidth) / 2, 38, "OFF");
-            } else {
-                switch(currentMode) {
-                    case MODE_SMOOTH_DIM: drawSmoothDimScreen(); break;
-                    case MODE_PRESET_SELECT: drawPresetScreen(); break;
-                    case MODE_STATS: drawStatsScreen(); break;
-                }
-            }
-        } while (u8g2.nextPage());
+    // MODIFIED: Redraw decisions come from the screen descriptors instead of raw last-values
+    static uint16_t lastShown[FIELD_COUNT];
+
+    ScreenId screen = currentScreen();
+    // NEW: The charge screen is only checked for changes every few seconds
+    static unsigned long lastChecked = 0;
+    if (screen == SCREEN_CHARGING && screen == displayedScreen && !isDisplayFrameInFlight() &&
+        millis() - lastChecked < CHARGING_DISPLAY_REFRESH_MS) {
+        return;
+    }
+    lastChecked = millis();
+    ScreenDescriptor desc;
+    memcpy_P(&desc, &screens[screen], sizeof(desc));
+    bool screenChanged = screen != displayedScreen;
+
+    for (uint8_t i = 0; i < desc.fieldCount; i++) {
+        ScreenField f;
+        memcpy_P(&f, &desc.fields[i], sizeof(f));
+        uint16_t value = quantizedField(f.field);
+        if (!screenChanged && value != lastShown[f.field]) {
+            invalidateDisplayRegion(f.pages, f.firstTile, f.lastTile);
+        }
+        lastShown[f.field] = value;
+    }
+
+    if (screenChanged) {
+        displayedScreen = screen;
+        requestDisplayFrame();
+    }
+
+    // NEW: Push at most one page of the current frame per pass
+    serviceDisplay();
+}
+
+// Draw the displayed screen; called once per page with U8g2 clipping to that page
+void renderScreen() {
+    ScreenDescriptor desc;
+    memcpy_P(&desc, &screens[displayedScreen], sizeof(desc));
+    desc.draw();
+}
+
+void drawOffScreen() {
+    u8g2.setFont(u8g2_font_ncenB14_tr);
+    u8g2_uint_t textWidth = u8g2.getStrWidth("OFF");
+    u8g2.drawStr((128 - textWidth) / 2, 38, "OFF");
+}
+
+bool isDisplayFrameInFlight() {
+    return displayDirtyPages != 0 || twiBusy;
+}
+
+// Ask for a full redraw. Pages of a stale frame that were already sent are marked
+// again, so the new frame simply replaces the one in flight.
+void requestDisplayFrame() {
+    invalidateDisplayRegion(0xFF, 0, OLED_WIDTH / 8 - 1);
+}
+
+// Mark part of the glass for resending. Pending regions merge into one column window.
+void invalidateDisplayRegion(uint8_t pages, uint8_t firstTile, uint8_t lastTile) {
+#ifdef LAMP_BENCH
+    if (!isDisplayFrameInFlight()) benchFrameStart = benchCycles();
+#endif
+    uint8_t first = firstTile * 8;
+    uint8_t end = (lastTile + 1) * 8;
+    noInterrupts();
+    if (first < displayColumnFirst) displayColumnFirst = first;
+    if (end > displayColumnEnd) displayColumnEnd = end;
+    displayDirtyPages |= pages;
+    interrupts();
+}
+
+// Render the next dirty page and hand it to the TWI interrupt. Never waits on the bus.
+void serviceDisplay() {
+    static uint8_t nextPage = 0;
+    if (!displayReady || twiBusy || (TWCR & _BV(TWSTO))) return;
 
-        lastDisplayedBrightness = brightness;
-        lastDisplayedState = isLampOn;
-        lastUpdatedMode = currentMode;
-        lastHighlightedPreset = highlightedPreset;
-        lastBatteryPercent = batteryPercent;
-        // NEW: Update the last known temperature
-        lastTemperature = ledTemperature;
-        lastIsOverheatWarn = isOverheatWarn;
-        lastIsOverheatCritical = isOverheatCritical;
+    uint8_t dirty = displayDirtyPages;
+    if (dirty == 0) {
+        displayColumnFirst = OLED_WIDTH;
+        displayColumnEnd = 0;
+#ifdef LAMP_BENCH
+        if (benchFrameStart != 0) {
+            benchRecord(BENCH_FRAME, benchCycles() - benchFrameStart);
+            benchFrameStart = 0;
+        }
+#endif
+        onDisplayFrameSent();
+        return;
     }
+    // Continue downwards from the last page sent, wrapping around
+    while (!(dirty & _BV(nextPage))) nextPage = (nextPage + 1) % OLED_PAGES;
+    uint8_t page = nextPage;
+    nextPage = (nextPage + 1) % OLED_PAGES;
+
+    u8g2_SetBufferCurrTileRow(u8g2.getU8g2(), page);
+    u8g2.clearBuffer();
+    renderScreen();
+
+    // SSD1306 control bytes: three single commands (start column, page), then the
+    // columns of the page that are inside the dirty window
+    noInterrupts();
+    uint8_t first = displayColumnFirst;
+    uint8_t width = displayColumnEnd - first;
+    displayDirtyPages &= ~_BV(page);
+    interrupts();
+    twiBuffer[0] = 0x80; twiBuffer[1] = 0x10 | (first >> 4);
+    twiBuffer[2] = 0x80; twiBuffer[3] = 0x00 | (first & 0x0F);
+    twiBuffer[4] = 0x80; twiBuffer[5] = 0xB0 | page;
+    twiBuffer[6] = 0x40;
+    memcpy(twiBuffer + OLED_PAGE_HEADER, u8g2.getBufferPtr() + first, width);
+
+    noInterrupts();
+    twiPage = page;
+    twiIndex = 0;
+    twiLength = OLED_PAGE_HEADER + width;
+    twiBusy = true;
+    interrupts();
+    TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE) | _BV(TWSTA);
 }
 
 void drawSmoothDimScreen() {
@@ -542,9 +4070,23 @@ void drawSmoothDimScreen() {
     sprintf(buffer, "%d%%", brightness);
     textWidth = u8g2.getStrWidth(buffer);
     u8g2.drawStr((128 - textWidth) / 2, 45, buffer);
+
+    // NEW: The running light scene
+    if (isSceneActive()) {
+        char name[SCENE_NAME_SIZE];
+        sceneName(name, sceneIndex);
+        u8g2.setFont(u8g2_font_6x12_tr);
+        textWidth = u8g2.getStrWidth(name);
+        u8g2.drawStr((128 - textWidth) / 2, 62, name);
+    }
 }
 
 void drawPresetScreen() {
+    // NEW: Past the four presets, one light scene per entry
+    if (highlightedPreset >= 4) {
+        drawScenePage();
+        return;
+    }
     u8g2.setFont(u8g2_font_7x13B_tr);
     u8g2_uint_t textWidth = u8g2.getStrWidth("Select Preset");
     u8g2.drawStr((128 - textWidth) / 2, 12, "Select Preset");
@@ -555,7 +4097,11 @@ void drawPresetScreen() {
         sprintf(buffer, "%d%%", presets[i]);
         u8g2_uint_t textWidth = u8g2.getStrWidth(buffer);
         int xPos = 30 * i + 5;
-        if (i == highlightedPreset) {
+        if (i == highlightedPreset && isEditingPreset) {
+            // NEW: Outlined while the value is being edited
+            u8g2.drawFrame(xPos, 25, textWidth + 6, 15);
+            u8g2.drawStr(xPos + 3, 38, buffer);
+        } else if (i == highlightedPreset) {
             u8g2.drawBox(xPos, 25, textWidth + 6, 15);
             u8g2.setDrawColor(0);
             u8g2.drawStr(xPos + 3, 38, buffer);
@@ -566,9 +4112,60 @@ void drawPresetScreen() {
     }
 
     u8g2.setFont(u8g2_font_6x12_tr);
-    const char* helpText = "Long-Press to Select";
+    // NEW: Estimated runtime under each preset
+    for (int i = 0; i < 4; i++) {
+        char runtimeString[8];
+        formatRuntime(runtimeString, presetRuntimeMinutes[i]);
+        u8g2.drawStr(30 * i + 5, 50, runtimeString);
+    }
+
+    const char* helpText = isEditingPreset ? "Press to Save" : "Long-Press to Select";
     textWidth = u8g2.getStrWidth(helpText);
-    u8g2.drawStr((128 - textWidth) / 2, 58, helpText);
+    u8g2.drawStr((128 - textWidth) / 2, 62, helpText);
+}
+
+// NEW: Second page of the preset menu: the highlighted light scene
+void drawScenePage() {
+    u8g2.setFont(u8g2_font_7x13B_tr);
+    u8g2_uint_t textWidth = u8g2.getStrWidth("Select Scene");
+    u8g2.drawStr((128 - textWidth) / 2, 12, "Select Scene");
+    u8g2.drawHLine(0, 15, 128);
+
+    uint8_t index = highlightedPreset - 4;
+    char name[SCENE_NAME_SIZE];
+    sceneName(name, index);
+    u8g2.setFont(u8g2_font_ncenB14_tr);
+    textWidth = u8g2.getStrWidth(name);
+    u8g2.drawStr((128 - textWidth) / 2, 38, name);
+
+    u8g2.setFont(u8g2_font_6x12_tr);
+    char buffer[16];
+    sprintf(buffer, "Scene %u of %u", index + 1, SCENE_COUNT);
+    textWidth = u8g2.getStrWidth(buffer);
+    u8g2.drawStr((128 - textWidth) / 2, 50, buffer);
+    textWidth = u8g2.getStrWidth("Long-Press to Start");
+    u8g2.drawStr((128 - textWidth) / 2, 62, "Long-Press to Start");
+}
+
+// NEW: Colour temperature, with a warm-to-cool scale
+void drawColorTempScreen() {
+    u8g2.setFont(u8g2_font_7x13B_tr);
+    u8g2_uint_t textWidth = u8g2.getStrWidth("Color Temp");
+    u8g2.drawStr((128 - textWidth) / 2, 12, "Color Temp");
+    u8g2.drawHLine(0, 15, 128);
+
+    u8g2.setFont(u8g2_font_ncenB14_tr);
+    char buffer[8];
+    sprintf(buffer, "%uK", colorTempKelvin());
+    textWidth = u8g2.getStrWidth(buffer);
+    u8g2.drawStr((128 - textWidth) / 2, 36, buffer);
+    u8g2.drawFrame(14, 41, 100, 8);
+    // MODIFIED: Placed by colour temperature, as the table may hold a single step
+    u8g2.drawBox(16 + (colorTempKelvin() - CCT_WARM_KELVIN) * 92UL / (CCT_COOL_KELVIN - CCT_WARM_KELVIN), 43, 4, 4);
+
+    u8g2.setFont(u8g2_font_6x12_tr);
+    u8g2.drawStr(14, 62, "Warm");
+    u8g2.drawStr(114 - u8g2.getStrWidth("Cool"), 62, "Cool");
 }
 
 void drawStatsScreen() {
@@ -577,67 +4174,116 @@ void drawStatsScreen() {
     u8g2.drawStr((128 - textWidth) / 2, 12, "System Stats");
     u8g2.drawHLine(0, 15, 128);
 
-    char voltageString[6];
-    dtostrf(batteryVoltage, 4, 2, voltageString);
-    char buffer[20];
-    sprintf(buffer, "Batt: %d%% (%sV)", batteryPercent, voltageString);
-    u8g2.drawStr(0, 35, buffer);
+    // MODIFIED: Smaller font so four stat lines fit
+    u8g2.setFont(u8g2_font_6x12_tr);
+    char voltageString[MILLIVOLTS_TEXT_SIZE];
+    formatMillivolts(voltageString, batteryMillivolts);
+    // MODIFIED: Remaining runtime at the current setting follows the voltage
+    char runtimeString[RUNTIME_TEXT_SIZE];
+    formatRuntime(runtimeString, runtimeMinutes);
+    // Up to "Ovr 65535/65535/65535/65535" (the battery line is at most 23 characters)
+    char buffer[28];
+    snprintf(buffer, sizeof(buffer), "Batt %u%% %sV %s", (uint8_t)batteryPercent, voltageString, runtimeString);
+    u8g2.drawStr(0, 27, buffer);
 
     // NEW: Display the live temperature
-    char tempString[6];
-    dtostrf(ledTemperature, 4, 1, tempString);
-    sprintf(buffer, "Temp: %s C", tempString);
-    u8g2.drawStr(0, 55, buffer);
+    char tempString[8];
+    formatCentiC(tempString, ledTemperature);
+    snprintf(buffer, sizeof(buffer), "Temp %sC", tempString);
+    u8g2.drawStr(0, 38, buffer);
+    // NEW: Time to first light, right-aligned on the same line (frame time: diagnostics)
+    char lightString[BOOT_MS_TEXT_SIZE];
+    formatBootMs(lightString, bootFirstLightUs);
+    snprintf(buffer, sizeof(buffer), "Lit %s", lightString);
+    u8g2.drawStr(128 - u8g2.getStrWidth(buffer), 38, buffer);
+
+    // NEW: Share of time awake and the MCU current saved by sleeping
+    sprintf(buffer, "Awake %u%% -%u.%umA", awakePercent, savedMicroamps / 1000, (savedMicroamps / 100) % 10);
+    u8g2.drawStr(0, 49, buffer);
+
+    // NEW: Scheduler overrun counters (inputs/battery/temperature/display)
+    snprintf(buffer, sizeof(buffer), "Ovr %u/%u/%u/%u", tasks[TASK_INPUTS].overruns, tasks[TASK_BATTERY].overruns,
+            tasks[TASK_TEMPERATURE].overruns, tasks[TASK_DISPLAY].overruns);
+    u8g2.drawStr(0, 60, buffer);
+}
+
+// NEW: Hidden page: RAM budget and the DS18B20 driver's interrupt-off time
+void drawDiagnosticsScreen() {
+    u8g2.setFont(u8g2_font_7x13B_tr);
+    u8g2_uint_t textWidth = u8g2.getStrWidth("Diagnostics");
+    u8g2.drawStr((128 - textWidth) / 2, 12, "Diagnostics");
+    u8g2.drawHLine(0, 15, 128);
+
+    u8g2.setFont(u8g2_font_6x12_tr);
+    // "RAM 65535+65535 free 65535" at most
+    char buffer[27];
+    // MODIFIED: Static + peak stack, and what is left of the 2 KB
+    snprintf(buffer, sizeof(buffer), "RAM %u+%u free %u", staticRamBytes(), stackPeak,
+             SRAM_BYTES - staticRamBytes() - stackPeak);
+    u8g2.drawStr(0, 27, buffer);
+    // NEW: Boot timings from sketch start (the bootloader runs before that)
+    char lightString[BOOT_MS_TEXT_SIZE];
+    formatBootMs(lightString, bootFirstLightUs);
+    snprintf(buffer, sizeof(buffer), "Light %s OLED %ums", lightString, (uint16_t)(bootFirstFrameUs / 1000));
+    u8g2.drawStr(0, 38, buffer);
+    snprintf(buffer, sizeof(buffer), "1W irq %uus max %u", tempBusIrqOffUs, tempBusSlotMaxUs);
+    u8g2.drawStr(0, 49, buffer);
+}
+
+// NEW: Charge progress: percentage, bar, time to full and the pack voltage
+void drawChargingScreen() {
+    u8g2.setFont(u8g2_font_7x13B_tr);
+    u8g2_uint_t textWidth = u8g2.getStrWidth("Charging");
+    u8g2.drawStr((128 - textWidth) / 2, 12, "Charging");
+    u8g2.drawHLine(0, 15, 128);
+
+    u8g2.setFont(u8g2_font_ncenB14_tr);
+    char buffer[24];
+    sprintf(buffer, "%d%%", batteryPercent);
+    textWidth = u8g2.getStrWidth(buffer);
+    u8g2.drawStr((128 - textWidth) / 2, 36, buffer);
+    u8g2.drawFrame(14, 41, 100, 8);
+    u8g2.drawBox(16, 43, batteryPercent * 96 / 100, 4);
+
+    u8g2.setFont(u8g2_font_6x12_tr);
+    char voltageString[MILLIVOLTS_TEXT_SIZE];
+    formatMillivolts(voltageString, batteryMillivolts);
+    // "Full in 1092h  655.35V" at most
+    if (chargeEtaMinutes == CHARGE_ETA_UNKNOWN) {
+        snprintf(buffer, sizeof(buffer), "Full in --  %sV", voltageString);
+    } else {
+        char etaString[RUNTIME_TEXT_SIZE];
+        formatRuntime(etaString, chargeEtaMinutes);
+        snprintf(buffer, sizeof(buffer), "Full in %s  %sV", etaString, voltageString);
+    }
+    textWidth = u8g2.getStrWidth(buffer);
+    u8g2.drawStr((128 - textWidth) / 2, 62, buffer);
 }
 
 // Helper function to draw the low battery warning screen
 void drawLowBatteryScreen() {
-    u8g2.firstPage();
-    do {
-        u8g2.setFont(u8g2_font_7x13B_tr);
-        u8g2_uint_t textWidth = u8g2.getStrWidth("LOW BATTERY");
-        u8g2.drawStr((128 - textWidth) / 2, 25, "LOW BATTERY");
-        textWidth = u8g2.getStrWidth("Please Charge");
-        u8g2.drawStr((128 - textWidth) / 2, 45, "Please Charge");
-    } while (u8g2.nextPage());
-}
-
-long readVcc() {
-  // Selects the 1.1V internal reference as the ADC input.
-  // The ADC reference is still the default VCC.
-  ADMUX = _BV(REFS0) | _BV(MUX3) | _BV(MUX2) | _BV(MUX1);
-  delay(2); // Wait for Vref to settle
-  ADCSRA |= _BV(ADSC); // Start conversion
-  while (bit_is_set(ADCSRA, ADSC)); // Wait for conversion to complete
-  long result = ADC;
-  // Calculate Vcc in millivolts
-  // 1.1V * 1023 ADC steps = 1125.3. We use 1125300L for integer math.
-  result = (1125300L / result);
-  return result; // Vcc in millivolts
+    u8g2.setFont(u8g2_font_7x13B_tr);
+    u8g2_uint_t textWidth = u8g2.getStrWidth("LOW BATTERY");
+    u8g2.drawStr((128 - textWidth) / 2, 25, "LOW BATTERY");
+    textWidth = u8g2.getStrWidth("Please Charge");
+    u8g2.drawStr((128 - textWidth) / 2, 45, "Please Charge");
 }
 
 //MODIFIED: This function is now fully non-blocking.
+// MODIFIED: Starts the next sensor sequence; serviceTemperatureSensor() runs it and
+// publishes the reading
 void updateTemperature() {
-    static unsigned long lastTempRequestTime = 0;
-    static bool conversionStarted = false;
-
-    // This runs in a two-step, non-blocking way.
-    // On the first pass, it requests the temperature.
-    // On the second pass (after the conversion time), it reads it.
-    if (!conversionStarted) {
-        sensors.requestTemperatures(); // Send the (non-blocking) command
-        conversionStarted = true;
-        lastTempRequestTime = millis();
-    }
-    
-    // The sensor needs ~750ms to convert. We check after that time has passed.
-    if (conversionStarted && millis() - lastTempRequestTime > 800) {
-        float tempC = sensors.getTempCByIndex(0);
-
-        if (tempC != DEVICE_DISCONNECTED_C) {
-            ledTemperature = tempC;
-        }
-        conversionStarted = false;
+#ifdef LAMP_BENCH
+    if (benchTempOverrideCentiC != INT16_MIN) {
+        ledTemperature = benchTempOverrideCentiC;
+        ledTemperatureFresh = true;
+        return;
     }
+#endif
+    if (tempPhase != TEMP_IDLE) return; // previous sequence still running
+    tempWantedBits = chooseTemperatureResolution();
+    if (!ledSensorFound) tempPhase = TEMP_READ_ROM;
+    else if (tempWantedBits != tempResolutionBits) tempPhase = TEMP_CONFIGURE;
+    else tempPhase = TEMP_CONVERT;
 }
 
@@ -0,0 +1,81 @@
+// Host stand-in for the Arduino AVR core: the part of it the firmware uses, on
+// top of the simulated registers. millis()/micros() read timer0, which the
+// simulator advances while the MCU is awake, like wiring.c.
+#pragma once
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define A0 14
+#define A1 15
+#define SDA 18
+#define SCL 19
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define digitalPinToPCMSKbit(p) (((p) <= 7) ? (p) : (((p) <= 13) ? ((p) - 8) : ((p) - 14)))
+#define noInterrupts() cli()
+#define interrupts() sei()
+#define __builtin_avr_delay_cycles(cycles) halDelayCycles(cycles)
+
+inline volatile unsigned long timer0_millis = 0;
+// The end of .bss, at a fixed place in the simulated SRAM (1152 static bytes)
+// rather than wherever the host linker put a variable
+extern uint8_t __heap_start asm("halSram+0x580");
+
+unsigned long micros();
+void halDelayCycles(unsigned long cycles);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+inline unsigned long millis() { return timer0_millis; }
+inline void delayMicroseconds(unsigned int us) { halDelayCycles(us * (F_CPU / 1000000UL)); }
+
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper*)(s))
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t value) = 0;
+  size_t print(const char* text) {
+    size_t n = 0;
+    while (*text) n += write(*text++);
+    return n;
+  }
+  size_t print(const __FlashStringHelper* text) { return print((const char*)text); }
+  size_t print(char value) { return write(value); }
+  size_t print(long value) { return printNumber(value); }
+  size_t print(unsigned long value) { return printNumber(value); }
+  size_t print(int value) { return printNumber(value); }
+  size_t print(unsigned int value) { return printNumber(value); }
+  template <typename T>
+  size_t println(T value) { return print(value) + print("\r\n"); }
+  size_t println() { return print("\r\n"); }
+
+ private:
+  template <typename T>
+  size_t printNumber(T value) {
+    char text[24];
+    snprintf(text, sizeof(text), value < 0 ? "%lld" : "%llu", value < 0 ? (long long)value : (unsigned long long)value);
+    return print(text);
+  }
+};
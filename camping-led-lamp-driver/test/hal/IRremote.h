@@ -0,0 +1,42 @@
+// Host stand-in for IRremote 4.x: the receiver API the firmware uses. The
+// simulator delivers decoded frames through the registered callback, like the
+// library's Timer2 interrupt does.
+#pragma once
+#include <stdint.h>
+
+enum decode_type_t : uint8_t { UNKNOWN = 0, NEC = 8 };
+
+#define IRDATA_FLAGS_IS_REPEAT 0x01
+#define DISABLE_LED_FEEDBACK false
+#define ENABLE_LED_FEEDBACK true
+
+struct IRData {
+  decode_type_t protocol;
+  uint16_t address;
+  uint16_t command;
+  uint8_t flags;
+};
+
+class IRrecv {
+ public:
+  IRData decodedIRData = {};
+  bool started = false;
+  bool frameReady = false;
+  bool receiving = false;  // between the leader mark and the end of the frame
+  bool inTimerInterrupt = false;  // the simulator is running the callback
+  uint32_t decodes = 0;
+  uint32_t decodesInInterrupt = 0;
+  void (*receiveComplete)() = nullptr;
+
+  void begin(uint8_t, bool) { started = true; }
+  void registerReceiveCompleteCallback(void (*callback)()) { receiveComplete = callback; }
+  bool decode() {
+    decodes++;
+    if (inTimerInterrupt) decodesInInterrupt++;
+    return frameReady;
+  }
+  void resume() { frameReady = false; }
+  bool isIdle() { return !receiving; }
+};
+
+inline IRrecv IrReceiver;
@@ -0,0 +1,172 @@
+// Host stand-in for U8g2 in page-buffer mode on an SSD1306 128x64. Drawing
+// rasterizes into the 128-byte page buffer with a built-in 5x7 font (the three
+// fonts the firmware uses differ in advance, weight and scale only). Display
+// commands go out through the firmware's byte callback, so they cross the
+// simulated TWI bus like U8g2's own command traffic.
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t u8g2_uint_t;
+
+#define U8X8_MSG_BYTE_SEND 23
+#define U8X8_MSG_BYTE_START_TRANSFER 24
+#define U8X8_MSG_BYTE_END_TRANSFER 25
+#define U8X8_MSG_BYTE_SET_DC 32
+#define U8X8_MSG_BYTE_INIT 40
+
+struct u8x8_struct;
+typedef struct u8x8_struct u8x8_t;
+typedef uint8_t (*u8x8_msg_cb)(u8x8_t* u8x8, uint8_t msg, uint8_t arg_int, void* arg_ptr);
+struct u8x8_struct {
+  u8x8_msg_cb byteCb;
+  u8x8_msg_cb gpioAndDelayCb;
+  uint8_t i2cAddress;
+};
+
+struct u8g2_cb_t {
+  uint8_t rotation;
+};
+inline const u8g2_cb_t u8g2_cb_r0 = {0};
+#define U8G2_R0 (&u8g2_cb_r0)
+
+struct u8g2_struct {
+  u8x8_t u8x8;
+  uint8_t tileRow;
+  uint8_t buffer[128];
+};
+typedef struct u8g2_struct u8g2_t;
+
+inline uint8_t u8x8_GetI2CAddress(u8x8_t* u8x8) { return u8x8->i2cAddress; }
+inline uint8_t u8x8_gpio_and_delay_arduino(u8x8_t*, uint8_t, uint8_t, void*) { return 1; }
+inline void u8g2_Setup_ssd1306_i2c_128x64_noname_1(u8g2_t* u8g2, const u8g2_cb_t*, u8x8_msg_cb byteCb,
+                                                   u8x8_msg_cb gpioAndDelayCb) {
+  u8g2->u8x8.byteCb = byteCb;
+  u8g2->u8x8.gpioAndDelayCb = gpioAndDelayCb;
+  u8g2->u8x8.i2cAddress = 0x78;
+}
+inline void u8g2_SetBufferCurrTileRow(u8g2_t* u8g2, uint8_t row) { u8g2->tileRow = row; }
+
+// Font descriptors: advance, horizontal/vertical scale, bold
+inline const uint8_t u8g2_font_6x12_tr[] = {6, 1, 0};
+inline const uint8_t u8g2_font_7x13B_tr[] = {7, 1, 1};
+inline const uint8_t u8g2_font_ncenB14_tr[] = {11, 2, 0};
+
+// Classic 5x7 glyphs for ' '..'~', one byte per column, bit 0 at the top, bit 7 descender
+inline const uint8_t halFont5x7[95][5] = {
+  {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00},
+  {0x14, 0x7F, 0x14, 0x7F, 0x14}, {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},
+  {0x36, 0x49, 0x56, 0x20, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00}, {0x00, 0x1C, 0x22, 0x41, 0x00},
+  {0x00, 0x41, 0x22, 0x1C, 0x00}, {0x2A, 0x1C, 0x7F, 0x1C, 0x2A}, {0x08, 0x08, 0x3E, 0x08, 0x08},
+  {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x60, 0x60, 0x00, 0x00},
+  {0x20, 0x10, 0x08, 0x04, 0x02}, {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00},
+  {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31}, {0x18, 0x14, 0x12, 0x7F, 0x10},
+  {0x27, 0x45, 0x45, 0x45, 0x39}, {0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},
+  {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E}, {0x00, 0x36, 0x36, 0x00, 0x00},
+  {0x00, 0x56, 0x36, 0x00, 0x00}, {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14},
+  {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06}, {0x32, 0x49, 0x79, 0x41, 0x3E},
+  {0x7E, 0x11, 0x11, 0x11, 0x7E}, {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22},
+  {0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41}, {0x7F, 0x09, 0x09, 0x09, 0x01},
+  {0x3E, 0x41, 0x49, 0x49, 0x7A}, {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00},
+  {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41}, {0x7F, 0x40, 0x40, 0x40, 0x40},
+  {0x7F, 0x02, 0x0C, 0x02, 0x7F}, {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E},
+  {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E}, {0x7F, 0x09, 0x19, 0x29, 0x46},
+  {0x46, 0x49, 0x49, 0x49, 0x31}, {0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F},
+  {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x3F, 0x40, 0x38, 0x40, 0x3F}, {0x63, 0x14, 0x08, 0x14, 0x63},
+  {0x07, 0x08, 0x70, 0x08, 0x07}, {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x00},
+  {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7F, 0x00}, {0x04, 0x02, 0x01, 0x02, 0x04},
+  {0x40, 0x40, 0x40, 0x40, 0x40}, {0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78},
+  {0x7F, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20}, {0x38, 0x44, 0x44, 0x48, 0x7F},
+  {0x38, 0x54, 0x54, 0x54, 0x18}, {0x08, 0x7E, 0x09, 0x01, 0x02}, {0x18, 0xA4, 0xA4, 0xA4, 0x7C},
+  {0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00}, {0x40, 0x80, 0x84, 0x7D, 0x00},
+  {0x7F, 0x10, 0x28, 0x44, 0x00}, {0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x18, 0x04, 0x78},
+  {0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38}, {0xFC, 0x24, 0x24, 0x24, 0x18},
+  {0x18, 0x24, 0x24, 0x18, 0xFC}, {0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20},
+  {0x04, 0x3F, 0x44, 0x40, 0x20}, {0x3C, 0x40, 0x40, 0x20, 0x7C}, {0x1C, 0x20, 0x40, 0x20, 0x1C},
+  {0x3C, 0x40, 0x30, 0x40, 0x3C}, {0x44, 0x28, 0x10, 0x28, 0x44}, {0x1C, 0xA0, 0xA0, 0xA0, 0x7C},
+  {0x44, 0x64, 0x54, 0x4C, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00}, {0x00, 0x00, 0x7F, 0x00, 0x00},
+  {0x00, 0x41, 0x36, 0x08, 0x00}, {0x08, 0x04, 0x08, 0x10, 0x08},
+};
+
+// Completes any interrupt-driven TWI transfer before U8g2 uses the bus (lamp_sim.h)
+void halTwiDrain();
+
+class U8G2 {
+ protected:
+  u8g2_t u8g2 = {};
+  const uint8_t* font = u8g2_font_6x12_tr;
+  uint8_t drawColor = 1;
+
+  void sendCommands(const uint8_t* bytes, uint8_t length) {
+    halTwiDrain();
+    u8g2.u8x8.byteCb(&u8g2.u8x8, U8X8_MSG_BYTE_START_TRANSFER, 0, nullptr);
+    u8g2.u8x8.byteCb(&u8g2.u8x8, U8X8_MSG_BYTE_SEND, length, (void*)bytes);
+    u8g2.u8x8.byteCb(&u8g2.u8x8, U8X8_MSG_BYTE_END_TRANSFER, 0, nullptr);
+  }
+
+ public:
+  u8g2_t* getU8g2() { return &u8g2; }
+  uint8_t* getBufferPtr() { return u8g2.buffer; }
+
+  // Display off, page addressing, U8g2's contrast, charge pump on
+  void initDisplay() {
+    u8g2.u8x8.byteCb(&u8g2.u8x8, U8X8_MSG_BYTE_INIT, 0, nullptr);
+    const uint8_t init[] = {0x00, 0xAE, 0x20, 0x02, 0x81, 0xCF, 0x8D, 0x14};
+    sendCommands(init, sizeof(init));
+  }
+  void setPowerSave(uint8_t on) {
+    const uint8_t command[] = {0x00, (uint8_t)(on ? 0xAE : 0xAF)};
+    sendCommands(command, sizeof(command));
+  }
+  void setContrast(uint8_t value) {
+    const uint8_t command[] = {0x00, 0x81, value};
+    sendCommands(command, sizeof(command));
+  }
+
+  void clearBuffer() { memset(u8g2.buffer, 0, sizeof(u8g2.buffer)); }
+  void setFont(const uint8_t* f) { font = f; }
+  void setDrawColor(uint8_t color) { drawColor = color; }
+
+  void drawPixel(int x, int y) {
+    if (x < 0 || x >= 128 || y < 0 || (y >> 3) != u8g2.tileRow) return;
+    uint8_t bit = 1 << (y & 7);
+    if (drawColor == 0) u8g2.buffer[x] &= ~bit;
+    else if (drawColor == 2) u8g2.buffer[x] ^= bit;
+    else u8g2.buffer[x] |= bit;
+  }
+  void drawHLine(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w) {
+    for (int i = 0; i < w; i++) drawPixel(x + i, y);
+  }
+  void drawBox(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h) {
+    for (int j = 0; j < h; j++) drawHLine(x, y + j, w);
+  }
+  void drawFrame(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h) {
+    if (w == 0 || h == 0) return;
+    drawHLine(x, y, w);
+    drawHLine(x, y + h - 1, w);
+    for (int j = 1; j < h - 1; j++) {
+      drawPixel(x, y + j);
+      drawPixel(x + w - 1, y + j);
+    }
+  }
+
+  u8g2_uint_t getStrWidth(const char* s) { return strlen(s) * font[0]; }
+  // y is the baseline; glyph row 6 sits on it
+  u8g2_uint_t drawStr(u8g2_uint_t x, u8g2_uint_t y, const char* s) {
+    uint8_t scale = font[1];
+    int cx = x;
+    for (; *s; s++, cx += font[0]) {
+      uint8_t c = (*s < ' ' || *s > '~') ? '?' : *s;
+      for (int col = 0; col < 5; col++) {
+        uint8_t bits = halFont5x7[c - ' '][col];
+        for (int row = 0; row < 8; row++) {
+          if (!(bits & (1 << row))) continue;
+          for (int dx = 0; dx < scale + font[2]; dx++)
+            for (int dy = 0; dy < scale; dy++)
+              drawPixel(cx + col * scale + dx, y - (7 * scale - 1) + row * scale + dy);
+        }
+      }
+    }
+    return cx - x;
+  }
+};
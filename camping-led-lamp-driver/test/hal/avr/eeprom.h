@@ -0,0 +1,33 @@
+// Host stand-in for <avr/eeprom.h>: 1 KiB of erased EEPROM, written at once.
+#pragma once
+#include <avr/io.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+inline uint8_t halEeprom[E2END + 1];
+inline uint32_t halEepromWrites = 0;
+
+inline uint8_t eeprom_read_byte(const uint8_t* address) {
+  return halEeprom[(uintptr_t)address & E2END];
+}
+
+inline void eeprom_update_byte(uint8_t* address, uint8_t value) {
+  uint8_t& cell = halEeprom[(uintptr_t)address & E2END];
+  if (cell == value) return;
+  cell = value;
+  halEepromWrites++;
+}
+
+inline void eeprom_write_byte(uint8_t* address, uint8_t value) {
+  halEeprom[(uintptr_t)address & E2END] = value;
+  halEepromWrites++;
+}
+
+inline void eeprom_read_block(void* destination, const void* source, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    ((uint8_t*)destination)[i] = eeprom_read_byte((const uint8_t*)source + i);
+  }
+}
+
+inline bool eeprom_is_ready() { return true; }
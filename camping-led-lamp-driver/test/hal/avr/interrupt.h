@@ -0,0 +1,24 @@
+// Host stand-in for <avr/interrupt.h>. Vectors become plain functions that the
+// simulator calls when the interrupt would fire; it never preempts the loop, so
+// cli()/sei() have nothing to do.
+#pragma once
+
+#define ISR(vector) extern "C" void vector(void)
+#define cli() ((void)0)
+#define sei() ((void)0)
+
+#define TWI_vect halTwiVector
+#define PCINT2_vect halPcint2Vector
+#define USART_RX_vect halUsartRxVector
+#define USART_UDRE_vect halUsartUdreVector
+#define TIMER1_OVF_vect halTimer1OvfVector
+#define ADC_vect halAdcVector
+#define WDT_vect halWdtVector
+
+ISR(TWI_vect);
+ISR(PCINT2_vect);
+ISR(USART_RX_vect);
+ISR(USART_UDRE_vect);
+ISR(TIMER1_OVF_vect);
+ISR(ADC_vect);
+ISR(WDT_vect);
@@ -0,0 +1,122 @@
+// Host stand-in for <avr/io.h>: the ATmega328P registers the firmware touches.
+// Most are plain bytes. The ones with side effects on real silicon (TWCR starts
+// bus actions, UDR0 sends and receives, DDRB/PINB are the 1-Wire line, TCNT1
+// follows the simulated clock) call into the simulator in lamp_sim.h.
+#pragma once
+#include <stdint.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define _BV(bit) (1 << (bit))
+
+// The 328P's data space. The firmware's variables are host globals, so this only
+// backs the SRAM above .bss that the stack instrumentation paints and scans.
+// RAMSTART and RAMEND are addresses in it, the way the firmware casts them.
+inline uint8_t halSram[0x900];
+#define RAMSTART ((uintptr_t)halSram + 0x100)
+#define RAMEND ((uintptr_t)halSram + 0x8FF)
+#define E2END 0x3FF
+
+enum HalRegister : uint8_t { HAL_TWCR, HAL_DDRB, HAL_PINB, HAL_UDR0 };
+uint8_t halRead8(HalRegister reg);
+void halWrite8(HalRegister reg, uint8_t value);
+inline uint16_t halReadTcnt1();
+
+template <HalRegister R>
+struct HalRegister8 {
+  operator uint8_t() const { return halRead8(R); }
+  HalRegister8& operator=(uint8_t value) { halWrite8(R, value); return *this; }
+  HalRegister8& operator|=(uint8_t value) { halWrite8(R, halRead8(R) | value); return *this; }
+  HalRegister8& operator&=(uint8_t value) { halWrite8(R, halRead8(R) & value); return *this; }
+};
+
+struct HalTimer1Counter {
+  operator uint16_t() const { return halReadTcnt1(); }
+};
+
+inline HalRegister8<HAL_TWCR> TWCR;
+inline HalRegister8<HAL_DDRB> DDRB;
+inline HalRegister8<HAL_PINB> PINB;
+inline HalRegister8<HAL_UDR0> UDR0;
+inline HalTimer1Counter TCNT1;
+
+inline volatile uint8_t SREG, MCUSR, WDTCSR, PORTB, PIND;
+inline volatile uint8_t TWSR, TWBR, TWDR;
+inline volatile uint8_t UCSR0A, UCSR0B, UCSR0C;
+inline volatile uint16_t UBRR0;
+inline volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+inline volatile uint16_t OCR1A, OCR1B, ICR1;
+inline volatile uint8_t ADMUX, ADCSRA, ADCSRB, DIDR0;
+inline volatile uint16_t ADC;
+inline volatile uint8_t PCICR, PCIFR, PCMSK2;
+inline uint16_t SP;
+
+// TWCR
+#define TWINT 7
+#define TWEA 6
+#define TWSTA 5
+#define TWSTO 4
+#define TWWC 3
+#define TWEN 2
+#define TWIE 0
+// UCSR0A/B/C
+#define RXC0 7
+#define UDRE0 5
+#define FE0 4
+#define U2X0 1
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0 4
+#define TXEN0 3
+#define UCSZ01 2
+#define UCSZ00 1
+// Timer1
+#define COM1A1 7
+#define COM1A0 6
+#define COM1B1 5
+#define COM1B0 4
+#define WGM11 1
+#define WGM10 0
+#define WGM13 4
+#define WGM12 3
+#define CS12 2
+#define CS11 1
+#define CS10 0
+#define TOIE1 0
+#define TOV1 0
+// ADC
+#define REFS1 7
+#define REFS0 6
+#define ADLAR 5
+#define MUX3 3
+#define MUX2 2
+#define MUX1 1
+#define MUX0 0
+#define ADEN 7
+#define ADSC 6
+#define ADATE 5
+#define ADIF 4
+#define ADIE 3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+#define ADTS2 2
+#define ADTS1 1
+#define ADTS0 0
+#define ADC1D 1
+// Pin change interrupts
+#define PCIE2 2
+#define PCIF2 2
+// Watchdog
+#define WDRF 3
+#define WDIF 7
+#define WDIE 6
+#define WDP3 5
+#define WDCE 4
+#define WDE 3
+#define WDP2 2
+#define WDP1 1
+#define WDP0 0
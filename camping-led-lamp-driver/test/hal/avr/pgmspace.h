@@ -0,0 +1,21 @@
+// Host stand-in for <avr/pgmspace.h>: flash and RAM share one address space.
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+// Called with the address of every pgm_read_byte(), when set (tests that trace
+// what the firmware reads from flash)
+inline void (*pgmReadHook)(const void* address) = nullptr;
+
+inline uint8_t pgmReadByte(const void* address) {
+  if (pgmReadHook) pgmReadHook(address);
+  return *(const uint8_t*)address;
+}
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(address) pgmReadByte(address)
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+#define memcpy_P memcpy
+#define strcpy_P strcpy
+#define strlen_P strlen
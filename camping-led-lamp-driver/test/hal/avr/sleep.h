@@ -0,0 +1,20 @@
+// Host stand-in for <avr/sleep.h>. sleep_cpu() hands the simulated time over to
+// the simulator until an interrupt wakes the MCU.
+#pragma once
+#include <stdint.h>
+
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_ADC 1
+#define SLEEP_MODE_PWR_DOWN 2
+#define SLEEP_MODE_PWR_SAVE 3
+#define SLEEP_MODE_STANDBY 6
+
+inline uint8_t halSleepMode = SLEEP_MODE_IDLE;
+inline bool halSleepEnabled = false;
+void halSleepCpu();
+
+inline void set_sleep_mode(uint8_t mode) { halSleepMode = mode; }
+inline void sleep_enable() { halSleepEnabled = true; }
+inline void sleep_disable() { halSleepEnabled = false; }
+inline void sleep_bod_disable() {}
+inline void sleep_cpu() { if (halSleepEnabled) halSleepCpu(); }
@@ -0,0 +1,918 @@
+// Host simulator for the lamp firmware. Includes src/main.cpp as is, on top of the
+// stub HAL in this directory, and runs setup()/loop() against:
+// - a cycle clock (16 MHz) with Timer1 overflows every 1024 cycles, the ADC
+//   auto-triggered by them, timer0 millis()/micros() that stop in power-down
+//   and standby, and the oscillator start-up time of a wake from power-down;
+// - the TWI bus with an SSD1306 behind it (GDDRAM, on/off, contrast);
+// - the UART at the configured baud rate in both directions;
+// - a DS18B20 on the 1-Wire pin, decoding the slots from the line timing;
+// - the encoder, button and IR receiver inputs;
+// - plant models for a 2S pack (with an optional CC/CV charger) and the LED
+//   heatsink, which the ADC and the DS18B20 read.
+// Interrupts run between loop() passes and while the firmware sleeps. When nothing
+// is in flight and no task is due, idle sleep jumps ahead in one step and replays
+// only the ADC rounds the filters need to catch up; a 1-Wire transaction with the
+// loop otherwise idle runs its interrupts back to back. Hours of operation run in
+// a fraction of a second. One firmware instance per test binary.
+#pragma once
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../../src/main.cpp"
+
+// The Arduino core's macros would break std::min/std::max from here on
+#undef min
+#undef max
+
+namespace sim {
+
+const uint64_t CYCLES_PER_US = F_CPU / 1000000UL;
+const uint64_t CYCLES_PER_MS = F_CPU / 1000UL;
+const uint64_t TIMER1_PERIOD = PWM_TOP + 1;
+const uint64_t NEVER = UINT64_MAX;
+const uint64_t PASS_CYCLES = 100 * CYCLES_PER_US;     // one loop() pass
+const uint64_t ADC_SAMPLE_CYCLES = 2 * 128;           // S/H 2 ADC clocks after the trigger
+const uint64_t ADC_CONVERSION_CYCLES = 27 * 128 / 2;  // 13.5 ADC clocks
+const uint64_t MIN_JUMP_CYCLES = 64 * TIMER1_PERIOD;  // shorter idle stretches run in full
+const uint64_t SETTLE_CYCLES = 4 * TIMER1_PERIOD;     // simulated in full before a jump ends
+const int SETTLE_ROUNDS_MAX = 32;                     // ADC rounds replayed after a jump
+const double ADC_VCC_MV = 5000;
+const double BATTERY_DIVIDER = 7.8;
+
+struct Halted {};  // power-down with nothing left that could wake the MCU
+
+// --- Clock ---
+uint64_t now = 0;                  // wall clock, CPU cycles since power-on
+uint64_t timer1Next = TIMER1_PERIOD;
+uint64_t timer0Residue = 0;        // awake cycles not yet counted into millis()
+uint64_t microsCycles = 0;
+uint64_t deadline = NEVER;
+bool halted = false;
+uint32_t irqJitterCycles = 64;     // overflow ISR entry delay: other ISRs, atomic sections
+uint32_t noiseSeed = 12345;
+
+uint32_t nextRandom() {
+  noiseSeed = noiseSeed * 1103515245u + 12345u;
+  return noiseSeed >> 8;
+}
+
+double seconds() { return (double)now / F_CPU; }
+
+// --- Plants ---
+struct BatteryPlant {
+  double capacityMah = 2600;
+  double chargeMah = 2600;
+  double resistanceOhm = 0.15;
+  double adcGain = 1.0;          // divider and bandgap tolerance
+  bool chargerPlugged = false;
+  bool chargerDone = false;
+  double chargerCcMa = 1000;
+  double chargerCvMv = 8400;
+  double chargerEndMa = 100;
+  // Open-circuit voltage at 0, 10, ... 100 %
+  double ocvCurve[11] = {6420, 6880, 7080, 7220, 7330, 7440, 7560, 7700, 7870, 8070, 8385};
+
+  double percent() const { return 100 * chargeMah / capacityMah; }
+  double ocvMv() const {
+    double p = percent();
+    if (p <= 0) return ocvCurve[0] + p * 80;  // steep knee below empty
+    if (p >= 100) return ocvCurve[10];
+    int i = (int)(p / 10);
+    return ocvCurve[i] + (ocvCurve[i + 1] - ocvCurve[i]) * (p - i * 10) / 10;
+  }
+  double chargerMa(double loadMa) const {
+    if (!chargerPlugged || chargerDone) return 0;
+    double cv = loadMa + (chargerCvMv - ocvMv()) * 1000 / (resistanceOhm * 1000);
+    return std::max(0.0, std::min(chargerCcMa, cv));
+  }
+  double terminalMv(double loadMa) const {
+    return ocvMv() - (loadMa - chargerMa(loadMa)) * resistanceOhm;
+  }
+  void step(double hours, double loadMa) {
+    double inMa = chargerMa(loadMa);
+    if (chargerPlugged && !chargerDone && inMa < chargerCcMa && inMa - loadMa < chargerEndMa) chargerDone = true;
+    chargeMah = std::min(capacityMah, chargeMah + (inMa - loadMa) * hours);
+  }
+};
+
+struct HeatsinkPlant {
+  double ambientC = 25;
+  double tempC = 25;
+  double riseAtFullC = 60;  // steady rise with one channel at 100 % duty
+  double tauSeconds = 120;
+  void step(double dtSeconds, double power) {
+    double settled = ambientC + riseAtFullC * power;
+    tempC += (settled - tempC) * (1 - std::exp(-dtSeconds / tauSeconds));
+  }
+};
+
+BatteryPlant battery;
+HeatsinkPlant heatsink;
+uint64_t plantUpdatedAt = 0;
+double systemCurrentMa = 15;
+
+bool channelConnected(uint8_t com) { return TCCR1A & _BV(com); }
+
+// LED power relative to one channel at full duty, and the average pack current
+double ledPower() {
+  double power = 0;
+  if (channelConnected(COM1A1)) power += (double)OCR1A / TIMER1_PERIOD;
+  if (channelConnected(COM1B1)) power += (double)OCR1B / TIMER1_PERIOD;
+  return power;
+}
+
+double averageCurrentMa() { return systemCurrentMa + LED_CURRENT_FULL_MA * ledPower(); }
+
+// The current the pack sees at this instant of the PWM period
+double instantCurrentMa(uint64_t phase) {
+  double ma = systemCurrentMa;
+  if (channelConnected(COM1A1) && OCR1A > phase) ma += LED_CURRENT_FULL_MA;
+  if (channelConnected(COM1B1) && OCR1B > phase) ma += LED_CURRENT_FULL_MA;
+  return ma;
+}
+
+void updatePlants() {
+  if (now - plantUpdatedAt < CYCLES_PER_MS) return;
+  double dt = (double)(now - plantUpdatedAt) / F_CPU;
+  plantUpdatedAt = now;
+  battery.step(dt / 3600, averageCurrentMa());
+  heatsink.step(dt, ledPower());
+}
+
+// --- Pins ---
+const uint8_t PIND_IDLE = _BV(UART_RX_PIN) | _BV(ENCODER_PIN_A) | _BV(ENCODER_PIN_B) |
+                          _BV(ENCODER_SWITCH_PIN) | _BV(IR_RECEIVE_PIN);
+bool pinInterrupted = false;
+
+// A level change on port D: PCINT2 fires if an enabled pin changed
+void setPortD(uint8_t value) {
+  uint8_t changed = PIND ^ value;
+  PIND = value;
+  if ((PCICR & _BV(PCIE2)) && (changed & PCMSK2)) {
+    pinInterrupted = true;
+    PCINT2_vect();
+  }
+}
+
+void setPortDPin(uint8_t pin, bool high) {
+  setPortD(high ? PIND | _BV(pin) : PIND & ~_BV(pin));
+}
+
+// --- Stimulus queue ---
+std::multimap<uint64_t, std::function<void()>> stimuli;
+
+void at(uint64_t cycle, std::function<void()> action) { stimuli.emplace(cycle, std::move(action)); }
+void after(double ms, std::function<void()> action) { at(now + (uint64_t)(ms * CYCLES_PER_MS), std::move(action)); }
+uint64_t nextStimulus() { return stimuli.empty() ? NEVER : stimuli.begin()->first; }
+
+void runStimulus() {
+  auto it = stimuli.begin();
+  auto action = std::move(it->second);
+  stimuli.erase(it);
+  action();
+}
+
+// --- ADC ---
+bool adcBusy = false;
+uint64_t adcDoneAt = 0;
+uint16_t adcResult = 0;
+// ADC interrupts held off past the next trigger: that conversion ran on the old mux
+uint32_t adcLateMuxSwitches = 0;
+
+uint16_t adcNoise(double value) {
+  // +-1 LSB triangular noise, like a real converter's, so averaging gains resolution
+  double noisy = value + ((int)(nextRandom() & 0xFF) + (int)(nextRandom() & 0xFF) - 255) / 256.0;
+  return (uint16_t)std::max(0.0, std::min(1023.0, std::round(noisy)));
+}
+
+// The divider's reading before noise, as a fractional code
+double batteryAdcCode() {
+  double mv = battery.terminalMv(instantCurrentMa(ADC_SAMPLE_CYCLES)) / BATTERY_DIVIDER * battery.adcGain;
+  return mv * 1023 / ADC_VCC_MV;
+}
+
+void startAdcConversion(uint64_t trigger) {
+  updatePlants();
+  if ((ADMUX & 0x0F) == 0x0E) {
+    adcResult = adcNoise(1100 * 1023 / ADC_VCC_MV);
+  } else {
+    adcResult = adcNoise(batteryAdcCode());
+  }
+  adcBusy = true;
+  adcDoneAt = trigger + ADC_CONVERSION_CYCLES;
+}
+
+bool adcAutoTriggered() {
+  return (ADCSRA & _BV(ADEN)) && (ADCSRA & _BV(ADATE)) && (ADCSRB & 0x07) == (_BV(ADTS2) | _BV(ADTS1));
+}
+
+// --- TWI and the SSD1306 ---
+struct Ssd1306 {
+  uint8_t ram[8][OLED_WIDTH] = {};
+  bool on = false;
+  uint8_t contrast = 0x7F;
+  uint8_t page = 0, column = 0;
+  bool expectControl = true, continuation = false, data = false;
+  uint8_t command = 0, argsLeft = 0;
+  uint32_t pageWrites = 0;
+
+  void start() { expectControl = true; argsLeft = 0; }
+  void write(uint8_t value) {
+    if (expectControl) {
+      continuation = value & 0x80;
+      data = value & 0x40;
+      expectControl = false;
+      return;
+    }
+    if (data) {
+      ram[page][column] = value;
+      column = (column + 1) % OLED_WIDTH;
+    } else {
+      runCommand(value);
+    }
+    if (continuation) expectControl = true;
+  }
+  void runCommand(uint8_t value) {
+    if (argsLeft) {
+      if (command == 0x81) contrast = value;
+      argsLeft--;
+      return;
+    }
+    command = value;
+    if (value <= 0x0F) column = (column & 0xF0) | value;
+    else if (value <= 0x1F) column = (column & 0x0F) | (value & 0x0F) << 4;
+    else if (value >= 0xB0 && value <= 0xB7) { page = value & 0x07; pageWrites++; }
+    else if (value == 0xAE || value == 0xAF) on = value == 0xAF;
+    else if (value == 0x81 || value == 0x20 || value == 0x8D || value == 0xA8 || value == 0xD3 ||
+             value == 0xD5 || value == 0xD9 || value == 0xDA || value == 0xDB) argsLeft = 1;
+    else if (value == 0x21 || value == 0x22) argsLeft = 2;
+  }
+};
+
+Ssd1306 oled;
+enum TwiBusState { TWI_IDLE, TWI_STARTED, TWI_ADDRESSED, TWI_REJECTED };
+TwiBusState twiState = TWI_IDLE;
+uint8_t twcr = 0;
+bool twiIrqPending = false;
+uint64_t twiIrqAt = 0;
+
+uint64_t twiByteCycles() { return 9 * (16 + 2 * (uint64_t)TWBR); }
+
+void twiComplete(uint8_t status) {
+  TWSR = status;
+  if (twcr & _BV(TWIE)) {
+    twiIrqPending = true;
+    twiIrqAt = now + twiByteCycles();
+  } else {
+    now += twiByteCycles();  // the polled caller spins for the byte time
+    twcr |= _BV(TWINT);
+  }
+}
+
+void writeTwcr(uint8_t value) {
+  twcr = value & ~_BV(TWINT);
+  if (!(value & _BV(TWEN))) return;
+  if (value & _BV(TWSTO)) {
+    twiState = TWI_IDLE;
+    twcr &= ~_BV(TWSTO);  // the STOP is on the bus at once
+    return;
+  }
+  if (!(value & _BV(TWINT))) return;
+  if (value & _BV(TWSTA)) {
+    twiState = TWI_STARTED;
+    twiComplete(0x08);
+  } else if (twiState == TWI_STARTED) {
+    bool ack = (TWDR & 0xFE) == 0x78;
+    twiState = ack ? TWI_ADDRESSED : TWI_REJECTED;
+    if (ack) oled.start();
+    twiComplete(ack ? 0x18 : 0x20);
+  } else if (twiState == TWI_ADDRESSED) {
+    oled.write(TWDR);
+    twiComplete(0x28);
+  }
+}
+
+// --- UART ---
+uint64_t uartBitCycles() { return 8 * ((uint64_t)UBRR0 + 1); }
+uint64_t uartByteCycles() { return 10 * uartBitCycles(); }
+uint64_t txShiftFreeAt = 0;
+uint64_t udreReadyAt = 0;
+std::vector<uint8_t> hostReceived;  // lamp to host
+std::multimap<uint64_t, uint8_t> hostSending;  // host to lamp, by arrival time
+uint8_t uartRxData = 0;
+uint32_t uartRxLostAsleep = 0;
+
+void writeUdr0(uint8_t value) {
+  uint64_t start = std::max(now, txShiftFreeAt);
+  txShiftFreeAt = start + uartByteCycles();
+  udreReadyAt = start;
+  hostReceived.push_back(value);
+}
+
+// --- DS18B20 ---
+struct Ds18b20 {
+  bool present = true;
+  uint8_t rom[8] = {DS18B20_FAMILY, 0x4C, 0x3A, 0x91, 0x0D, 0x00, 0x00, 0x00};
+  uint8_t pad[9] = {0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10, 0x00};
+  // Slave timing (us): presence pulse after the reset, how long a 0 is held in a read slot
+  double presenceDelayUs = 30, presenceLengthUs = 120, readHoldUs = 30;
+
+  enum Mode { IDLE, ROM_COMMAND, MATCH_ROM, FUNCTION, WRITE_SCRATCHPAD, TRANSMIT } mode = IDLE;
+  bool masterLow = false;
+  uint64_t fallAt = 0, releaseAt = 0, slaveLowFrom = 0, slaveLowUntil = 0;
+  uint8_t rxByte = 0, rxBits = 0, rxCount = 0;
+  uint8_t tx[9];
+  uint8_t txLength = 0, txBit = 0;
+  bool matched = true;
+
+  // What the master did to the bus: slot low times and sample points, in us
+  uint32_t resets = 0, presenceSamples = 0, slotViolations = 0, conversions = 0;
+  double write0MinUs = 1e9, write0MaxUs = 0, write1MaxUs = 0;
+  double presenceSampleMinUs = 1e9, presenceSampleMaxUs = 0, readSampleMaxUs = 0;
+  bool sampledSinceEdge = true;
+
+  void init() { pad[8] = dallasCrc(pad, 8); rom[7] = dallasCrc(rom, 7); }
+  bool line() const { return !(masterLow || (now >= slaveLowFrom && now < slaveLowUntil)); }
+  double usSince(uint64_t t) const { return (double)(now - t) / CYCLES_PER_US; }
+
+  void drive(bool low) {
+    if (low == masterLow) return;
+    masterLow = low;
+    if (low) fall(); else rise();
+  }
+  // Only the first PINB read after an edge is the master's sample
+  void sample() {
+    if (sampledSinceEdge) return;
+    sampledSinceEdge = true;
+    if (masterLow) return;
+    if (mode == ROM_COMMAND && rxBits == 0 && rxCount == 0 && releaseAt > fallAt) {
+      double us = usSince(releaseAt);
+      presenceSamples++;
+      presenceSampleMinUs = std::min(presenceSampleMinUs, us);
+      presenceSampleMaxUs = std::max(presenceSampleMaxUs, us);
+    } else if (mode == TRANSMIT) {
+      readSampleMaxUs = std::max(readSampleMaxUs, usSince(fallAt));
+    }
+  }
+  void fall() {
+    fallAt = now;
+    sampledSinceEdge = false;
+    if (mode == TRANSMIT && present && !(tx[txBit >> 3] & (1 << (txBit & 7)))) {
+      slaveLowFrom = now;
+      slaveLowUntil = now + (uint64_t)(readHoldUs * CYCLES_PER_US);
+    }
+  }
+  void rise() {
+    double lowUs = usSince(fallAt);
+    releaseAt = now;
+    sampledSinceEdge = false;
+    if (lowUs >= 480) {
+      resets++;
+      mode = ROM_COMMAND;
+      rxBits = rxCount = 0;
+      if (present) {
+        slaveLowFrom = now + (uint64_t)(presenceDelayUs * CYCLES_PER_US);
+        slaveLowUntil = slaveLowFrom + (uint64_t)(presenceLengthUs * CYCLES_PER_US);
+      }
+      return;
+    }
+    if (!present || mode == IDLE) return;
+    if (mode == TRANSMIT) {
+      if (++txBit == txLength * 8) mode = IDLE;
+      return;
+    }
+    bool bit;
+    if (lowUs < 15) {
+      bit = true;
+      write1MaxUs = std::max(write1MaxUs, lowUs);
+    } else if (lowUs >= 60 && lowUs <= 120) {
+      bit = false;
+      write0MinUs = std::min(write0MinUs, lowUs);
+      write0MaxUs = std::max(write0MaxUs, lowUs);
+    } else {
+      // Inside the slave's 15..60 us sampling window, or too long for a slot
+      slotViolations++;
+      bit = lowUs < 30;
+      if (!bit) {
+        write0MinUs = std::min(write0MinUs, lowUs);
+        write0MaxUs = std::max(write0MaxUs, lowUs);
+      }
+    }
+    rxByte |= bit << rxBits;
+    if (++rxBits == 8) {
+      uint8_t value = rxByte;
+      rxByte = rxBits = 0;
+      receive(value);
+    }
+  }
+  void transmit(const uint8_t* bytes, uint8_t length) {
+    memcpy(tx, bytes, length);
+    txLength = length;
+    txBit = 0;
+    mode = TRANSMIT;
+  }
+  void receive(uint8_t value) {
+    switch (mode) {
+      case ROM_COMMAND:
+        if (value == DS_READ_ROM) transmit(rom, 8);
+        else if (value == DS_MATCH_ROM) { mode = MATCH_ROM; rxCount = 0; matched = true; }
+        else if (value == 0xCC) mode = FUNCTION;
+        else mode = IDLE;
+        break;
+      case MATCH_ROM:
+        matched = matched && value == rom[rxCount];
+        if (++rxCount == 8) mode = matched ? FUNCTION : IDLE;
+        break;
+      case FUNCTION:
+        rxCount = 0;
+        if (value == DS_CONVERT_T) { convert(); mode = IDLE; }
+        else if (value == DS_READ_SCRATCHPAD) transmit(pad, 9);
+        else if (value == DS_WRITE_SCRATCHPAD) mode = WRITE_SCRATCHPAD;
+        else mode = IDLE;
+        break;
+      case WRITE_SCRATCHPAD:
+        pad[2 + rxCount] = value;
+        if (++rxCount == 3) {
+          pad[4] |= 0x1F;
+          pad[8] = dallasCrc(pad, 8);
+          mode = IDLE;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  // The bits below the configured resolution are left set: they are undefined
+  void convert() {
+    updatePlants();
+    uint8_t bits = ((pad[4] >> 5) & 0x03) + 9;
+    int16_t raw = (int16_t)std::lround(heatsink.tempC * 16);
+    raw |= (1 << (12 - bits)) - 1;
+    pad[0] = raw & 0xFF;
+    pad[1] = (uint16_t)raw >> 8;
+    pad[8] = dallasCrc(pad, 8);
+    conversions++;
+  }
+};
+
+Ds18b20 sensor;
+uint8_t ddrb = 0;
+
+// --- IR ---
+const uint64_t NEC_FRAME_CYCLES = 67500 * CYCLES_PER_US;
+const uint64_t NEC_REPEAT_CYCLES = 11250 * CYCLES_PER_US;
+const uint64_t NEC_PERIOD_CYCLES = 108000 * CYCLES_PER_US;
+const uint64_t NEC_LEADER_CYCLES = 9000 * CYCLES_PER_US;
+// IRremote's matchMark(): 25 % under the mark plus MARK_EXCESS_MICROS
+const uint64_t NEC_LEADER_MIN_CYCLES = (9000 + 20) * 3 / 4 * CYCLES_PER_US;
+
+// The library times the marks with its Timer2 tick, which only runs while the
+// CPU clock does: the part of the leader before a wake finished goes unseen
+uint64_t cpuClockStoppedUntil = 0;
+double irLeaderMeasuredUs = 0;    // last frame, as the receiver timed it
+uint32_t irFramesMissed = 0;
+
+void irFrame(uint32_t code, bool repeat) {
+  IrReceiver.receiving = true;
+  uint64_t leaderStart = now;
+  setPortDPin(IR_RECEIVE_PIN, false);  // leader mark
+  at(now + (repeat ? NEC_REPEAT_CYCLES : NEC_FRAME_CYCLES), [code, repeat, leaderStart] {
+    setPortDPin(IR_RECEIVE_PIN, true);
+    IrReceiver.receiving = false;
+    uint64_t unseen = cpuClockStoppedUntil > leaderStart
+                          ? std::min(cpuClockStoppedUntil - leaderStart, NEC_LEADER_CYCLES) : 0;
+    irLeaderMeasuredUs = (double)(NEC_LEADER_CYCLES - unseen) / CYCLES_PER_US;
+    if (NEC_LEADER_CYCLES - unseen < NEC_LEADER_MIN_CYCLES) {
+      irFramesMissed++;
+      return;
+    }
+    if (!IrReceiver.started || IrReceiver.frameReady || !IrReceiver.receiveComplete) return;
+    IrReceiver.decodedIRData = {NEC, (uint16_t)(code & 0xFF), (uint16_t)((code >> 16) & 0xFF),
+                                (uint8_t)(repeat ? IRDATA_FLAGS_IS_REPEAT : 0)};
+    IrReceiver.frameReady = true;
+    IrReceiver.inTimerInterrupt = true;
+    IrReceiver.receiveComplete();
+    IrReceiver.inTimerInterrupt = false;
+  });
+}
+
+// --- Event processing ---
+// Runs the interrupts due up to `until`. With stopAtInterrupt it returns after the
+// first one that reached the CPU (idle sleep wakes on it).
+bool timer1Running() { return TCCR1B & 0x07; }
+
+inline void advanceAwake(uint64_t to) {
+  if (to <= now) return;
+  uint64_t dt = to - now;
+  now = to;
+  microsCycles += dt;
+  timer0Residue += dt;
+  if (timer0Residue < CYCLES_PER_MS) return;
+  timer0_millis += timer0Residue / CYCLES_PER_MS;
+  timer0Residue %= CYCLES_PER_MS;
+}
+
+// The overflow at timer1Next: triggers the ADC, then enters the ISR if enabled
+bool timer1Overflow() {
+  uint64_t overflow = timer1Next;
+  timer1Next += TIMER1_PERIOD;
+  if (adcAutoTriggered() && !adcBusy) startAdcConversion(overflow);
+  if (!(TIMSK1 & _BV(TOIE1))) return false;
+  advanceAwake(overflow + 4 + (irqJitterCycles ? nextRandom() % irqJitterCycles : 0));
+  TIFR1 &= ~_BV(TOV1);  // cleared on entry
+  TIMER1_OVF_vect();
+  return true;
+}
+
+bool adcComplete() {
+  adcBusy = false;
+  ADC = adcResult;
+  if (!(ADCSRA & _BV(ADEN)) || !(ADCSRA & _BV(ADIE))) return false;
+  if (now >= timer1Next && adcAutoTriggered()) adcLateMuxSwitches++;
+  ADC_vect();
+  return true;
+}
+
+bool runEvents(uint64_t until, bool stopAtInterrupt) {
+  for (;;) {
+    enum { NONE, TIMER1, ADC_DONE, TWI, UDRE, RX, STIMULUS } which = NONE;
+    uint64_t t = until;
+    auto consider = [&](uint64_t at, decltype(which) source) {
+      if (at != NEVER && (which == NONE ? at <= t : at < t)) { t = at; which = source; }
+    };
+    if (timer1Running()) consider(timer1Next, TIMER1);
+    if (adcBusy) consider(adcDoneAt, ADC_DONE);
+    if (twiIrqPending && (twcr & _BV(TWIE))) consider(twiIrqAt, TWI);
+    if ((UCSR0B & _BV(UDRIE0)) && (UCSR0B & _BV(TXEN0))) consider(std::max(now, udreReadyAt), UDRE);
+    if (!hostSending.empty()) consider(hostSending.begin()->first, RX);
+    consider(nextStimulus(), STIMULUS);
+    if (which == NONE) {
+      advanceAwake(until);
+      return false;
+    }
+    advanceAwake(t);
+    bool interrupted = false;
+    switch (which) {
+      case TIMER1:
+        interrupted = timer1Overflow();
+        break;
+      case ADC_DONE:
+        interrupted = adcComplete();
+        break;
+      case TWI:
+        twiIrqPending = false;
+        twcr |= _BV(TWINT);
+        TWI_vect();
+        interrupted = true;
+        break;
+      case UDRE:
+        USART_UDRE_vect();
+        interrupted = true;
+        break;
+      case RX: {
+        auto it = hostSending.begin();
+        uint8_t value = it->second;
+        hostSending.erase(it);
+        if (UCSR0B & _BV(RXEN0)) {
+          uartRxData = value;
+          UCSR0A &= ~_BV(FE0);
+          if (UCSR0B & _BV(RXCIE0)) {
+            USART_RX_vect();
+            interrupted = true;
+          }
+        }
+        break;
+      }
+      case STIMULUS:
+        pinInterrupted = false;
+        runStimulus();
+        interrupted = pinInterrupted;
+        break;
+      default:
+        break;
+    }
+    if (interrupted && stopAtInterrupt) return true;
+  }
+}
+
+void drainTwi() {
+  while (twiIrqPending) runEvents(twiIrqAt, false);
+}
+
+// --- Sleep ---
+// Nothing in flight and nothing due: a jump cannot skip over anything the firmware
+// would have done. With busAllowed a 1-Wire transaction may be in flight.
+bool quiescent(bool busAllowed = false) {
+  uint16_t level = fadeLevel;
+  if (level != fadeTargetLevel || isPatternActive() || isSceneActive()) return false;
+  if (isOneWireBusy() && !busAllowed) return false;
+  if (isDisplayFrameInFlight() || twiBusy || twiIrqPending) return false;
+  if (!isSerialIdle() || logDumpActive || !isEepromIdle() || !hostSending.empty()) return false;
+  if (inputHead != inputTail || irFrameReady || buttonIsDown || !IrReceiver.isIdle() || bootStage != BOOT_DONE) return false;
+  if (!isOneWireBusy() && tempPhase != TEMP_IDLE && tempPhase != TEMP_CONVERTING) return false;
+  if ((UCSR0B & _BV(UDRIE0)) || txShiftFreeAt > now) return false;
+  return true;
+}
+
+// Where an idle stretch ends: the run's deadline, the next stimulus or task release
+uint64_t idleUntil() {
+  uint64_t target = std::min(std::min(deadline, nextStimulus()), now + 1000 * CYCLES_PER_MS);
+  if (currentState != STATE_LOW_BATTERY) {
+    target = std::min(target, now + msUntilNextRelease(millis()) * CYCLES_PER_MS);
+  }
+  return target;
+}
+
+// Only a 1-Wire transaction in flight: the overflow interrupt drives the bus and
+// the loop would only check for the end. Nothing else is due before the target,
+// so the overflows and the conversions they trigger run back to back.
+void finishBusTransaction() {
+  uint64_t target = idleUntil();
+  while (isOneWireBusy() && timer1Running() && timer1Next < target) {
+    if (adcBusy && adcDoneAt <= timer1Next) {
+      advanceAwake(adcDoneAt);
+      adcComplete();
+    }
+    advanceAwake(timer1Next);
+    timer1Overflow();
+  }
+  runEvents(isOneWireBusy() ? target : now, false);
+}
+
+// ADC rounds until a 1/8-per-round filter that is `codes` off is within 1/16 LSB
+int settleRounds(double codes) {
+  int rounds = 1;
+  for (double left = codes * 16; left >= 1 && rounds < SETTLE_ROUNDS_MAX; left *= 7.0 / 8) rounds++;
+  return rounds;
+}
+
+void fastForward() {
+  uint64_t target = idleUntil();
+  if (tempPhase == TEMP_CONVERTING) {
+    unsigned long doneMs = tempConvertStart + conversionTimeMs(tempResolutionBits);
+    target = std::min(target, now + (doneMs > millis() ? doneMs - millis() : 0) * CYCLES_PER_MS);
+  }
+  if (target == NEVER || target < now + MIN_JUMP_CYCLES) {
+    runEvents(NEVER, true);
+    return;
+  }
+  // Skip whole PWM periods. As many of the skipped conversions as the battery
+  // filter needs to catch up with the plants run back to back, then the last few
+  // periods run in full. The bandgap reading does not move.
+  uint64_t skip = (target - SETTLE_CYCLES - now) / TIMER1_PERIOD * TIMER1_PERIOD;
+  adcBusy = false;
+  advanceAwake(now + skip);
+  timer1Next += skip;
+  updatePlants();
+  if (adcAutoTriggered() && (ADCSRA & _BV(ADIE))) {
+    double lag = std::abs(batteryAdcCode() - adcBatteryFiltered / 64.0);
+    int conversions = settleRounds(lag) * ADC_SEQ_SLOTS;
+    for (int i = 0; i < conversions; i++) {
+      startAdcConversion(now);
+      adcBusy = false;
+      ADC = adcResult;
+      ADC_vect();
+    }
+  }
+  runEvents(target, false);
+}
+
+uint64_t watchdogCycles() {
+  if (!(WDTCSR & _BV(WDIE))) return NEVER;
+  if (WDTCSR & _BV(WDP3)) return 8000 * CYCLES_PER_MS;
+  return (16ULL << (WDTCSR & 0x07)) * CYCLES_PER_MS;
+}
+
+// Power-down and standby: timers stop; the watchdog, a pin change or (pin 0) the
+// start bit of a received byte wakes the MCU. The byte itself is lost. From
+// power-down the crystal starts again first: 16K CK with the Nano's fuses
+// (CKSEL = 1111, SUT = 11); standby wakes in 6 cycles.
+const uint64_t POWER_DOWN_STARTUP_CYCLES = 16384;
+const uint64_t STANDBY_STARTUP_CYCLES = 6;
+
+void sleepDeep() {
+  uint64_t start = now;
+  uint64_t wakeAt = watchdogCycles() == NEVER ? NEVER : start + watchdogCycles();
+  for (;;) {
+    uint64_t rx = hostSending.empty() ? NEVER : hostSending.begin()->first;
+    uint64_t t = std::min(std::min(wakeAt, nextStimulus()), rx);
+    if (t == NEVER) throw Halted();
+    now = t;
+    updatePlants();
+    if (t == wakeAt) {
+      WDT_vect();
+      break;
+    }
+    pinInterrupted = false;
+    if (t == rx) {
+      hostSending.erase(hostSending.begin());
+      uartRxLostAsleep++;
+      setPortDPin(UART_RX_PIN, false);
+      setPortDPin(UART_RX_PIN, true);
+    } else {
+      runStimulus();
+    }
+    if (pinInterrupted) break;
+  }
+  now += halSleepMode == SLEEP_MODE_STANDBY ? STANDBY_STARTUP_CYCLES : POWER_DOWN_STARTUP_CYCLES;
+  cpuClockStoppedUntil = now;
+  timer1Next += now - start;
+}
+
+}  // namespace sim
+
+// --- HAL hooks ---
+uint8_t halRead8(HalRegister reg) {
+  switch (reg) {
+    case HAL_TWCR: return sim::twcr;
+    case HAL_DDRB: return sim::ddrb;
+    case HAL_PINB:
+      sim::sensor.sample();
+      return sim::sensor.line() ? ONEWIRE_MASK : 0;
+    case HAL_UDR0: return sim::uartRxData;
+  }
+  return 0;
+}
+
+void halWrite8(HalRegister reg, uint8_t value) {
+  switch (reg) {
+    case HAL_TWCR: sim::writeTwcr(value); break;
+    case HAL_DDRB:
+      sim::ddrb = value;
+      sim::sensor.drive((value & ONEWIRE_MASK) && !(PORTB & ONEWIRE_MASK));
+      break;
+    case HAL_PINB: break;
+    case HAL_UDR0: sim::writeUdr0(value); break;
+  }
+}
+
+// A 16-bit read is two LDS, 2 cycles each
+inline uint16_t halReadTcnt1() {
+  sim::advanceAwake(sim::now + 4);
+  // An overflow that came while the firmware was busy is pending until its ISR runs
+  uint64_t count = sim::now - (sim::timer1Next - sim::TIMER1_PERIOD);
+  if (count < sim::TIMER1_PERIOD) return count;
+  TIFR1 |= _BV(TOV1);
+  return count % sim::TIMER1_PERIOD;
+}
+
+unsigned long micros() { return sim::microsCycles / sim::CYCLES_PER_US; }
+void halDelayCycles(unsigned long cycles) { sim::advanceAwake(sim::now + cycles); }
+void halTwiDrain() { sim::drainTwi(); }
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t pin) {
+  if (pin < 8) return (PIND >> pin) & 1;
+  if (pin < 14) return (halRead8(HAL_PINB) >> (pin - 8)) & 1;
+  return LOW;
+}
+
+void halSleepCpu() {
+  if (halSleepMode == SLEEP_MODE_IDLE) {
+    if (sim::quiescent()) sim::fastForward();
+    else if (isOneWireBusy() && sim::quiescent(true)) sim::finishBusTransaction();
+    else sim::runEvents(sim::NEVER, true);
+  } else {
+    sim::sleepDeep();
+  }
+}
+
+namespace sim {
+
+// --- Test API ---
+struct PowerOn {
+  PowerOn() {
+    memset(halEeprom, 0xFF, sizeof(halEeprom));
+    PIND = PIND_IDLE;
+    sensor.init();
+    // paintStack() runs from .init3 on the target; the host stack is not in SRAM,
+    // so the canary stays untouched and the peak reads 0
+    memset(&__heap_start, STACK_CANARY, RAMEND + 1 - (uintptr_t)&__heap_start);
+  }
+};
+PowerOn powerOn;
+
+// Runs loop() passes up to end, or until stop holds after a pass. The whole span
+// is the deadline, so idle stretches inside it are skipped.
+void runUntilCycle(uint64_t end, const std::function<bool()>& stop = nullptr) {
+  if (halted) {
+    now = std::max(now, end);
+    return;
+  }
+  deadline = end;
+  try {
+    while (now < end && !(stop && stop())) {
+      loop();
+      runEvents(now + PASS_CYCLES, false);
+    }
+  } catch (Halted&) {
+    halted = true;
+    now = std::max(now, end);
+  }
+  deadline = NEVER;
+}
+
+// Runs loop() passes for ms of simulated time (a power-down sleep can overrun it
+// up to the next wake)
+void run(double ms) { runUntilCycle(now + (uint64_t)(ms * CYCLES_PER_MS)); }
+
+// Runs until the condition holds, checked after every loop() pass; false on timeout
+bool runUntil(std::function<bool()> condition, double timeoutMs) {
+  runUntilCycle(now + (uint64_t)(timeoutMs * CYCLES_PER_MS), condition);
+  return condition();
+}
+
+void boot() {
+  setup();
+  run(200);
+}
+
+// Encoder detents: positive is clockwise (brighter). Four quadrature edges each.
+void turn(int detents, double msPerDetent = 40) {
+  static const uint8_t clockwise[4] = {1, 0, 2, 3};  // A|B<<1 after each edge
+  static const uint8_t counterClockwise[4] = {2, 0, 1, 3};
+  const uint8_t* sequence = detents > 0 ? clockwise : counterClockwise;
+  double t = 1;
+  for (int i = 0; i < std::abs(detents); i++) {
+    for (int edge = 0; edge < 4; edge++, t += msPerDetent / 4) {
+      uint8_t ab = sequence[edge];
+      after(t, [ab] {
+        uint8_t pins = PIND & ~(_BV(ENCODER_PIN_A) | _BV(ENCODER_PIN_B));
+        if (ab & 1) pins |= _BV(ENCODER_PIN_A);
+        if (ab & 2) pins |= _BV(ENCODER_PIN_B);
+        setPortD(pins);
+      });
+    }
+  }
+  run(t + 10);
+}
+
+void press(double holdMs) {
+  after(1, [] { setPortDPin(ENCODER_SWITCH_PIN, false); });
+  after(1 + holdMs, [] { setPortDPin(ENCODER_SWITCH_PIN, true); });
+  run(holdMs + 50);
+}
+
+void click() { press(120); }
+
+// An NEC frame for a raw code (as in the IR_CODE_* table), plus held-key repeats
+void ir(uint32_t code, int repeats = 0) {
+  at(now + CYCLES_PER_MS, [code] { irFrame(code, false); });
+  for (int i = 1; i <= repeats; i++) {
+    at(now + CYCLES_PER_MS + i * NEC_PERIOD_CYCLES, [code] { irFrame(code, true); });
+  }
+  run(1 + (repeats + 1) * 108.0);
+}
+
+// Bytes from the host, back to back on the line
+void send(const std::vector<uint8_t>& bytes) {
+  uint64_t t = std::max(now, hostSending.empty() ? 0 : hostSending.rbegin()->first);
+  for (uint8_t value : bytes) {
+    t += uartByteCycles();
+    hostSending.emplace(t, value);
+  }
+}
+
+// --- Observations ---
+uint8_t coolDutyPercent() { return channelConnected(COM1A1) ? OCR1A * 100 / TIMER1_PERIOD : 0; }
+uint8_t warmDutyPercent() { return channelConnected(COM1B1) ? OCR1B * 100 / TIMER1_PERIOD : 0; }
+bool outputsOff() { return coolDutyPercent() == 0 && warmDutyPercent() == 0; }
+
+// The display as text: a status line, then one row of '#'/'.' per pixel row
+std::string screen() {
+  std::ostringstream out;
+  out << "display " << (oled.on ? "on" : "off") << " contrast " << (int)oled.contrast << "\n";
+  for (int y = 0; y < 64; y++) {
+    for (int x = 0; x < OLED_WIDTH; x++) out << ((oled.ram[y >> 3][x] >> (y & 7)) & 1 ? '#' : '.');
+    out << "\n";
+  }
+  return out.str();
+}
+
+// Compares the display with test/<suite>/snapshots/<name>.txt. With
+// LAMP_UPDATE_SNAPSHOTS=1 in the environment the file is rewritten instead.
+std::string snapshotMismatch(const char* testFile, const char* name) {
+  std::string path = testFile;
+  path = path.substr(0, path.find_last_of("/\\") + 1) + "snapshots/" + name + ".txt";
+  std::string actual = screen();
+  if (getenv("LAMP_UPDATE_SNAPSHOTS")) {
+    std::ofstream(path) << actual;
+    return "";
+  }
+  std::ifstream file(path);
+  if (!file) return "missing snapshot " + path + " (run with LAMP_UPDATE_SNAPSHOTS=1)";
+  std::stringstream expected;
+  expected << file.rdbuf();
+  if (expected.str() == actual) return "";
+  return "display differs from " + path + ":\n" + actual;
+}
+
+}  // namespace sim
@@ -0,0 +1,7 @@
+// Host stand-in for <util/atomic.h>. Interrupts never preempt the simulated loop,
+// so an atomic block is a block that runs once.
+#pragma once
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 1
+#define ATOMIC_BLOCK(type) for (bool _halAtomicOnce = true; _halAtomicOnce; _halAtomicOnce = false)
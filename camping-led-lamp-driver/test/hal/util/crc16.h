@@ -0,0 +1,15 @@
+// Host stand-in for <util/crc16.h>: the C equivalents given in the avr-libc manual.
+#pragma once
+#include <stdint.h>
+
+inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data) {
+  crc ^= data;
+  for (uint8_t i = 0; i < 8; i++) crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+  return crc;
+}
+
+inline uint8_t _crc_ibutton_update(uint8_t crc, uint8_t data) {
+  crc ^= data;
+  for (uint8_t i = 0; i < 8; i++) crc = (crc & 0x01) ? (crc >> 1) ^ 0x8C : crc >> 1;
+  return crc;
+}
@@ -0,0 +1,99 @@
+// The charging state against the battery plant's CC/CV charger: a charge ends at
+// the charger's constant voltage and calibrates the reading, the charging cap has
+// its own flag, and a charger that fades out cannot hold the lamp in the charging
+// state (where the state of charge only rises) while the pack runs down.
+#include <unity.h>
+
+#include "lamp_sim.h"
+
+using namespace sim;
+
+#define TEST_ASSERT_SNAPSHOT(name)                                     \
+  do {                                                                 \
+    std::string mismatch = snapshotMismatch(__FILE__, name);           \
+    TEST_ASSERT_TRUE_MESSAGE(mismatch.empty(), mismatch.c_str());      \
+  } while (0)
+
+void setUp() {}
+void tearDown() {}
+
+void plugIn() {
+  battery.chargerPlugged = true;
+  battery.chargerDone = false;
+  TEST_ASSERT_TRUE(runUntil([] { return currentState == STATE_CHARGING; }, 120e3));
+}
+
+void test_charge_ends_at_cv_and_calibrates() {
+  battery.adcGain = 1.015;
+  battery.chargeMah = battery.capacityMah * 0.4;
+  boot();
+  ir(IR_CODE_POWER);
+  run(1000);
+  TEST_ASSERT_FALSE(isLampOn);
+  run(60000);
+  plugIn();
+  TEST_ASSERT_TRUE(runUntil([] { return currentState != STATE_CHARGING; }, 6 * 3600e3));
+  TEST_ASSERT_EQUAL(STATE_OPERATING, currentState);
+  // In the constant-voltage phase, not on an earlier plateau
+  TEST_ASSERT_TRUE(battery.percent() > 95);
+  TEST_ASSERT_FALSE(battery.chargerDone);
+  TEST_ASSERT_EQUAL(100, batteryPercent);
+  TEST_ASSERT_INT_WITHIN(30, 8400 * 1.015, batteryFullChargeMv);
+  // Later readings are scaled by it
+  run(60000);
+  TEST_ASSERT_INT_WITHIN(30, 8400, batteryMillivolts);
+}
+
+void test_reading_outside_the_window_is_not_saved() {
+  battery.chargerPlugged = false;
+  battery.adcGain = 1.04;
+  batteryFullChargeMv = 0;
+  battery.chargeMah = battery.capacityMah * 0.7;
+  run(120000);
+  plugIn();
+  TEST_ASSERT_TRUE(runUntil([] { return currentState != STATE_CHARGING; }, 6 * 3600e3));
+  TEST_ASSERT_EQUAL(STATE_OPERATING, currentState);
+  TEST_ASSERT_EQUAL(0, batteryFullChargeMv);
+}
+
+void test_charging_cap_is_not_a_thermal_limit() {
+  battery.chargerPlugged = false;
+  battery.adcGain = 1;
+  battery.chargeMah = battery.capacityMah * 0.2;
+  ir(IR_CODE_POWER);
+  run(1000);
+  ir(IR_CODE_PRESET_4);
+  run(60000);
+  TEST_ASSERT_TRUE(isLampOn);
+  TEST_ASSERT_EQUAL(STATE_OPERATING, currentState);
+  TEST_ASSERT_FALSE(isChargeLimited);
+  plugIn();
+  run(5000);
+  TEST_ASSERT_TRUE(isChargeLimited);
+  TEST_ASSERT_FALSE(isOverheatWarn);
+  TEST_ASSERT_TRUE(coolDutyPercent() + warmDutyPercent() <= 50);
+  TEST_ASSERT_SNAPSHOT("charge_limit");
+}
+
+void test_fading_charger_does_not_hold_the_charging_state() {
+  // Dusk on a solar charger: the current falls below the lamp's draw too slowly
+  // for an unplug step
+  TEST_ASSERT_EQUAL(STATE_CHARGING, currentState);
+  while (battery.chargerCcMa > 0) {
+    battery.chargerCcMa -= 5;
+    run(2000);
+  }
+  // The state of charge falls again and the 10% warning is given on time
+  TEST_ASSERT_TRUE(runUntil([] { return low10Handled; }, 4 * 3600e3));
+  TEST_ASSERT_EQUAL(STATE_OPERATING, currentState);
+  TEST_ASSERT_INT_WITHIN(4, battery.percent(), batteryPercent);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_charge_ends_at_cv_and_calibrates);
+  RUN_TEST(test_reading_outside_the_window_is_not_saved);
+  RUN_TEST(test_charging_cap_is_not_a_thermal_limit);
+  RUN_TEST(test_fading_charger_does_not_hold_the_charging_state);
+  return UNITY_END();
+}
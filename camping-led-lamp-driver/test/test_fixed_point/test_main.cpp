@@ -0,0 +1,149 @@
+// The fixed-point sensor math against the float math it replaced: the battery
+// voltage, the temperature conversion, the display formatting and the overheat
+// cutoff hysteresis, over every value the ADC and the DS18B20 can produce, the
+// ADC filter against the mean it should settle at, and the fade step against the
+// rate it is set for.
+#include <unity.h>
+
+#include "lamp_sim.h"
+
+using namespace sim;
+
+void setUp() {}
+void tearDown() {}
+
+// --- The float versions, as they were ---
+float floatBatteryVoltage(uint16_t batteryRaw, uint16_t bandgapRaw) {
+  float pinVoltage = 1.1 * batteryRaw / bandgapRaw;
+  return pinVoltage * 7.8;
+}
+
+// dtostrf(value, 4, 1, out) rounds half away from zero
+std::string floatFormat(float value, int decimals) {
+  float scale = decimals == 1 ? 10 : 100;
+  char out[16];
+  snprintf(out, sizeof(out), "%.*f", decimals, std::round(value * scale) / scale);
+  return out;
+}
+
+struct FloatCutoff {
+  bool critical = false;
+  void update(float tempC) {
+    if (critical) {
+      if (tempC <= 55.0) critical = false;
+    } else if (tempC >= 75.0) {
+      critical = true;
+    }
+  }
+};
+
+void test_battery_millivolts_match_float() {
+  for (uint16_t bandgap = 200; bandgap <= 260; bandgap++) {
+    for (uint16_t raw = 0; raw <= 1023; raw++) {
+      millivolts_t mv = (uint32_t)raw * BATTERY_MV_PER_BANDGAP / bandgap;
+      float volts = floatBatteryVoltage(raw, bandgap);
+      // Truncated, so at most 1 mV under the float result
+      TEST_ASSERT_TRUE(mv <= volts * 1000 + 0.01f);
+      TEST_ASSERT_TRUE(mv > volts * 1000 - 1.01f);
+    }
+  }
+}
+
+// Round sums a fraction of an LSB above or below the filter, as the bandgap's are
+// (about 225, so an LSB is 0.4 % of the battery reading): it gets there either way
+void test_adc_filter_settles_from_either_side() {
+  const double scale = 8 << ADC_FILTER_EXTRA_SHIFT;  // filter state per sample LSB
+  for (uint16_t sum = 225 * 8 - 12; sum <= 225 * 8 + 12; sum++) {
+    for (int offset : {-7, 7}) {
+      uint16_t filtered = filterStep(0, sum + offset);
+      for (int round = 0; round < 100; round++) filtered = filterStep(filtered, sum);
+      // Within the rounding of the last step, 1/16 LSB
+      TEST_ASSERT_FLOAT_WITHIN((1 << (ADC_FILTER_SHIFT - 1)) / scale, sum / 8.0, filtered / scale);
+    }
+  }
+}
+
+// A full-range fade, one fadeTick() per 1.024 ms, takes 100 / rate seconds to
+// within the rounding of the step; rates past what a byte holds are clamped
+void test_fade_rate_sets_the_slew() {
+  for (uint16_t rate : {4, 25, 100, 200, 500, 975, 2000, 65535}) {
+    setFadeRate(rate);
+    for (uint8_t from : {0, 100}) {
+      setOutputImmediate(from);
+      setFadeTarget(100 - from);
+      uint32_t ticks = 0;
+      while (fadeLevel != fadeTargetLevel && ticks < 100000) {
+        fadeTick();
+        ticks++;
+      }
+      double tickSeconds = FADE_TICK_OVERFLOWS * (PWM_TOP + 1.0) / F_CPU;
+      double step = std::min<uint16_t>(rate, 975) * 256 * tickSeconds;  // exact, in 1/256 %
+      double expected = 100 * 256 / step;
+      // The step is truncated to a whole 1/256 %
+      TEST_ASSERT_FLOAT_WITHIN(expected / step + 1, expected, ticks);
+      TEST_ASSERT_EQUAL(brightnessToDuty(100 - from), outputDuty);
+    }
+  }
+  setFadeRate(FADE_RATE_PERCENT_PER_SEC);
+}
+
+void test_voltage_text_matches_dtostrf() {
+  for (millivolts_t mv = 0; mv <= 9999; mv++) {
+    char fixed[8];
+    formatMillivolts(fixed, mv);
+    // Exact halves are decided in decimal, where the float may sit either side
+    if (mv % 10 == 5) continue;
+    TEST_ASSERT_EQUAL_STRING(floatFormat(mv / 1000.0f, 2).c_str(), fixed);
+  }
+}
+
+void test_temperature_text_matches_dtostrf() {
+  for (int16_t raw = -55 * 16; raw <= 125 * 16; raw++) {
+    centiC_t temp = ((int32_t)raw * 25) >> 2;  // as serviceTemperatureSensor()
+    TEST_ASSERT_EQUAL((int)std::floor(raw * 6.25), temp);  // 1/16 C rounded down to 0.01 C
+    char fixed[8];
+    formatCentiC(fixed, temp);
+    TEST_ASSERT_EQUAL_STRING(floatFormat(raw / 16.0f, 1).c_str(), fixed);
+  }
+}
+
+// Readings in sensor steps across both cutoff thresholds and back, through the
+// real sensor path, with the float hysteresis fed the same readings alongside
+void test_cutoff_hysteresis_matches_float() {
+  boot();
+  ir(IR_CODE_POWER);  // off, so the heatsink holds the temperature it is given
+  run(1000);
+  TEST_ASSERT_FALSE(isLampOn);
+
+  FloatCutoff reference;
+  std::vector<int16_t> readings;
+  for (int16_t raw = 73 * 16; raw <= 77 * 16; raw++) readings.push_back(raw);
+  for (int16_t raw = 77 * 16; raw >= 53 * 16; raw--) readings.push_back(raw);
+  int transitions = 0;
+  for (int16_t raw : readings) {
+    heatsink.ambientC = heatsink.tempC = raw / 16.0;
+    // The next conversion, at the resolution the firmware has set
+    uint32_t conversions = sensor.conversions;
+    TEST_ASSERT_TRUE(runUntil([conversions] { return sensor.conversions > conversions; }, 60000));
+    uint8_t bits = ((sensor.pad[4] >> 5) & 0x03) + 9;
+    int16_t reading = (int16_t)(sensor.pad[0] | sensor.pad[1] << 8) & ~((1 << (12 - bits)) - 1);
+    centiC_t expected = ((int32_t)reading * 25) >> 2;
+    TEST_ASSERT_TRUE(runUntil([expected] { return ledTemperature == expected; }, 30000));
+    bool wasCritical = reference.critical;
+    reference.update(reading / 16.0f);
+    transitions += reference.critical != wasCritical;
+    TEST_ASSERT_EQUAL(reference.critical, isOverheatCritical);
+  }
+  TEST_ASSERT_EQUAL(2, transitions);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_battery_millivolts_match_float);
+  RUN_TEST(test_adc_filter_settles_from_either_side);
+  RUN_TEST(test_fade_rate_sets_the_slew);
+  RUN_TEST(test_voltage_text_matches_dtostrf);
+  RUN_TEST(test_temperature_text_matches_dtostrf);
+  RUN_TEST(test_cutoff_hysteresis_matches_float);
+  return UNITY_END();
+}
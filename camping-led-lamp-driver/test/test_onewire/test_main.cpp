@@ -0,0 +1,84 @@
+// 1-Wire slot timing as the DS18B20 sees it, with the Timer1 overflow interrupt
+// entered late by up to 40 us (other interrupts, atomic sections): every "0"
+// must stay 60..120 us low, presence must be sampled inside 60..75 us after the
+// reset and a read slot before the slave releases a 0 at 15 us. No wait may
+// hold off the ADC interrupt past the next conversion's trigger, and no slot may
+// keep the overflow interrupt for more than a few microseconds. IRremote's
+// Timer2 interrupt is one of the late entries, so its receive-complete callback
+// must not decode the frame there.
+#include <unity.h>
+
+#include "lamp_sim.h"
+
+using namespace sim;
+
+void setUp() {}
+void tearDown() {}
+
+uint8_t slotMaxUs = 0;  // longest 1-Wire step in the overflow ISR, over all transactions
+
+void resetSlotRanges() {
+  slotMaxUs = 0;
+  sensor.write0MinUs = sensor.presenceSampleMinUs = 1e9;
+  sensor.write0MaxUs = sensor.write1MaxUs = sensor.presenceSampleMaxUs = sensor.readSampleMaxUs = 0;
+  adcLateMuxSwitches = 0;
+}
+
+void checkSlots(uint32_t conversions) {
+  TEST_ASSERT_TRUE(ledSensorFound);
+  TEST_ASSERT_TRUE(sensor.conversions > conversions + 10);
+  TEST_ASSERT_EQUAL(0, sensor.slotViolations);
+  TEST_ASSERT_TRUE(sensor.write0MinUs >= 60);
+  TEST_ASSERT_TRUE(sensor.write0MaxUs <= 120);
+  TEST_ASSERT_TRUE(sensor.write1MaxUs < 15);
+  TEST_ASSERT_TRUE(sensor.presenceSampleMinUs >= 60);
+  TEST_ASSERT_TRUE(sensor.presenceSampleMaxUs <= 75);
+  TEST_ASSERT_TRUE(sensor.readSampleMaxUs < 15);
+  TEST_ASSERT_EQUAL(0, adcLateMuxSwitches);
+  slotMaxUs = std::max(slotMaxUs, tempBusSlotMaxUs);
+  TEST_ASSERT_TRUE(slotMaxUs <= 10);
+  TEST_ASSERT_INT_WITHIN(100, heatsink.tempC * 100, ledTemperature);
+}
+
+void readForAMinute(uint32_t jitterCycles) {
+  irqJitterCycles = jitterCycles;
+  uint32_t conversions = sensor.conversions;
+  // Often enough to see every transaction's figures
+  for (int i = 0; i < 6000; i++) {
+    run(10);
+    slotMaxUs = std::max(slotMaxUs, tempBusSlotMaxUs);
+  }
+  checkSlots(conversions);
+}
+
+void test_slots_with_quiet_interrupts() {
+  boot();
+  resetSlotRanges();
+  readForAMinute(64);
+}
+
+void test_slots_with_late_interrupts() {
+  resetSlotRanges();
+  readForAMinute(40 * CYCLES_PER_US);
+}
+
+void test_slots_with_ir_frames() {
+  resetSlotRanges();
+  irqJitterCycles = 40 * CYCLES_PER_US;
+  uint32_t conversions = sensor.conversions;
+  uint32_t decodes = IrReceiver.decodes;
+  // A minute of held keys: a frame or repeat every 108 ms
+  for (int i = 0; i < 60; i++) ir(i % 2 ? IR_CODE_UP : IR_CODE_DOWN, 8);
+  TEST_ASSERT_EQUAL(0, irFramesMissed);
+  TEST_ASSERT_EQUAL(60 * 9, IrReceiver.decodes - decodes);
+  TEST_ASSERT_EQUAL(0, IrReceiver.decodesInInterrupt);
+  checkSlots(conversions);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_slots_with_quiet_interrupts);
+  RUN_TEST(test_slots_with_late_interrupts);
+  RUN_TEST(test_slots_with_ir_frames);
+  return UNITY_END();
+}
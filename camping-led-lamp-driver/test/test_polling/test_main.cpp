@@ -0,0 +1,120 @@
+// Adaptive sensor polling against the fixed 2 s period it replaced: with the lamp
+// off and cold the sensors are read a small fraction as often, and while the LED
+// heats up quickly towards the thermal target the temperature is read faster.
+#include <unity.h>
+
+#include "lamp_sim.h"
+
+using namespace sim;
+
+void setUp() {}
+void tearDown() {}
+
+const double FIXED_POLLS_PER_HOUR = 3600 / 2.0;
+
+struct PollLog {
+  unsigned long runs = 0;
+  double watchedMs = 0;
+  double longestGapMs = 0;  // up to each of its runs from the run before, whoever logged it
+
+  double meanIntervalMs() const { return runs ? watchedMs / runs : 0; }
+};
+
+double lastRunAt = -1;
+
+// Runs for ms in 10 ms steps, logging the task's runs to the log logFor() picks for
+// the step, or to none
+void watchTask(TaskId id, double ms, std::function<PollLog*()> logFor) {
+  for (double t = 0; t < ms; t += 10) {
+    unsigned long runs = tasks[id].runs;
+    PollLog* log = logFor();
+    run(10);
+    if (log) log->watchedMs += 10;
+    if (tasks[id].runs == runs) continue;
+    double at = seconds() * 1000;
+    if (log) {
+      log->runs += tasks[id].runs - runs;
+      if (lastRunAt >= 0) log->longestGapMs = std::max(log->longestGapMs, at - lastRunAt);
+    }
+    lastRunAt = at;
+  }
+}
+
+void test_off_and_cold_polls_rarely() {
+  boot();
+  ir(IR_CODE_POWER);
+  run(60000);
+  TEST_ASSERT_FALSE(isLampOn);
+  unsigned long battery = tasks[TASK_BATTERY].runs;
+  unsigned long temperature = tasks[TASK_TEMPERATURE].runs;
+  uint32_t conversions = sensor.conversions;
+  run(3600e3);
+  battery = tasks[TASK_BATTERY].runs - battery;
+  temperature = tasks[TASK_TEMPERATURE].runs - temperature;
+  char message[80];
+  snprintf(message, sizeof(message), "per hour: battery %lu, temperature %lu, fixed %.0f", battery, temperature,
+           FIXED_POLLS_PER_HOUR);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE_MESSAGE(battery <= FIXED_POLLS_PER_HOUR / 10, message);
+  TEST_ASSERT_TRUE_MESSAGE(temperature <= FIXED_POLLS_PER_HOUR / 10, message);
+  // Each reading is one bus transaction, no more
+  TEST_ASSERT_UINT_WITHIN(2, temperature, sensor.conversions - conversions);
+}
+
+void test_fast_rise_is_read_faster() {
+  // A small heatsink: at 100% the LED climbs about half a degree per second
+  heatsink.tauSeconds = 80;
+  ir(IR_CODE_POWER);
+  run(200);
+  ir(IR_CODE_PRESET_4);
+  TEST_ASSERT_TRUE(isLampOn);
+  // By the firmware's last reading: the schedule can only change once one is taken
+  const int alertC = THERMAL_TARGET_C - TEMP_ALERT_MARGIN_C;
+  lastRunAt = -1;
+  PollLog rise, alert;
+  double peakC = 0;
+  for (int i = 0; i < 600; i++) {
+    watchTask(TASK_TEMPERATURE, 1000, [&]() -> PollLog* {
+      if (ledTemperature >= alertC) return &alert;
+      return ledTemperature >= DEG_C(40) ? &rise : nullptr;
+    });
+    peakC = std::max(peakC, heatsink.tempC);
+  }
+  char message[120];
+  snprintf(message, sizeof(message),
+           "rise: every %.0f ms (longest %.0f), alert band: longest %.0f ms, fixed 2000 ms, peak %.1f C",
+           rise.meanIntervalMs(), rise.longestGapMs, alert.longestGapMs, peakC);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(rise.runs > 20 && alert.runs > 100);
+  TEST_ASSERT_TRUE_MESSAGE(rise.meanIntervalMs() <= 2000 * 0.7, message);
+  TEST_ASSERT_TRUE_MESSAGE(rise.longestGapMs <= SENSOR_UPDATE_INTERVAL + 100, message);
+  // The period is set when a conversion's result comes in, after the run started it:
+  // up to a 12-bit conversion (the rise slows near the target) and the bus time
+  TEST_ASSERT_TRUE_MESSAGE(alert.longestGapMs <= SENSOR_ALERT_INTERVAL + conversionTimeMs(12) + 100, message);
+  TEST_ASSERT_FALSE(isOverheatCritical);
+  TEST_ASSERT_TRUE(peakC < 75);
+}
+
+void test_lit_and_steady_keeps_the_lit_ceiling() {
+  // Settled below the alert band: never slower than the old period
+  heatsink.tauSeconds = 120;
+  ir(IR_CODE_PRESET_2);
+  run(1800e3);
+  TEST_ASSERT_TRUE(isLampOn);
+  TEST_ASSERT_TRUE(ledTemperature < THERMAL_TARGET_C - TEMP_ALERT_MARGIN_C);
+  lastRunAt = -1;
+  PollLog log;
+  watchTask(TASK_TEMPERATURE, 600e3, [&] { return &log; });
+  char message[64];
+  snprintf(message, sizeof(message), "every %.0f ms, longest %.0f ms", log.meanIntervalMs(), log.longestGapMs);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE_MESSAGE(log.longestGapMs <= SENSOR_UPDATE_INTERVAL + 100, message);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_off_and_cold_polls_rarely);
+  RUN_TEST(test_fast_rise_is_read_faster);
+  RUN_TEST(test_lit_and_steady_keeps_the_lit_ceiling);
+  return UNITY_END();
+}
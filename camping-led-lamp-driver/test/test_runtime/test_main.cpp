@@ -0,0 +1,111 @@
+// The remaining-runtime estimator against a simulated discharge: the lamp held at
+// one setting on the stats screen, its estimate checked against the battery
+// plant's remaining charge at the plant's own draw.
+#include <unity.h>
+
+#include <chrono>
+
+#include "lamp_sim.h"
+
+using namespace sim;
+
+void setUp() {}
+void tearDown() {}
+
+// Minutes the plant's remaining charge lasts at its present draw
+double plantMinutesLeft() { return battery.chargeMah / averageCurrentMa() * 60; }
+
+void test_stats_redraw_matches_full_frame() {
+  boot();
+  ir(IR_CODE_PRESET_3);
+  click();
+  run(500);
+  click();
+  run(500);
+  TEST_ASSERT_EQUAL(MODE_STATS, currentMode);
+  TEST_ASSERT_EQUAL(50, brightness);
+  // 100% to 99% and a new runtime: only the stats fields are sent
+  int percent = batteryPercent;
+  TEST_ASSERT_TRUE(runUntil([percent] { return batteryPercent < percent; }, 3600e3));
+  run(1000);
+  std::string incremental = screen();
+  requestDisplayFrame();
+  run(1000);
+  TEST_ASSERT_EQUAL_STRING(screen().c_str(), incremental.c_str());
+}
+
+void test_estimate_tracks_the_discharge() {
+  auto wallStart = std::chrono::steady_clock::now();
+  uint64_t start = now;
+  int checked = 0;
+  while (!low10Handled) {
+    run(600e3);
+    // From the first learned correction down to the 10% clamp, which changes the load
+    if (battery.percent() > 90 || low10Handled) continue;
+    double actual = plantMinutesLeft();
+    TEST_ASSERT_TRUE_MESSAGE(std::abs(runtimeMinutes - actual) <= actual * 0.2, "runtime off by more than 20%");
+    checked++;
+  }
+  TEST_ASSERT_TRUE(checked >= 50);
+  // How fast the simulator replays a discharge, for the log only: wall time
+  // depends on the machine and whatever else runs on it
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  double hours = (double)(now - start) / F_CPU / 3600;
+  char message[64];
+  snprintf(message, sizeof(message), "%.1f h replayed in %.2f s", hours, wallSeconds);
+  TEST_MESSAGE(message);
+}
+
+void test_presets_follow_their_brightness() {
+  // The setting changed at the 10% clamp; the presets are still estimated
+  for (int i = 0; i < 3; i++) TEST_ASSERT_TRUE(presetRuntimeMinutes[i] > presetRuntimeMinutes[i + 1]);
+  TEST_ASSERT_EQUAL(estimateRuntimeMinutes(presets[2]), presetRuntimeMinutes[2]);
+  TEST_ASSERT_EQUAL(estimateRuntimeMinutes(brightness), runtimeMinutes);
+}
+
+// The frame on the glass once the display task has seen the latest values and
+// everything it asked for has been sent
+std::string settledScreen() {
+  run(50);
+  TEST_ASSERT_TRUE(runUntil([] { return !isDisplayFrameInFlight(); }, 1000));
+  return screen();
+}
+
+// Lines that print several values (the preset runtimes, the 1-Wire timings) are
+// redrawn on a change of any of them, whichever way the values move. Each check
+// follows a change, well before the next one.
+void test_multi_value_lines_match_full_frame() {
+  while (currentMode != MODE_PRESET_SELECT) {
+    click();
+    run(500);
+  }
+  for (int change = 0; change < 5; change++) {
+    uint16_t revision = presetRuntimeRevision;
+    TEST_ASSERT_TRUE(runUntil([revision] { return presetRuntimeRevision != revision; }, 2 * 3600e3));
+    std::string incremental = settledScreen();
+    requestDisplayFrame();
+    TEST_ASSERT_EQUAL_STRING(settledScreen().c_str(), incremental.c_str());
+  }
+  while (currentMode != MODE_STATS) {
+    click();
+    run(500);
+  }
+  turn(DIAGNOSTICS_DETENTS);
+  TEST_ASSERT_EQUAL(SCREEN_DIAGNOSTICS, currentScreen());
+  for (int change = 0; change < 20; change++) {
+    uint16_t revision = tempBusTimingRevision;
+    TEST_ASSERT_TRUE(runUntil([revision] { return tempBusTimingRevision != revision; }, 3 * SENSOR_UPDATE_INTERVAL));
+    std::string incremental = settledScreen();
+    requestDisplayFrame();
+    TEST_ASSERT_EQUAL_STRING(settledScreen().c_str(), incremental.c_str());
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_stats_redraw_matches_full_frame);
+  RUN_TEST(test_estimate_tracks_the_discharge);
+  RUN_TEST(test_presets_follow_their_brightness);
+  RUN_TEST(test_multi_value_lines_match_full_frame);
+  return UNITY_END();
+}
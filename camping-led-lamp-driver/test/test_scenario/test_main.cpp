@@ -0,0 +1,242 @@
+// End-to-end scenario on the host: the firmware against the stub HAL and the
+// battery/heatsink plants. The tests run in order on one simulated lamp, each
+// picking up where the previous one left it.
+#include <unity.h>
+
+#include "lamp_sim.h"
+
+using namespace sim;
+
+void setUp() {}
+void tearDown() {}
+
+#define TEST_ASSERT_SNAPSHOT(name)                                     \
+  do {                                                                 \
+    std::string mismatch = snapshotMismatch(__FILE__, name);           \
+    TEST_ASSERT_TRUE_MESSAGE(mismatch.empty(), mismatch.c_str());      \
+  } while (0)
+
+// The cool channel duty, in percent, for a brightness at the current colour mix
+uint8_t coolPercentOfDuty(uint16_t duty) {
+  return (uint32_t)duty * mixCoolQ8 / 256 / 16 * 100 / TIMER1_PERIOD;
+}
+
+uint8_t expectedCoolPercent(int percent) {
+  return coolPercentOfDuty(brightnessToDuty(percent));
+}
+
+// The highest cool channel duty seen over ms of simulated time
+uint8_t peakCoolPercent(double ms) {
+  uint8_t peak = 0;
+  for (double t = 0; t < ms; t += 10) {
+    run(10);
+    peak = std::max(peak, coolDutyPercent());
+  }
+  return peak;
+}
+
+void test_boot_lights_before_the_first_frame() {
+  setup();
+  run(5);
+  TEST_ASSERT_FALSE(oled.on);
+  TEST_ASSERT_TRUE(bootFirstLightUs > 0);
+  run(195);
+  TEST_ASSERT_TRUE(oled.on);
+  TEST_ASSERT_TRUE(bootFirstLightUs < bootFirstFrameUs);
+  TEST_ASSERT_EQUAL(STATE_OPERATING, currentState);
+  TEST_ASSERT_EQUAL(MODE_SMOOTH_DIM, currentMode);
+  TEST_ASSERT_EQUAL(50, brightness);
+  TEST_ASSERT_EQUAL(0, warmDutyPercent());
+  run(3000);
+  TEST_ASSERT_TRUE(ledSensorFound);
+  TEST_ASSERT_INT_WITHIN(50, 2500, ledTemperature);
+  TEST_ASSERT_EQUAL(100, batteryPercent);
+  TEST_ASSERT_SNAPSHOT("boot");
+}
+
+void test_encoder_dims_up() {
+  turn(10);
+  run(1000);
+  TEST_ASSERT_EQUAL(70, brightness);
+  TEST_ASSERT_UINT_WITHIN(1, expectedCoolPercent(70), coolDutyPercent());
+  TEST_ASSERT_SNAPSHOT("dim_70");
+}
+
+void test_ir_preset_and_power() {
+  ir(IR_CODE_PRESET_4);
+  run(1000);
+  TEST_ASSERT_EQUAL(100, brightness);
+  TEST_ASSERT_UINT_WITHIN(1, expectedCoolPercent(100), coolDutyPercent());
+  ir(IR_CODE_POWER);
+  run(1000);
+  TEST_ASSERT_FALSE(isLampOn);
+  TEST_ASSERT_TRUE(outputsOff());
+  ir(IR_CODE_PRESET_2);  // ignored while off
+  run(5000);
+  // The frame that wakes the sleeping MCU is received in full. Sent between
+  // temperature reads, so the MCU is asleep for it.
+  TEST_ASSERT_TRUE(runUntil([] { return tempPhase == TEMP_IDLE && canPowerDown(millis()); }, 5000));
+  ir(IR_CODE_POWER);
+  run(1000);
+  TEST_ASSERT_TRUE(isLampOn);
+  TEST_ASSERT_TRUE(irLeaderMeasuredUs < 9000);
+  TEST_ASSERT_TRUE(irLeaderMeasuredUs > 8990);
+  TEST_ASSERT_EQUAL(0, irFramesMissed);
+  TEST_ASSERT_EQUAL(100, brightness);
+  ir(IR_CODE_PRESET_2);
+  run(1000);
+  TEST_ASSERT_EQUAL(25, brightness);
+  TEST_ASSERT_UINT_WITHIN(1, expectedCoolPercent(25), coolDutyPercent());
+}
+
+// Saving an edited preset blinks twice at its new level, then hands the output
+// back to the setting. Edited up and back down, so the presets end as they were.
+void test_saved_preset_blinks() {
+  uint8_t steady = coolDutyPercent();
+  click();
+  run(500);
+  TEST_ASSERT_EQUAL(MODE_PRESET_SELECT, currentMode);
+  TEST_ASSERT_TRUE(highlightedPreset < 4);
+  int original = presets[highlightedPreset];
+  for (int detents : {5, -5}) {
+    press(PRESET_EDIT_HOLD_MS + 200);
+    TEST_ASSERT_TRUE(isEditingPreset);
+    turn(detents);
+    int saved = presets[highlightedPreset];
+    TEST_ASSERT_EQUAL(detents > 0 ? original + 10 : original, saved);
+    click();  // the blinks start on the release, 50 ms before this returns
+    TEST_ASSERT_FALSE(isEditingPreset);
+    int blinks = 0;
+    bool wasOn = false;
+    while (isPatternActive()) {
+      bool on = coolDutyPercent() > 0;
+      if (on) TEST_ASSERT_UINT_WITHIN(1, expectedCoolPercent(saved), coolDutyPercent());
+      blinks += on && !wasOn;
+      wasOn = on;
+      run(10);
+    }
+    TEST_ASSERT_EQUAL(PRESET_SAVED_BLINKS, blinks);
+    TEST_ASSERT_EQUAL(steady, coolDutyPercent());
+  }
+  for (int i = 0; i < 3; i++) {
+    click();
+    run(500);
+  }
+  TEST_ASSERT_EQUAL(MODE_SMOOTH_DIM, currentMode);
+}
+
+void test_click_cycles_modes() {
+  static const char* const names[] = {"mode_presets", "mode_stats", "mode_colour"};
+  static const LampMode modes[] = {MODE_PRESET_SELECT, MODE_STATS, MODE_COLOR_TEMP};
+  for (int i = 0; i < 3; i++) {
+    click();
+    run(500);
+    TEST_ASSERT_EQUAL(modes[i], currentMode);
+    TEST_ASSERT_SNAPSHOT(names[i]);
+    if (modes[i] == MODE_STATS) {
+      // Only a deliberate turn flips the page, and a detent back does not undo it
+      turn(DIAGNOSTICS_DETENTS - 1);
+      TEST_ASSERT_EQUAL(SCREEN_STATS, currentScreen());
+      turn(1);
+      TEST_ASSERT_EQUAL(SCREEN_DIAGNOSTICS, currentScreen());
+      turn(5);
+      turn(-(DIAGNOSTICS_DETENTS - 1));
+      TEST_ASSERT_EQUAL(SCREEN_DIAGNOSTICS, currentScreen());
+      turn(-1);
+      TEST_ASSERT_EQUAL(SCREEN_STATS, currentScreen());
+      turn(-5);
+      TEST_ASSERT_EQUAL(SCREEN_STATS, currentScreen());
+    }
+  }
+  click();
+  run(500);
+  TEST_ASSERT_EQUAL(MODE_SMOOTH_DIM, currentMode);
+}
+
+void test_thermal_limit_holds_below_cutoff() {
+  heatsink.ambientC = 45;
+  ir(IR_CODE_PRESET_4);
+  double peak = 0;
+  for (int i = 0; i < 900; i++) {
+    run(1000);
+    peak = std::max(peak, heatsink.tempC);
+  }
+  TEST_ASSERT_TRUE(isLampOn);
+  TEST_ASSERT_FALSE(isOverheatCritical);
+  TEST_ASSERT_TRUE(isOverheatWarn);
+  TEST_ASSERT_TRUE(thermalCeiling < 100);
+  TEST_ASSERT_TRUE(coolDutyPercent() > 0 && coolDutyPercent() < 100);
+  TEST_ASSERT_TRUE(peak < 75);
+  TEST_ASSERT_SNAPSHOT("overheat_warn");
+
+  // A notification flash goes up to the thermal ceiling (which the governor may
+  // move meanwhile) and no further
+  playBlinkPattern(3, 400, 100);
+  int closest = 100;
+  for (int t = 0; t < 1500; t += 10) {
+    run(10);
+    TEST_ASSERT_TRUE(patternCeilingDuty < brightnessToDuty(100));
+    int headroom = coolPercentOfDuty(patternCeilingDuty) - coolDutyPercent();
+    TEST_ASSERT_TRUE(headroom >= -1);
+    closest = std::min(closest, headroom);
+  }
+  TEST_ASSERT_TRUE(closest <= 1);
+}
+
+void test_heat_gun_forces_cutoff_and_recovers() {
+  heatsink.ambientC = 80;
+  heatsink.tempC = 80;
+  playBlinkPattern(200, 400, 100);
+  TEST_ASSERT_TRUE(runUntil([] { return isOverheatCritical; }, 10000));
+  run(500);
+  TEST_ASSERT_FALSE(isPatternActive());
+  TEST_ASSERT_TRUE(outputsOff());
+  TEST_ASSERT_SNAPSHOT("overheat_critical");
+
+  heatsink.ambientC = 25;
+  TEST_ASSERT_TRUE(runUntil([] { return !isOverheatCritical; }, 600000));
+  TEST_ASSERT_TRUE(heatsink.tempC <= 55.5);
+  run(2000);
+  TEST_ASSERT_FALSE(outputsOff());
+}
+
+void test_discharge_warns_then_shuts_down() {
+  heatsink.ambientC = 25;
+  heatsink.tempC = 25;
+  battery.chargeMah = battery.capacityMah * 0.3;
+  TEST_ASSERT_TRUE(runUntil([] { return low10Handled; }, 4 * 3600e3));
+  TEST_ASSERT_TRUE(isPatternActive());
+  TEST_ASSERT_EQUAL(brightnessForPower(10), brightness);
+  TEST_ASSERT_UINT_WITHIN(1, expectedCoolPercent(brightness), peakCoolPercent(4000));
+  TEST_ASSERT_TRUE(runUntil([] { return currentState == STATE_LOW_BATTERY; }, 12 * 3600e3));
+  // After the flashes the light dims out instead of cutting off
+  TEST_ASSERT_TRUE(runUntil([] { return lowBatteryPhase == LOW_BATTERY_DIMMING; }, 10000));
+  unsigned long dimStart = millis();
+  uint16_t from = brightnessToDuty(brightnessForPower(10));
+  uint16_t previous = patternDuty;
+  TEST_ASSERT_TRUE(previous <= from && previous > from * 9 / 10);
+  while (lowBatteryPhase == LOW_BATTERY_DIMMING) {
+    run(10);
+    TEST_ASSERT_TRUE(!isPatternActive() || patternDuty <= previous);
+    previous = patternDuty;
+  }
+  TEST_ASSERT_UINT_WITHIN(2 * PATTERN_TICK_MS, LOW_BATTERY_DIM_MS, millis() - dimStart);
+  TEST_ASSERT_TRUE(outputsOff());
+  run(30000);
+  TEST_ASSERT_TRUE(halted);
+  TEST_ASSERT_TRUE(outputsOff());
+  TEST_ASSERT_FALSE(oled.on);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_boot_lights_before_the_first_frame);
+  RUN_TEST(test_encoder_dims_up);
+  RUN_TEST(test_ir_preset_and_power);
+  RUN_TEST(test_saved_preset_blinks);
+  RUN_TEST(test_click_cycles_modes);
+  RUN_TEST(test_thermal_limit_holds_below_cutoff);
+  RUN_TEST(test_heat_gun_forces_cutoff_and_recovers);
+  RUN_TEST(test_discharge_warns_then_shuts_down);
+  return UNITY_END();
+}
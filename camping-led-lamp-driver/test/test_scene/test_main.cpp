@@ -0,0 +1,243 @@
+// The built-in scenes on the firmware's own engine: sceneTick() called once per
+// 8 ms engine tick (the simulator is not run, so the Timer1 interrupt does not
+// tick them as well), checked against the .expect and .event lines of
+// tools/scenes/*.scene and against their timing. Every byte the engine reads from
+// flash is traced, so each tick's instructions are counted.
+#include <unity.h>
+
+#include "lamp_sim.h"
+
+using namespace sim;
+
+void setUp() {}
+void tearDown() {}
+
+const uint16_t SCENE_RANDOM_SEED = 0xACE1;  // sceneRandom at power-on, as in tools/sceneasm.py
+const uint32_t TICKS_PER_MINUTE = 60UL * SCENE_TICKS_PER_SECOND;
+// Opcode and operand bytes of each instruction, by opcode
+const uint8_t INSTRUCTION_SIZE[] = {1, 1, 2, 4, 3, 5, 3, 2, 2, 3};
+
+std::vector<const uint8_t*> flashReads;
+int worstInstructions = 0;
+
+void traceRead(const void* address) { flashReads.push_back((const uint8_t*)address); }
+
+void startTracedScene(uint8_t index) {
+  sceneRandom = SCENE_RANDOM_SEED;
+  sceneRequestsOff = false;
+  startScene(index);
+}
+
+// One engine tick; returns the number of instructions it ran
+int tick() {
+  const uint8_t* program = scene.program;
+  flashReads.clear();
+  pgmReadHook = traceRead;
+  sceneTick();
+  pgmReadHook = nullptr;
+
+  int instructions = 0;
+  uint8_t op = SCENE_END;
+  for (size_t i = 0; i < flashReads.size(); i += INSTRUCTION_SIZE[op]) {
+    TEST_ASSERT_TRUE(flashReads[i] >= program && flashReads[i] < program + 256);
+    op = *flashReads[i];
+    TEST_ASSERT_TRUE(op < sizeof(INSTRUCTION_SIZE));
+    // The operands are the bytes after the opcode
+    for (uint8_t j = 1; j < INSTRUCTION_SIZE[op] && i + j < flashReads.size(); j++) {
+      TEST_ASSERT_TRUE(flashReads[i + j] == flashReads[i] + j);
+    }
+    instructions++;
+  }
+  TEST_ASSERT_TRUE(instructions <= SCENE_STEPS_PER_TICK);
+  // A tick that ran out of steps leaves the rest for the next one, late: the
+  // built-in scenes always reach a timed instruction, a wait or their end
+  if (instructions == SCENE_STEPS_PER_TICK && scene.program != NULL) {
+    TEST_ASSERT_TRUE(scene.ticksLeft != 0 || scene.op == SCENE_WAIT);
+  }
+  worstInstructions = std::max(worstInstructions, instructions);
+  return instructions;
+}
+
+uint8_t intensity() { return scene.levelQ16 >> 16; }
+
+// --- The scene sources ---
+struct SceneFile {
+  std::vector<std::pair<uint32_t, std::string>> expects;  // (ms, check)
+  std::vector<std::pair<uint32_t, uint8_t>> events;       // (ms, mask)
+};
+
+uint32_t parseMs(const std::string& text) {
+  size_t digits;
+  uint32_t value = std::stoul(text, &digits);
+  std::string unit = text.substr(digits);
+  if (unit == "min") return value * 60000;
+  if (unit == "s") return value * 1000;
+  TEST_ASSERT_TRUE(unit == "" || unit == "ms");
+  return value;
+}
+
+SceneFile readSceneFile(uint8_t index) {
+  char name[SCENE_NAME_SIZE];
+  sceneName(name, index);
+  std::string path = __FILE__;
+  path = path.substr(0, path.find_last_of("/\\") + 1) + "../../tools/scenes/";
+  for (char* c = name; *c; c++) path += (char)tolower(*c);
+  path += ".scene";
+  std::ifstream file(path);
+  TEST_ASSERT_TRUE_MESSAGE(file.good(), path.c_str());
+
+  SceneFile scene;
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream words(line.substr(0, line.find(';')));
+    std::string directive, time, value;
+    words >> directive >> time >> value;
+    if (directive == ".expect") scene.expects.emplace_back(parseMs(time), value);
+    if (directive == ".event") {
+      TEST_ASSERT_TRUE(value == "input");
+      scene.events.emplace_back(parseMs(time), SCENE_EVENT_INPUT);
+    }
+  }
+  std::sort(scene.expects.begin(), scene.expects.end());
+  std::sort(scene.events.begin(), scene.events.end());
+  TEST_ASSERT_FALSE(scene.expects.empty());
+  return scene;
+}
+
+// "end", "off", LEVEL or LOW..HIGH, as tools/sceneasm.py checks it
+bool matches(const std::string& check) {
+  if (scene.program == NULL) return check == (sceneRequestsOff ? "off" : "end");
+  size_t dots = check.find("..");
+  if (!isdigit((unsigned char)check[0])) return false;
+  int low = std::stoi(check.substr(0, dots));
+  int high = dots == std::string::npos ? low : std::stoi(check.substr(dots + 2));
+  return low <= intensity() && intensity() <= high;
+}
+
+void test_scenes_meet_their_expectations() {
+  boot();
+  for (uint8_t index = 0; index < SCENE_COUNT; index++) {
+    SceneFile source = readSceneFile(index);
+    startTracedScene(index);
+    size_t nextExpect = 0, nextEvent = 0;
+    // Tick n is at n * 8 ms, events first; an expectation holds after its tick
+    for (uint32_t ticks = 0; nextExpect < source.expects.size(); ticks++) {
+      uint32_t ms = ticks * PATTERN_TICK_MS;
+      while (nextEvent < source.events.size() && source.events[nextEvent].first <= ms) {
+        postSceneEvent(source.events[nextEvent++].second);
+      }
+      if (scene.program != NULL) tick();
+      while (nextExpect < source.expects.size() && source.expects[nextExpect].first / PATTERN_TICK_MS == ticks) {
+        char message[64];
+        snprintf(message, sizeof(message), "scene %d at %lu ms: expected %s, intensity %d", index,
+                 (unsigned long)source.expects[nextExpect].first, source.expects[nextExpect].second.c_str(),
+                 intensity());
+        TEST_ASSERT_TRUE_MESSAGE(matches(source.expects[nextExpect].second), message);
+        nextExpect++;
+      }
+    }
+    stopScene();
+  }
+  char message[48];
+  snprintf(message, sizeof(message), "at most %d instructions in a tick", worstInstructions);
+  TEST_MESSAGE(message);
+}
+
+void test_sos_timing() {
+  TEST_ASSERT_TRUE(isLampOn);
+  startTracedScene(2);
+  // On and off stretches in 200 ms units: S, O, S and the word gap, twice
+  const int units[] = {1, 1, 1, 1, 1, 3, 3, 1, 3, 1, 3, 3, 1, 1, 1, 1, 1, 7};
+  const uint32_t UNIT_TICKS = 200 / PATTERN_TICK_MS;
+  tick();
+  for (int round = 0; round < 2; round++) {
+    for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+      bool on = i % 2 == 0;
+      for (uint32_t t = 0; t < units[i] * UNIT_TICKS; t++) {
+        TEST_ASSERT_EQUAL(on ? 255 : 0, intensity());
+        // Full intensity is the steady output, none is dark
+        TEST_ASSERT_EQUAL(on ? outputDuty : 0, sceneDuty);
+        tick();
+      }
+    }
+  }
+  TEST_ASSERT_EQUAL(255, intensity());
+  stopScene();
+}
+
+void test_sunrise_ramps_up_and_ends_on_input() {
+  startTracedScene(1);
+  tick();
+  TEST_ASSERT_EQUAL(0, intensity());
+  uint8_t last = 0;
+  uint16_t lastDuty = sceneDuty;
+  for (uint32_t t = 1; t <= 30 * TICKS_PER_MINUTE; t++) {
+    tick();
+    TEST_ASSERT_TRUE(intensity() >= last);
+    TEST_ASSERT_TRUE(sceneDuty >= lastDuty);
+    if (t == 10 * TICKS_PER_MINUTE) TEST_ASSERT_EQUAL(40, intensity());
+    last = intensity();
+    lastDuty = sceneDuty;
+  }
+  TEST_ASSERT_EQUAL(255, intensity());
+  TEST_ASSERT_EQUAL(outputDuty, sceneDuty);
+  // The pulse stays between its two levels until the lamp is touched
+  for (uint32_t t = 0; t < TICKS_PER_MINUTE; t++) {
+    tick();
+    TEST_ASSERT_TRUE(intensity() >= 170);
+  }
+  postSceneEvent(SCENE_EVENT_INPUT);
+  for (uint32_t t = 0; t < 4 * SCENE_TICKS_PER_SECOND && scene.program != NULL; t++) tick();
+  TEST_ASSERT_FALSE(isSceneActive());
+  TEST_ASSERT_FALSE(sceneRequestsOff);
+}
+
+void test_candle_stays_in_bounds_and_repeats() {
+  std::vector<uint8_t> first;
+  for (int run = 0; run < 2; run++) {
+    startTracedScene(0);
+    for (uint32_t t = 0; t < 5 * TICKS_PER_MINUTE; t++) {
+      tick();
+      TEST_ASSERT_TRUE(intensity() >= 70 && intensity() <= 230);
+      // From the same seed the flame is the same
+      if (run == 0) first.push_back(intensity());
+      else TEST_ASSERT_EQUAL(first[t], intensity());
+    }
+    stopScene();
+  }
+  // And it does move
+  TEST_ASSERT_TRUE(*std::min_element(first.begin(), first.end()) < 130);
+  TEST_ASSERT_TRUE(*std::max_element(first.begin(), first.end()) > 200);
+}
+
+void test_sleep_fades_out_then_switches_off() {
+  startTracedScene(3);
+  for (uint32_t t = 0; t < 10 * TICKS_PER_MINUTE; t++) {
+    tick();
+    TEST_ASSERT_EQUAL(255, intensity());
+  }
+  uint8_t last = 255;
+  for (uint32_t t = 0; t < 20 * TICKS_PER_MINUTE; t++) {
+    tick();
+    TEST_ASSERT_TRUE(intensity() <= last);
+    TEST_ASSERT_TRUE(isSceneActive());
+    last = intensity();
+  }
+  TEST_ASSERT_EQUAL(0, intensity());
+  TEST_ASSERT_EQUAL(0, sceneDuty);
+  TEST_ASSERT_FALSE(sceneRequestsOff);
+  TEST_ASSERT_EQUAL(1, tick());
+  TEST_ASSERT_FALSE(isSceneActive());
+  TEST_ASSERT_TRUE(sceneRequestsOff);
+  sceneRequestsOff = false;
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_scenes_meet_their_expectations);
+  RUN_TEST(test_sos_timing);
+  RUN_TEST(test_sunrise_ramps_up_and_ends_on_input);
+  RUN_TEST(test_candle_stays_in_bounds_and_repeats);
+  RUN_TEST(test_sleep_fades_out_then_switches_off);
+  return UNITY_END();
+}
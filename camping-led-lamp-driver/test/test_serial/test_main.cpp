@@ -0,0 +1,109 @@
+// The serial protocol against a host on the simulated UART: commands sent in the
+// middle of a telemetry log dump are still read and answered.
+#include <unity.h>
+
+#include "lamp_sim.h"
+
+using namespace sim;
+
+void setUp() {}
+void tearDown() {}
+
+std::vector<uint8_t> frame(uint8_t type, std::vector<uint8_t> payload = {}) {
+  std::vector<uint8_t> out;
+  out.reserve(FRAME_OVERHEAD + payload.size());
+  out.push_back(FRAME_SYNC);
+  out.push_back(type);
+  out.push_back(payload.size());
+  for (uint8_t byte : payload) out.push_back(byte);
+  uint8_t crc = 0;
+  for (size_t i = 1; i < out.size(); i++) crc = _crc8_ccitt_update(crc, out[i]);
+  out.push_back(crc);
+  return out;
+}
+
+// Frame types received so far, in order, and the dump bytes they carried
+std::vector<uint8_t> receivedTypes(size_t* dumpBytes) {
+  std::vector<uint8_t> types;
+  *dumpBytes = 0;
+  size_t i = 0;
+  while (i + 3 <= hostReceived.size() && i + FRAME_OVERHEAD + hostReceived[i + 2] <= hostReceived.size()) {
+    TEST_ASSERT_EQUAL(FRAME_SYNC, hostReceived[i]);
+    uint8_t length = hostReceived[i + 2];
+    types.push_back(hostReceived[i + 1]);
+    if (hostReceived[i + 1] == FRAME_LOG_CHUNK) *dumpBytes += length;
+    i += FRAME_OVERHEAD + length;
+  }
+  return types;
+}
+
+void test_commands_are_answered_during_a_dump() {
+  boot();
+  run(1000);
+  hostReceived.clear();
+  send(frame(FRAME_LOG_DUMP));
+  run(20);
+  TEST_ASSERT_TRUE(logDumpActive);
+  // More than the RX ring holds, back to back
+  const int queries = 10;
+  for (int i = 0; i < queries; i++) send(frame(FRAME_QUERY_STATE));
+  send(frame(FRAME_SET_BRIGHTNESS, {40}));
+  TEST_ASSERT_TRUE(runUntil([] { return !logDumpActive && isSerialIdle(); }, 2000));
+
+  size_t dumpBytes;
+  std::vector<uint8_t> types = receivedTypes(&dumpBytes);
+  TEST_ASSERT_EQUAL(0, uartRxDropped);
+  TEST_ASSERT_EQUAL(LOG_DUMP_SIZE, dumpBytes);
+  TEST_ASSERT_EQUAL(FRAME_ACK, types.front());
+  TEST_ASSERT_EQUAL(FRAME_LOG_CHUNK, types.back());
+  // Every command answered, and before the dump finished
+  int acks = 0, states = 0;
+  size_t lastAnswer = 0;
+  for (size_t i = 1; i < types.size(); i++) {
+    if (types[i] == FRAME_LOG_CHUNK) continue;
+    acks += types[i] == FRAME_ACK;
+    states += types[i] == FRAME_STATE;
+    lastAnswer = i;
+  }
+  TEST_ASSERT_EQUAL(queries, states);
+  TEST_ASSERT_EQUAL(1, acks);
+  TEST_ASSERT_TRUE(lastAnswer < types.size() - 10);
+  TEST_ASSERT_EQUAL(40, brightness);
+}
+
+// The status of the one ACK the host has received
+uint8_t ackStatus() {
+  TEST_ASSERT_EQUAL(FRAME_ACK, hostReceived[1]);
+  TEST_ASSERT_EQUAL(FRAME_SET_FADE_RATE, hostReceived[3]);
+  return hostReceived[4];
+}
+
+// The fade rate is set over the serial link and survives a restart
+void test_fade_rate_is_set_and_saved() {
+  static const std::vector<uint8_t> bad[] = {{100}, {0, 0}, {0xE9, 0x03}, {100, 0, 0}};
+  for (const std::vector<uint8_t>& payload : bad) {
+    hostReceived.clear();
+    send(frame(FRAME_SET_FADE_RATE, payload));
+    TEST_ASSERT_TRUE(runUntil([] { return hostReceived.size() == FRAME_OVERHEAD + 2; }, 100));
+    TEST_ASSERT_EQUAL(FRAME_STATUS_BAD_ARGUMENT, ackStatus());
+  }
+  TEST_ASSERT_EQUAL(fadeStepForRate(FADE_RATE_PERCENT_PER_SEC), fadeStep);
+
+  hostReceived.clear();
+  send(frame(FRAME_SET_FADE_RATE, {100, 0}));
+  TEST_ASSERT_TRUE(runUntil([] { return hostReceived.size() == FRAME_OVERHEAD + 2; }, 100));
+  TEST_ASSERT_EQUAL(FRAME_STATUS_OK, ackStatus());
+  TEST_ASSERT_EQUAL(fadeStepForRate(100), fadeStep);
+  run(SETTINGS_SETTLE_MS + 1000);
+  TEST_ASSERT_TRUE(isEepromIdle());
+  fadeStep = fadeStepForRate(FADE_RATE_PERCENT_PER_SEC);
+  restoreSettings();
+  TEST_ASSERT_EQUAL(fadeStepForRate(100), fadeStep);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_commands_are_answered_during_a_dump);
+  RUN_TEST(test_fade_rate_is_set_and_saved);
+  return UNITY_END();
+}
@@ -0,0 +1,64 @@
+// The state-of-charge estimator's open-circuit voltage against the battery plant's:
+// the loaded reading is taken at one point of the PWM cycle, so the sag to remove
+// is that of the current flowing there, whatever the output is driven by.
+#include <unity.h>
+
+#include "lamp_sim.h"
+
+using namespace sim;
+
+void setUp() {}
+void tearDown() {}
+
+const double OCV_TOLERANCE_MV = 15;
+
+double worstOcvErrorMv = 0;
+
+void checkOcv(const char* what) {
+  double error = std::abs(batteryOcvMillivolts - battery.ocvMv());
+  worstOcvErrorMv = std::max(worstOcvErrorMv, error);
+  char message[80];
+  snprintf(message, sizeof(message), "%s: estimated %d mV, plant %.0f mV", what, batteryOcvMillivolts,
+           battery.ocvMv());
+  TEST_ASSERT_TRUE_MESSAGE(error <= OCV_TOLERANCE_MV, message);
+}
+
+void test_ocv_at_each_preset() {
+  boot();
+  run(1000);
+  TEST_ASSERT_TRUE(isLampOn);
+  // Stepping between presets is what the pack resistance is learned from
+  const uint32_t codes[] = {IR_CODE_PRESET_1, IR_CODE_PRESET_2, IR_CODE_PRESET_3, IR_CODE_PRESET_4};
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < 4; i++) {
+      ir(codes[i]);
+      run(30000);
+      TEST_ASSERT_EQUAL(presets[i], brightness);
+      char what[24];
+      snprintf(what, sizeof(what), "preset %d", i + 1);
+      checkOcv(what);
+    }
+  }
+}
+
+void test_ocv_while_a_scene_plays() {
+  ir(IR_CODE_PRESET_2);
+  run(30000);
+  ir(IR_CODE_SCENE_1);
+  run(1000);
+  TEST_ASSERT_TRUE(isSceneActive());
+  for (int i = 0; i < 60; i++) {
+    run(2000);
+    checkOcv("scene");
+  }
+  char message[48];
+  snprintf(message, sizeof(message), "worst OCV error %.1f mV", worstOcvErrorMv);
+  TEST_MESSAGE(message);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_ocv_at_each_preset);
+  RUN_TEST(test_ocv_while_a_scene_plays);
+  return UNITY_END();
+}
@@ -0,0 +1,174 @@
+// The thermal governor against the three-state derating it replaced, on the same
+// heatsink plant: at 100% requested for an hour, the governor must deliver more
+// light on average and never reach the 75 C cutoff.
+#include <unity.h>
+
+#include "lamp_sim.h"
+
+using namespace sim;
+
+void setUp() {}
+void tearDown() {}
+
+const double RUN_SECONDS = 3600;
+
+// The old derating: at 65 C cap at 50%, at 75 C off, both until 55 C. Read every
+// 2 s, with the output linear in brightness. Full power is the firmware's, so the
+// two drive the same LEDs.
+struct ThreeStateBaseline {
+  HeatsinkPlant plant;
+  bool warn = false;
+  bool critical = false;
+
+  // Average LED power over the run
+  double run(double ambientC, double fullPower) {
+    plant.ambientC = plant.tempC = ambientC;
+    double energy = 0;
+    for (double t = 0; t < RUN_SECONDS; t += 2) {
+      double temp = std::floor(plant.tempC * 16) / 16;  // DS18B20 steps
+      if (critical) {
+        if (temp <= 55) critical = warn = false;
+      } else if (temp >= 75) {
+        critical = warn = true;
+      } else if (warn) {
+        if (temp <= 55) warn = false;
+      } else if (temp >= 65) {
+        warn = true;
+      }
+      double power = critical ? 0 : warn ? fullPower / 2 : fullPower;
+      for (int ms = 0; ms < 2000; ms++) plant.step(0.001, power);
+      energy += power * 2;
+    }
+    return energy / RUN_SECONDS;
+  }
+};
+
+struct GovernedRun {
+  double averagePower;
+  double peakC;
+  double runtimeRatio;  // estimate / plant's remaining charge at its draw, at the end
+};
+
+// The firmware at 100% from a heatsink at startC, the lamp switched off between runs
+GovernedRun runGoverned(double ambientC, double startC) {
+  heatsink.ambientC = ambientC;
+  heatsink.tempC = startC;
+  heatsink.tauSeconds = 1e9;  // held while the sensor and the governor settle
+  // Each run on a full pack, before the 10% clamp. Swapped once two readings have
+  // been taken with the lamp off, so the jump is not learned as pack resistance.
+  // At a steady load the jump looks like a charger, so the run starts once the
+  // firmware has seen that "charge" end.
+  run(2 * SENSOR_IDLE_INTERVAL);
+  battery.chargeMah = battery.capacityMah;
+  run(60000);
+  TEST_ASSERT_TRUE(runUntil([] { return currentState == STATE_OPERATING; }, 3 * 3600e3));
+  heatsink.tauSeconds = 120;
+  ir(IR_CODE_POWER);
+  run(200);
+  TEST_ASSERT_TRUE(isLampOn);
+  TEST_ASSERT_EQUAL(100, brightness);
+  GovernedRun result = {0, 0, 0};
+  for (double t = 0; t < RUN_SECONDS; t += 0.1) {
+    run(100);
+    result.averagePower += ledPower() * 0.1;
+    result.peakC = std::max(result.peakC, heatsink.tempC);
+  }
+  result.averagePower /= RUN_SECONDS;
+  result.runtimeRatio = runtimeMinutes / (battery.chargeMah / averageCurrentMa() * 60);
+  ir(IR_CODE_POWER);
+  run(200);
+  TEST_ASSERT_FALSE(isLampOn);
+  return result;
+}
+
+void checkAmbient(double ambientC) {
+  GovernedRun governed = runGoverned(ambientC, ambientC);
+  TEST_ASSERT_FALSE(isOverheatCritical);
+  TEST_ASSERT_TRUE(governed.peakC < 75);
+
+  double fullPower = (double)brightnessToDuty(100) * colorMixPowerQ8 / 256 / 16 / TIMER1_PERIOD;
+  ThreeStateBaseline baseline;
+  double baselinePower = baseline.run(ambientC, fullPower);
+  char message[80];
+  snprintf(message, sizeof(message), "%.0f C: governed %.3f, three-state %.3f, peak %.1f C, runtime x%.2f",
+           ambientC, governed.averagePower, baselinePower, governed.peakC, governed.runtimeRatio);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE_MESSAGE(governed.averagePower > baselinePower, message);
+  // The estimate is for the limited output, not the 100% asked for
+  TEST_ASSERT_TRUE_MESSAGE(std::abs(governed.runtimeRatio - 1) <= 0.2, message);
+}
+
+void test_mild_night() { checkAmbient(25); }
+void test_warm_night() { checkAmbient(35); }
+void test_hot_enclosure() { checkAmbient(40); }
+
+// Switched back on while still hot: the integrator starts from full and must not
+// carry the output through the cutoff
+void test_relight_while_hot() {
+  GovernedRun governed = runGoverned(35, 66);
+  TEST_ASSERT_FALSE(isOverheatCritical);
+  TEST_ASSERT_TRUE(governed.peakC < 75);
+}
+
+// Full output drives the brighter channel of every mix at full duty, and is within
+// the governor's full ceiling, so a cool lamp at 100% is not flagged as limited
+// on any colour temperature. WARMER walks the mix over to the warm channel.
+void test_full_output_is_not_a_thermal_limit() {
+  for (uint8_t step = 0; step < CCT_STEPS; step++) {
+    setColorTempStep(step);
+    TEST_ASSERT_EQUAL(256, std::max((uint16_t)mixCoolQ8, (uint16_t)mixWarmQ8));
+  }
+  setColorTempStep(CCT_STEPS - 1);
+  heatsink.ambientC = heatsink.tempC = 25;
+  run(60000);
+  ir(IR_CODE_POWER);
+  run(5000);
+  TEST_ASSERT_TRUE(isLampOn);
+  TEST_ASSERT_EQUAL(PWM_TOP, OCR1A);
+  TEST_ASSERT_EQUAL(0, warmDutyPercent());
+  for (uint8_t step = CCT_STEPS - 1; step > 0; step--) {
+    ir(IR_CODE_WARMER);
+    run(300);
+    TEST_ASSERT_EQUAL(step - 1, colorTempStep);
+    TEST_ASSERT_EQUAL(PWM_TOP, std::max((uint16_t)OCR1A, (uint16_t)OCR1B));
+    TEST_ASSERT_EQUAL(100, thermalCeiling);
+    TEST_ASSERT_FALSE(isOverheatWarn);
+    TEST_ASSERT_EQUAL(100, brightnessCeiling);
+  }
+  TEST_ASSERT_EQUAL(0, coolDutyPercent());
+  TEST_ASSERT_EQUAL(PWM_TOP, OCR1B);
+  ir(IR_CODE_POWER);
+  run(200);
+}
+
+// The 10 % battery clamp and the charging cap are one channel's power: the full
+// level on a single-channel step, less where both channels share it
+void test_power_caps_follow_the_mix() {
+  for (uint8_t step = 0; step < CCT_STEPS; step++) {
+    setColorTempStep(step);
+    for (uint8_t percent : {10, 50, 100}) {
+      uint8_t allowed = brightnessForPower(percent);
+      TEST_ASSERT_TRUE(allowed <= percent);
+      TEST_ASSERT_TRUE((uint32_t)brightnessToDuty(allowed) * colorMixPowerQ8 <= (uint32_t)brightnessToDuty(percent) * 256);
+      if (mixCoolQ8 == 0 || mixWarmQ8 == 0) TEST_ASSERT_EQUAL(percent, allowed);
+      else TEST_ASSERT_TRUE(allowed < percent);
+    }
+  }
+  setColorTempStep(CCT_STEPS - 1);
+}
+
+int main() {
+  boot();
+  ir(IR_CODE_PRESET_4);
+  run(1000);
+  ir(IR_CODE_POWER);
+  run(1000);
+  UNITY_BEGIN();
+  RUN_TEST(test_mild_night);
+  RUN_TEST(test_warm_night);
+  RUN_TEST(test_hot_enclosure);
+  RUN_TEST(test_relight_while_hot);
+  RUN_TEST(test_full_output_is_not_a_thermal_limit);
+  RUN_TEST(test_power_caps_follow_the_mix);
+  return UNITY_END();
+}
@@ -0,0 +1,74 @@
+"""Host tests for tools/cct_tables.py.
+
+The firmware scales each mix to duty + duty / 128 per channel (see
+setColorTempStep() in src/main.cpp), so a channel at 255 is exactly full duty.
+Run from the project root:
+
+    python3 -m unittest discover -s test/tools
+"""
+import os
+import subprocess
+import sys
+import unittest
+
+TOOLS = os.path.join(os.path.dirname(__file__), "..", "..", "tools")
+SOURCE = os.path.join(os.path.dirname(__file__), "..", "..", "src", "main.cpp")
+sys.path.insert(0, TOOLS)
+
+import cct_tables  # noqa: E402
+
+
+def q8(duty):
+    return duty + (duty >> 7)
+
+
+def build(*argv):
+    return cct_tables.build(cct_tables.parse_args(list(argv)))
+
+
+class TableTest(unittest.TestCase):
+    def check(self, table):
+        for kelvin, cool, warm, _, _ in table:
+            # Full output is the brighter channel at full duty
+            self.assertEqual(256, max(q8(cool), q8(warm)), "%d K" % kelvin)
+        mixes = [(cool, warm) for _, cool, warm, _, _ in table]
+        self.assertEqual(len(mixes), len(set(mixes)))
+
+    def test_default_table(self):
+        table = build()
+        self.check(table)
+        self.assertEqual(list(range(2700, 6501, 200)), [row[0] for row in table])
+        # The ends are one channel each, everything between mixes both
+        self.assertEqual((0, 255), table[0][1:3])
+        self.assertEqual((255, 0), table[-1][1:3])
+        for kelvin, cool, warm, mixed, power in table[1:-1]:
+            self.assertGreater(cool, 0, "%d K" % kelvin)
+            self.assertGreater(warm, 0, "%d K" % kelvin)
+            self.assertGreater(power, 1, "%d K" % kelvin)
+        # With no flux figures neither channel is preferred: the mix is on the step
+        for kelvin, _, _, mixed, _ in table:
+            self.assertAlmostEqual(1e6 / kelvin, 1e6 / mixed, delta=1, msg="%d K" % kelvin)
+
+    def test_more_efficient_channel_takes_the_band(self):
+        for cool_lm, warm_lm, towards in (("180", "200", 1), ("200", "180", -1)):
+            table = build("--cool-lm", cool_lm, "--warm-lm", warm_lm)
+            self.check(table)
+            for kelvin, cool, warm, mixed, _ in table:
+                # Mixes sit at the efficient edge of the +-5 mired band, or at
+                # the end of the range where the band runs past it
+                offset = 1e6 / mixed - 1e6 / kelvin
+                edge = 1e6 / kelvin + 5 * towards
+                if 1e6 / 6500 < edge < 1e6 / 2700:
+                    self.assertAlmostEqual(5 * towards, offset, delta=0.01, msg="%d K" % kelvin)
+                else:
+                    self.assertEqual(0, warm if towards < 0 else cool, "%d K" % kelvin)
+
+    def test_source_is_up_to_date(self):
+        block = subprocess.run([sys.executable, os.path.join(TOOLS, "cct_tables.py")],
+                               check=True, capture_output=True, text=True).stdout
+        with open(SOURCE) as f:
+            self.assertIn(block, f.read())
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,217 @@
+"""Host tests for tools/lampctl.py over a pseudo-terminal.
+
+lampctl talks to one end of a pty, and a scripted lamp answers frames on the
+other, so the framing, retries and streams run through a real tty. pyserial is
+not needed: the pty is opened directly, and the command line tests get a
+stand-in serial module that does the same. Run from the project root:
+
+    python3 -m unittest discover -s test/tools
+"""
+import contextlib
+import io
+import os
+import select
+import struct
+import sys
+import threading
+import time
+import tty
+import types
+import unittest
+from unittest import mock
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), "..", "..", "tools"))
+
+import lampctl  # noqa: E402
+
+
+class PtyLink:
+    """The host end, with pyserial's read(size)-with-timeout behaviour."""
+
+    def __init__(self, path, baud=115200, timeout=0.05):
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(self.fd)
+        self.timeout = timeout
+
+    def read(self, size):
+        ready, _, _ = select.select([self.fd], [], [], self.timeout)
+        return os.read(self.fd, size) if ready else b""
+
+    def write(self, data):
+        os.write(self.fd, data)
+
+    def close(self):
+        os.close(self.fd)
+
+
+class FakeLamp(threading.Thread):
+    """Answers on the lamp end of the pty the way serviceSerial() does."""
+
+    def __init__(self, fd, dump=b"", drop_first=0):
+        super().__init__(daemon=True)
+        self.fd = fd
+        self.dump = dump
+        self.drop_first = drop_first  # frames lost to standby wake-ups
+        self.brightness = 50
+        self.fade_rate = 200
+        self.received = []
+        self.telemetry_period = 0
+        self.next_sample = 0
+        self.samples = 0
+        self.stopping = threading.Event()
+
+    def send(self, kind, payload=b""):
+        os.write(self.fd, lampctl.encode_frame(kind, payload))
+
+    def handle(self, kind, payload):
+        self.received.append(kind)
+        if self.drop_first:
+            self.drop_first -= 1
+            return
+        if kind == lampctl.QUERY_STATE:
+            self.send(lampctl.STATE, struct.pack("<7BHhH", 0, 2, 0x03, self.brightness, 80, 1, 64,
+                                                 7710, 4125, 312))
+        elif kind == lampctl.SET_BRIGHTNESS:
+            status = 1 if len(payload) != 1 or payload[0] > 100 else 0
+            if not status:
+                self.brightness = payload[0]
+            self.send(lampctl.ACK, bytes((kind, status)))
+        elif kind == lampctl.SET_FADE_RATE:
+            rate = struct.unpack("<H", payload)[0] if len(payload) == 2 else 0
+            status = 1 if not 1 <= rate <= 1000 else 0
+            if not status:
+                self.fade_rate = rate
+            self.send(lampctl.ACK, bytes((kind, status)))
+        elif kind == lampctl.TOGGLE_POWER:
+            self.send(lampctl.ACK, bytes((kind, 0)))
+        elif kind == lampctl.TELEMETRY:
+            self.telemetry_period = payload[0]
+            self.next_sample = time.monotonic()
+            self.send(lampctl.ACK, bytes((kind, 0)))
+        elif kind == lampctl.LOG_DUMP:
+            self.send(lampctl.ACK, bytes((kind, 0)))
+            for start in range(0, len(self.dump), lampctl.MAX_PAYLOAD):
+                self.send(lampctl.LOG_CHUNK, self.dump[start:start + lampctl.MAX_PAYLOAD])
+            self.send(lampctl.LOG_CHUNK)
+        else:
+            self.send(lampctl.ACK, bytes((kind, 3)))
+
+    def run(self):
+        decoder = lampctl.FrameDecoder()
+        while not self.stopping.is_set():
+            ready, _, _ = select.select([self.fd], [], [], 0.01)
+            if ready:
+                try:
+                    data = os.read(self.fd, 64)
+                except OSError:
+                    return
+                for kind, payload in decoder.feed(data):
+                    self.handle(kind, payload)
+            if self.telemetry_period and time.monotonic() >= self.next_sample:
+                self.samples += 1
+                self.next_sample += self.telemetry_period / 10
+                self.send(lampctl.TELEMETRY_SAMPLE,
+                          struct.pack("<IHhHHH", 1000 * self.samples, 7700, 2550, 12800, 900, 40))
+
+
+class LoopbackTest(unittest.TestCase):
+    def start(self, **lamp_args):
+        master, slave = os.openpty()
+        tty.setraw(master)
+        self.lamp = FakeLamp(master, **lamp_args)
+        self.lamp.start()
+        self.port = os.ttyname(slave)
+        self.addCleanup(os.close, slave)
+        self.addCleanup(os.close, master)
+        self.addCleanup(self.lamp.join)
+        self.addCleanup(self.lamp.stopping.set)
+
+    def open(self):
+        lamp = lampctl.Lamp(self.port, link=PtyLink(self.port))
+        self.addCleanup(lamp.close)
+        return lamp
+
+
+class LampTest(LoopbackTest):
+    def test_query_state(self):
+        self.start()
+        state = self.open().query_state()
+        self.assertEqual({"state": "operating", "mode": "stats", "lamp_on": True, "limiting": True,
+                          "cutoff": False, "editing_preset": False, "charge_limited": False, "brightness": 50,
+                          "thermal_ceiling": 80, "preset": 1, "battery_percent": 64,
+                          "battery_mv": 7710, "temp_c": 41.25, "runtime_min": 312}, state)
+
+    def test_set_brightness_and_errors(self):
+        self.start()
+        lamp = self.open()
+        lamp.set_brightness(40)
+        self.assertEqual(40, lamp.query_state()["brightness"])
+        with self.assertRaisesRegex(lampctl.LampError, "bad argument"):
+            lamp.set_brightness(101)
+        with self.assertRaisesRegex(lampctl.LampError, "unknown command"):
+            lamp.request(0x7F)
+
+    def test_set_fade_rate(self):
+        self.start()
+        lamp = self.open()
+        lamp.set_fade_rate(750)
+        self.assertEqual(750, self.lamp.fade_rate)
+        with self.assertRaisesRegex(lampctl.LampError, "bad argument"):
+            lamp.set_fade_rate(0)
+
+    def test_lost_wake_frame_is_resent(self):
+        self.start(drop_first=1)
+        self.open().toggle_power()
+        self.assertEqual([lampctl.TOGGLE_POWER] * 2, self.lamp.received)
+
+    def test_no_answer(self):
+        self.start(drop_first=2)
+        with self.assertRaisesRegex(lampctl.LampError, "no answer"):
+            self.open().query_state()
+
+    def test_telemetry_stream_stops_on_exit(self):
+        self.start()
+        stream = self.open().telemetry(period_s=0.1)
+        samples = [next(stream) for _ in range(3)]
+        stream.close()
+        self.assertEqual([1000, 2000, 3000], [s["time_ms"] for s in samples])
+        self.assertEqual(50.0, samples[0]["duty_percent"])
+        self.assertEqual(0, self.lamp.telemetry_period)
+
+    def test_log_dump(self):
+        dump = b"TLOG" + bytes(range(256)) * 3 + b"\x01"
+        self.start(dump=dump)
+        self.assertEqual(dump, self.open().dump_log())
+
+
+class CommandLineTest(LoopbackTest):
+    def run_main(self, *args):
+        fake_serial = types.SimpleNamespace(Serial=PtyLink)
+        out, err = io.StringIO(), io.StringIO()
+        with mock.patch.dict(sys.modules, serial=fake_serial), \
+                mock.patch.object(sys, "argv", ["lampctl.py", "--port", self.port] + list(args)), \
+                contextlib.redirect_stdout(out), contextlib.redirect_stderr(err):
+            status = lampctl.main()
+        return status, out.getvalue(), err.getvalue()
+
+    def test_state(self):
+        self.start()
+        status, out, _ = self.run_main("state")
+        self.assertEqual(0, status)
+        self.assertIn("battery_mv=7710", out.splitlines())
+
+    def test_fade_rate(self):
+        self.start()
+        status, _, _ = self.run_main("fade-rate", "100")
+        self.assertEqual(0, status)
+        self.assertEqual(100, self.lamp.fade_rate)
+
+    def test_brightness_refused(self):
+        self.start()
+        status, _, err = self.run_main("brightness", "140")
+        self.assertEqual(1, status)
+        self.assertEqual("error: bad argument\n", err)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,157 @@
+"""Host tests for tools/telemetry_decode.py.
+
+Dumps are built record by record in the layout logTelemetry() writes (see the
+EEPROM Telemetry Log section of src/main.cpp). Run from the project root:
+
+    python3 -m unittest discover -s test/tools
+"""
+import contextlib
+import io
+import os
+import sys
+import tempfile
+import unittest
+from unittest import mock
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), "..", "..", "tools"))
+
+import telemetry_decode  # noqa: E402
+
+KEY_BATTERY, KEY_TEMP, DELTA, EVENT = range(4)
+LAMP_ON, WARN, CRITICAL = 0x01, 0x02, 0x04
+CHARGING, LOW_BATTERY = 1 << 3, 2 << 3
+SLOTS = 224
+INTERVAL_S = 300
+
+
+def record(kind, a, b, c, flags=LAMP_ON, epoch=0):
+    return bytes(((epoch << 7) | (kind << 5) | flags, a & 0xFF, b & 0xFF, c))
+
+
+def keyframe(centivolts, decitemp, brightness, boot=False, flags=LAMP_ON):
+    temp = decitemp & 0xFFFF
+    return (record(KEY_BATTERY, centivolts >> 8, centivolts, brightness | (0x80 if boot else 0), flags)
+            + record(KEY_TEMP, temp >> 8, temp, brightness, flags))
+
+
+def dump(*records, slots=SLOTS, interval=INTERVAL_S):
+    body = b"".join(records)
+    body += b"\xff" * (slots * 4 - len(body))
+    return b"TLOG" + bytes((1, slots, interval >> 8, interval & 0xFF)) + body
+
+
+def decode(data):
+    return list(telemetry_decode.decode(*telemetry_decode.read_dump(data)))
+
+
+class ReadDumpTest(unittest.TestCase):
+    def test_header_and_slots(self):
+        interval, records = telemetry_decode.read_dump(dump(keyframe(812, 251, 50, boot=True)))
+        self.assertEqual(INTERVAL_S, interval)
+        self.assertEqual(SLOTS, len(records))
+        self.assertEqual(record(KEY_BATTERY, 3, 44, 50 | 0x80), bytes(records[0]))
+
+    def test_rejects_bad_header(self):
+        with self.assertRaisesRegex(ValueError, "TLOG"):
+            telemetry_decode.read_dump(b"TLOX" + bytes(4 + SLOTS * 4))
+        data = bytearray(dump())
+        data[4] = 2
+        with self.assertRaisesRegex(ValueError, "version 2"):
+            telemetry_decode.read_dump(bytes(data))
+
+    def test_rejects_truncated_dump(self):
+        with self.assertRaisesRegex(ValueError, "truncated"):
+            telemetry_decode.read_dump(dump()[:-1])
+
+
+class DecodeTest(unittest.TestCase):
+    def test_keyframe_pair_is_one_row(self):
+        rows = decode(dump(keyframe(812, 251, 50, boot=True)))
+        self.assertEqual(1, len(rows))
+        self.assertEqual({"boot": 1, "time_s": 0, "kind": "key_temp", "state": "operating",
+                          "lamp_on": 1, "warn": 0, "critical": 0, "brightness": 50,
+                          "battery_mv": 8120, "temp_c": 25.1}, rows[0])
+
+    def test_deltas_accumulate_per_interval(self):
+        rows = decode(dump(keyframe(812, 251, 50, boot=True),
+                           record(DELTA, -3, 42, 50),
+                           record(DELTA, -128, 127, 70),
+                           record(DELTA, 5, -20, 70)))
+        self.assertEqual([0, 300, 600, 900], [r["time_s"] for r in rows])
+        self.assertEqual([8120, 8090, 6810, 6860], [r["battery_mv"] for r in rows])
+        self.assertEqual([25.1, 29.3, 42.0, 40.0], [r["temp_c"] for r in rows])
+        self.assertEqual([50, 50, 70, 70], [r["brightness"] for r in rows])
+
+    def test_negative_temperature_keyframe(self):
+        rows = decode(dump(keyframe(780, -55, 10, boot=True), record(DELTA, 0, -10, 10)))
+        self.assertEqual([-5.5, -6.5], [r["temp_c"] for r in rows])
+
+    def test_event_is_timed_from_the_last_interval(self):
+        rows = decode(dump(keyframe(812, 600, 100, boot=True),
+                           record(DELTA, -1, 30, 100),
+                           record(EVENT, 0, 97, 100, LAMP_ON | WARN),
+                           record(EVENT, 1, 4, 0, CRITICAL),
+                           record(DELTA, -1, -5, 40, LAMP_ON)))
+        self.assertEqual([0, 300, 397, 560, 600], [r["time_s"] for r in rows])
+        self.assertEqual(["key_temp", "delta", "event", "event", "delta"], [r["kind"] for r in rows])
+        self.assertEqual([0, 0, 1, 0, 0], [r["warn"] for r in rows])
+        self.assertEqual([0, 0, 0, 1, 0], [r["critical"] for r in rows])
+        self.assertEqual([1, 1, 1, 0, 1], [r["lamp_on"] for r in rows])
+        # An event carries no new reading
+        self.assertEqual(63.0, rows[2]["temp_c"])
+
+    def test_state_field(self):
+        rows = decode(dump(keyframe(812, 250, 0, boot=True, flags=CHARGING),
+                           record(EVENT, 0, 10, 0, LOW_BATTERY)))
+        self.assertEqual(["charging", "low_battery"], [r["state"] for r in rows])
+
+    def test_keyframe_mid_boot_continues_the_clock(self):
+        rows = decode(dump(keyframe(812, 250, 50, boot=True),
+                           record(DELTA, 0, 0, 50),
+                           keyframe(700, 250, 50)))
+        self.assertEqual([(1, 0), (1, 300), (1, 600)], [(r["boot"], r["time_s"]) for r in rows])
+        self.assertEqual(7000, rows[2]["battery_mv"])
+
+    def test_boot_marker_restarts_the_clock(self):
+        rows = decode(dump(keyframe(812, 250, 50, boot=True),
+                           record(DELTA, -2, 0, 50),
+                           keyframe(790, 240, 25, boot=True),
+                           record(DELTA, -1, 1, 25)))
+        self.assertEqual([(1, 0), (1, 300), (2, 0), (2, 300)], [(r["boot"], r["time_s"]) for r in rows])
+
+    def test_records_before_the_first_keyframe_are_skipped(self):
+        # The oldest slots of a wrapped ring: the tail of an overwritten boot
+        rows = decode(dump(record(DELTA, -1, 0, 50, epoch=1),
+                           record(KEY_TEMP, 0, 250, 50, epoch=1),
+                           record(EVENT, 0, 20, 50, LAMP_ON | WARN, epoch=1),
+                           keyframe(800, 250, 50, boot=True)))
+        self.assertEqual(1, len(rows))
+        self.assertEqual(8000, rows[0]["battery_mv"])
+
+    def test_erased_slots_are_skipped(self):
+        rows = decode(dump(keyframe(812, 250, 50, boot=True), b"\xff" * 4, record(DELTA, -1, 0, 50)))
+        self.assertEqual([0, 300], [r["time_s"] for r in rows])
+
+    def test_interval_from_the_header(self):
+        rows = decode(dump(keyframe(812, 250, 50, boot=True), record(DELTA, 0, 0, 50), interval=60))
+        self.assertEqual([0, 60], [r["time_s"] for r in rows])
+
+
+class CommandLineTest(unittest.TestCase):
+    def test_dump_file_to_csv(self):
+        with tempfile.NamedTemporaryFile(suffix=".bin", delete=False) as f:
+            f.write(dump(keyframe(812, 251, 50, boot=True), record(DELTA, -3, 42, 50)))
+        self.addCleanup(os.unlink, f.name)
+        out = io.StringIO()
+        with mock.patch.object(sys, "argv", ["telemetry_decode.py", f.name]), \
+                contextlib.redirect_stdout(out):
+            self.assertEqual(0, telemetry_decode.main())
+        self.assertEqual([
+            "boot,time_s,kind,state,lamp_on,warn,critical,brightness,battery_mv,temp_c",
+            "1,0,key_temp,operating,1,0,0,50,8120,25.1",
+            "1,300,delta,operating,1,0,0,50,8090,29.3",
+        ], out.getvalue().splitlines())
+
+
+if __name__ == "__main__":
+    unittest.main()
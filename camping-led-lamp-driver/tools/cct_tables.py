@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+"""Generate the warm/cool colour mixing table in src/main.cpp.
+
+The lamp has a cool and a warm white LED channel on the same constant-current
+driver, PWM dimmed, so each channel's luminous flux is proportional to its
+duty and its power draw follows the duty. For every colour temperature step
+the table holds the duty of each channel at full output:
+
+- The mixed light is within --tolerance mired of the step. Within that band
+  the mix with the most lumens per watt is taken, which is the one with the
+  largest share of the more efficient channel. With no flux figures the two
+  channels count as equally efficient and the mix sits on the step.
+- Full output drives the brighter channel of the mix at full duty, so no step
+  gives up light the LEDs could make. The power caps in the firmware work on
+  the total of both channels.
+- Steps whose mix comes out the same as the next one's (the tolerance band
+  runs into the end of the range) are left out.
+
+How much of each channel a colour temperature takes depends on the flux of
+the two channels at full duty. Nothing in the repo gives it for the fitted
+LEDs, so by default both are taken to give the same flux. --cool-lm and
+--warm-lm set it from the LED datasheets or a measurement.
+
+Chromaticities are taken on the Planckian locus (Kim et al. cubic fit) and
+mixed in CIE XYZ; the CCT of a mix uses McCamy's formula. Usage:
+
+    cct_tables.py                         print the table
+    cct_tables.py --update src/main.cpp   rewrite the generated block
+"""
+import argparse
+import sys
+
+BEGIN_MARK = "// BEGIN GENERATED COLOR MIX TABLE"
+END_MARK = "// END GENERATED COLOR MIX TABLE"
+
+
+def planck_xy(kelvin):
+    t = float(kelvin)
+    if t <= 4000:
+        x = -0.2661239e9 / t**3 - 0.2343589e6 / t**2 + 0.8776956e3 / t + 0.179910
+    else:
+        x = -3.0258469e9 / t**3 + 2.1070379e6 / t**2 + 0.2226347e3 / t + 0.240390
+    if t <= 2222:
+        y = -1.1063814 * x**3 - 1.34811020 * x**2 + 2.18555832 * x - 0.20219683
+    elif t <= 4000:
+        y = -0.9549476 * x**3 - 1.37418593 * x**2 + 2.09137015 * x - 0.16748867
+    else:
+        y = 3.0817580 * x**3 - 5.87338670 * x**2 + 3.75112997 * x - 0.37001483
+    return x, y
+
+
+def mix_cct(sources):
+    """sources: (flux, (x, y)) pairs -> CCT of the mix."""
+    X = Y = Z = 0.0
+    for flux, (x, y) in sources:
+        X += flux * x / y
+        Y += flux
+        Z += flux * (1 - x - y) / y
+    total = X + Y + Z
+    x, y = X / total, Y / total
+    n = (x - 0.3320) / (0.1858 - y)
+    return 449 * n**3 + 3525 * n**2 + 6823.3 * n + 5520.33
+
+
+def warm_share_for(target_kelvin, warm_xy, cool_xy):
+    """Warm share of the flux whose mix has the target CCT (bisection)."""
+    low, high = 0.0, 1.0
+    if mix_cct([(1, cool_xy)]) <= target_kelvin:
+        return 0.0
+    if mix_cct([(1, warm_xy)]) >= target_kelvin:
+        return 1.0
+    for _ in range(60):
+        mid = (low + high) / 2
+        if mix_cct([(1 - mid, cool_xy), (mid, warm_xy)]) > target_kelvin:
+            low = mid
+        else:
+            high = mid
+    return (low + high) / 2
+
+
+def build(args):
+    warm_xy, cool_xy = planck_xy(args.warm_k), planck_xy(args.cool_k)
+    # Both channels draw the same driver current, so efficacy follows flux
+    cool_lm = args.cool_lm or 1.0
+    warm_lm = args.warm_lm or 1.0
+    table = []
+    for kelvin in range(args.warm_k, args.cool_k + 1, args.step_k):
+        mired = 1e6 / kelvin
+        # Edge of the tolerance band towards the more efficient channel
+        if cool_lm > warm_lm:
+            mired -= args.tolerance
+        elif warm_lm > cool_lm:
+            mired += args.tolerance
+        share = warm_share_for(min(max(1e6 / mired, args.warm_k), args.cool_k), warm_xy, cool_xy)
+        # Duty of each channel per unit of flux, the brighter one at full
+        cool, warm = (1 - share) / cool_lm, share / warm_lm
+        scale = 255 / max(cool, warm)
+        cool, warm = round(cool * scale), round(warm * scale)
+        mixed = mix_cct([(1 - share, cool_xy), (share, warm_xy)])
+        row = (kelvin, cool, warm, mixed, (cool + warm) / 255.0)
+        if table and table[-1][1:3] == row[1:3]:
+            table[-1] = row  # same mix: keep the step it actually reaches
+        else:
+            table.append(row)
+    return table
+
+
+def c_block(args, table):
+    out = [BEGIN_MARK + " (tools/cct_tables.py)"]
+    if args.cool_lm and args.warm_lm:
+        flux = "%d lm and %d lm at full duty" % (args.cool_lm, args.warm_lm)
+    else:
+        flux = "same flux at full duty"
+    out.append("// cool %d K, warm %d K, %s, +-%g mired;"
+               % (args.cool_k, args.warm_k, flux, args.tolerance))
+    out.append("// 100% drives the brighter channel at full duty")
+    out.append("const ColorMix colorMixTable[] PROGMEM = {")
+    for kelvin, cool, warm, mixed, power in table:
+        out.append("  { %2d, %3d, %3d },  // %4d K: mix %4d K, %.2f x one channel's power"
+                   % (kelvin // 100, cool, warm, kelvin, round(mixed), power))
+    out.append("};")
+    out.append("const uint8_t CCT_STEPS = %d;" % len(table))
+    out.append("const uint16_t CCT_WARM_KELVIN = %d;  // ends of the display scale" % args.warm_k)
+    out.append("const uint16_t CCT_COOL_KELVIN = %d;" % args.cool_k)
+    out.append(END_MARK)
+    return "\n".join(out) + "\n"
+
+
+def parse_args(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--cool-k", type=int, default=6500)
+    parser.add_argument("--cool-lm", type=int, help="cool channel flux at full duty")
+    parser.add_argument("--warm-k", type=int, default=2700)
+    parser.add_argument("--warm-lm", type=int, help="warm channel flux at full duty")
+    parser.add_argument("--step-k", type=int, default=200)
+    parser.add_argument("--tolerance", type=float, default=5, help="mired")
+    parser.add_argument("--update", metavar="SOURCE", help="rewrite the block in this file")
+    return parser.parse_args(argv)
+
+
+def main():
+    args = parse_args()
+
+    table = build(args)
+    block = c_block(args, table)
+    if not args.update:
+        sys.stdout.write(block)
+        return 0
+    with open(args.update) as f:
+        text = f.read()
+    start = text.find(BEGIN_MARK)
+    end = text.find(END_MARK)
+    if start < 0 or end < start:
+        print("error: %s: no generated colour mix block" % args.update, file=sys.stderr)
+        return 1
+    end = text.index("\n", end) + 1
+    with open(args.update, "w") as f:
+        f.write(text[:start] + block + text[end:])
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,271 @@
+#!/usr/bin/env python3
+"""Talk to the lamp over its binary serial protocol.
+
+Every frame, in both directions, is 0xA5, type, payload length (0-16), payload,
+then a CRC-8 (polynomial 0x07, init 0) over type, length and payload. Multi-byte
+fields are little-endian. Needs pyserial. As a library:
+
+    with Lamp("/dev/ttyUSB0") as lamp:
+        lamp.set_brightness(40)
+        print(lamp.query_state())
+        for sample in lamp.telemetry(period_s=0.5):
+            print(sample)
+
+From the shell:
+
+    lampctl.py --port /dev/ttyUSB0 state
+    lampctl.py --port /dev/ttyUSB0 brightness 40
+    lampctl.py --port /dev/ttyUSB0 preset 2
+    lampctl.py --port /dev/ttyUSB0 power
+    lampctl.py --port /dev/ttyUSB0 fade-rate 100
+    lampctl.py --port /dev/ttyUSB0 telemetry 0.5
+
+A lamp in standby loses the byte that wakes it, so a command that gets no
+answer is sent once more.
+"""
+import argparse
+import struct
+import sys
+import time
+
+SYNC = 0xA5
+MAX_PAYLOAD = 16
+
+SET_BRIGHTNESS = 0x01
+SELECT_PRESET = 0x02
+TOGGLE_POWER = 0x03
+QUERY_STATE = 0x04
+TELEMETRY = 0x05
+LOG_DUMP = 0x06
+SET_FADE_RATE = 0x07
+ACK = 0x80
+STATE = 0x81
+TELEMETRY_SAMPLE = 0x82
+LOG_CHUNK = 0x83
+
+STATUS = ("ok", "bad argument", "refused", "unknown command")
+STATES = ("operating", "charging", "low_battery", "overheat")
+MODES = ("smooth_dim", "preset_select", "stats", "color_temp")
+
+
+class LampError(Exception):
+    pass
+
+
+def crc8(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def encode_frame(kind, payload=b""):
+    if len(payload) > MAX_PAYLOAD:
+        raise ValueError("payload too long")
+    body = bytes((kind, len(payload))) + bytes(payload)
+    return bytes((SYNC,)) + body + bytes((crc8(body),))
+
+
+class FrameDecoder:
+    """Feed raw bytes, collect (type, payload) tuples. Bad frames are skipped."""
+
+    def __init__(self):
+        self.buffer = bytearray()
+
+    def feed(self, data):
+        self.buffer += data
+        frames = []
+        while True:
+            start = self.buffer.find(SYNC)
+            if start < 0:
+                self.buffer.clear()
+                return frames
+            del self.buffer[:start]
+            if len(self.buffer) < 3:
+                return frames
+            length = self.buffer[2]
+            if length > MAX_PAYLOAD:
+                del self.buffer[0]
+                continue
+            if len(self.buffer) < length + 4:
+                return frames
+            body = bytes(self.buffer[1:3 + length])
+            if crc8(body) != self.buffer[3 + length]:
+                del self.buffer[0]
+                continue
+            frames.append((body[0], body[2:]))
+            del self.buffer[:length + 4]
+
+
+def decode_state(payload):
+    state, mode, flags, brightness, ceiling, preset, percent, mv, temp, runtime = \
+        struct.unpack("<7BHhH", payload)
+    return {
+        "state": STATES[state] if state < len(STATES) else state,
+        "mode": MODES[mode] if mode < len(MODES) else mode,
+        "lamp_on": bool(flags & 1),
+        "limiting": bool(flags & 2),
+        "cutoff": bool(flags & 4),
+        "editing_preset": bool(flags & 8),
+        "charge_limited": bool(flags & 16),
+        "brightness": brightness,
+        "thermal_ceiling": ceiling,
+        "preset": preset,
+        "battery_percent": percent,
+        "battery_mv": mv,
+        "temp_c": temp / 100.0,
+        "runtime_min": runtime,
+    }
+
+
+def decode_telemetry(payload):
+    millis, mv, temp, level, loop_worst, passes = struct.unpack("<IHhHHH", payload)
+    return {
+        "time_ms": millis,
+        "battery_mv": mv,
+        "temp_c": temp / 100.0,
+        "duty_percent": level / 256.0,
+        "loop_worst_us": loop_worst,
+        "loop_passes": passes,
+    }
+
+
+class Lamp:
+    def __init__(self, port, baud=115200, timeout=0.3, link=None):
+        if link is None:
+            import serial  # pyserial
+            link = serial.Serial(port, baud, timeout=0.05)
+        self.link = link
+        self.timeout = timeout
+        self.decoder = FrameDecoder()
+        self.pending = []
+
+    def close(self):
+        self.link.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def _frames(self, timeout):
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            if self.pending:
+                yield self.pending.pop(0)
+                continue
+            data = self.link.read(64)
+            if data:
+                self.pending.extend(self.decoder.feed(data))
+
+    def _wait_for(self, kinds, timeout):
+        for kind, payload in self._frames(timeout):
+            if kind in kinds:
+                return kind, payload
+        return None
+
+    def request(self, kind, payload=b"", reply=ACK):
+        frame = encode_frame(kind, payload)
+        for _ in range(2):
+            self.link.write(frame)
+            answer = self._wait_for((reply,), self.timeout)
+            if answer is None:
+                continue
+            if reply != ACK:
+                return answer[1]
+            command, status = answer[1][0], answer[1][1]
+            if command != kind:
+                continue
+            if status:
+                raise LampError(STATUS[status] if status < len(STATUS) else status)
+            return
+        raise LampError("no answer from the lamp")
+
+    def set_brightness(self, percent):
+        self.request(SET_BRIGHTNESS, bytes((percent,)))
+
+    def select_preset(self, index):
+        self.request(SELECT_PRESET, bytes((index,)))
+
+    def toggle_power(self):
+        self.request(TOGGLE_POWER)
+
+    def set_fade_rate(self, percent_per_s):
+        """Brightness change per second of a fade, 1-1000; the lamp saves it."""
+        self.request(SET_FADE_RATE, struct.pack("<H", percent_per_s))
+
+    def query_state(self):
+        return decode_state(self.request(QUERY_STATE, reply=STATE))
+
+    def telemetry(self, period_s=1.0, duration_s=None):
+        """Yield telemetry samples; the stream is stopped again on exit."""
+        period = max(1, min(255, round(period_s * 10)))
+        self.request(TELEMETRY, bytes((period,)))
+        end = None if duration_s is None else time.monotonic() + duration_s
+        try:
+            while end is None or time.monotonic() < end:
+                frame = self._wait_for((TELEMETRY_SAMPLE,), period_s * 3)
+                if frame is not None:
+                    yield decode_telemetry(frame[1])
+        finally:
+            self.request(TELEMETRY, b"\x00")
+
+    def dump_log(self, timeout=5.0):
+        """Raw telemetry log dump, as decoded by telemetry_decode.py."""
+        self.request(LOG_DUMP)
+        data = bytearray()
+        while True:
+            frame = self._wait_for((LOG_CHUNK,), timeout)
+            if frame is None:
+                raise LampError("log dump stopped after %d bytes" % len(data))
+            if not frame[1]:
+                return bytes(data)
+            data += frame[1]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", required=True, help="serial port of the lamp")
+    parser.add_argument("--baud", type=int, default=115200)
+    sub = parser.add_subparsers(dest="command", required=True)
+    sub.add_parser("state")
+    sub.add_parser("power")
+    sub.add_parser("brightness").add_argument("percent", type=int)
+    sub.add_parser("preset").add_argument("index", type=int, help="0-3")
+    sub.add_parser("fade-rate").add_argument("percent", type=int, help="per second, 1-1000")
+    stream = sub.add_parser("telemetry")
+    stream.add_argument("period", type=float, nargs="?", default=1.0, help="seconds")
+    args = parser.parse_args()
+
+    with Lamp(args.port, args.baud) as lamp:
+        try:
+            if args.command == "state":
+                for key, value in lamp.query_state().items():
+                    print("%s=%s" % (key, value))
+            elif args.command == "power":
+                lamp.toggle_power()
+            elif args.command == "brightness":
+                lamp.set_brightness(args.percent)
+            elif args.command == "preset":
+                lamp.select_preset(args.index)
+            elif args.command == "fade-rate":
+                lamp.set_fade_rate(args.percent)
+            else:
+                columns = ("time_ms", "battery_mv", "temp_c", "duty_percent",
+                           "loop_worst_us", "loop_passes")
+                print(",".join(columns))
+                for sample in lamp.telemetry(args.period):
+                    print(",".join(str(sample[c]) for c in columns), flush=True)
+        except LampError as error:
+            print("error: %s" % error, file=sys.stderr)
+            return 1
+        except KeyboardInterrupt:
+            pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,449 @@
+#!/usr/bin/env python3
+"""Assemble light scenes for the lamp's scene engine and check their timing.
+
+A scene is a small program that sets an intensity (0-255) which scales the
+lamp's output level. The firmware runs it from the Timer1 interrupt, one step
+every 8 ms engine tick. Source files (see scenes/) hold one instruction per
+line, with optional "label:" prefixes and ";" comments:
+
+    end                       steady light at the normal level from here
+    off                       switch the lamp off
+    set LEVEL                 intensity = LEVEL at once
+    ramp LEVEL TIME           linear from the current intensity to LEVEL
+    hold TIME                 keep the intensity
+    flicker LOW HIGH TIME     smoothed random intensity between LOW and HIGH
+    loop COUNT LABEL          run the code from LABEL to here COUNT times
+                              (loops do not nest)
+    jump LABEL
+    wait EVENTS               until one of the events happens
+    jev EVENTS LABEL          jump if one of the events has happened
+
+TIME is 500ms, 2s, 10min or plain milliseconds. Up to 262 s is rounded to
+the 8 ms tick; longer times must be whole seconds. EVENTS is "input"
+(encoder, button or IR key), or several events joined with "|".
+
+Directives:
+
+    .name NAME                name shown on the OLED (and the C identifier)
+    .expect TIME LEVEL        checked by "check": intensity at TIME, where
+                              LEVEL is a number, LOW..HIGH, "end" or "off"
+    .event TIME EVENTS        posts events at TIME while checking
+
+Usage:
+
+    sceneasm.py c scenes/*.scene                    print the C block
+    sceneasm.py c --update src/main.cpp scenes/*.scene
+    sceneasm.py simulate scenes/sos.scene --until 10s
+    sceneasm.py check scenes/*.scene
+
+"simulate" and "check" run the same integer interpreter as the firmware, tick
+for tick, so an instruction that runs late shows up as a failed expectation.
+"""
+import argparse
+import os
+import re
+import sys
+
+TICK_MS = 8
+TICKS_PER_SECOND = 1000 // TICK_MS
+TIME_SECONDS = 0x8000
+STEPS_PER_TICK = 4
+MAX_SCENE_BYTES = 256
+RANDOM_SEED = 0xACE1
+
+OPCODES = ("end", "off", "set", "ramp", "hold", "flicker", "loop", "jump",
+           "wait", "jev")
+OP = {name: code for code, name in enumerate(OPCODES)}
+OPERANDS = {
+    "end": (), "off": (), "set": ("level",), "ramp": ("level", "time"),
+    "hold": ("time",), "flicker": ("level", "level", "time"),
+    "loop": ("count", "label"), "jump": ("label",), "wait": ("events",),
+    "jev": ("events", "label"),
+}
+EVENTS = {"input": 0x01}
+
+BEGIN_MARK = "// BEGIN GENERATED SCENES"
+END_MARK = "// END GENERATED SCENES"
+
+
+class SceneError(Exception):
+    pass
+
+
+def parse_time(text):
+    m = re.fullmatch(r"(\d+)(ms|s|min)?", text)
+    if not m:
+        raise SceneError("bad time %r" % text)
+    scale = {None: 1, "ms": 1, "s": 1000, "min": 60000}[m.group(2)]
+    return int(m.group(1)) * scale
+
+
+def encode_time(ms):
+    ticks = (ms + TICK_MS // 2) // TICK_MS
+    if ticks < TIME_SECONDS:
+        return ticks
+    if ms % 1000 or ms // 1000 >= TIME_SECONDS:
+        raise SceneError("%d ms: times over 262 s must be whole seconds, "
+                         "at most 32767 s" % ms)
+    return TIME_SECONDS | (ms // 1000)
+
+
+def decode_ticks(time):
+    if time & TIME_SECONDS:
+        return (time & ~TIME_SECONDS) * TICKS_PER_SECOND
+    return time
+
+
+def parse_events(text):
+    mask = 0
+    for name in text.split("|"):
+        if name not in EVENTS:
+            raise SceneError("unknown event %r" % name)
+        mask |= EVENTS[name]
+    return mask
+
+
+def parse_number(text, low, high, what):
+    try:
+        value = int(text, 0)
+    except ValueError:
+        raise SceneError("bad %s %r" % (what, text))
+    if not low <= value <= high:
+        raise SceneError("%s %d out of range %d-%d" % (what, value, low, high))
+    return value
+
+
+class Scene:
+    def __init__(self, path):
+        self.path = path
+        self.name = os.path.splitext(os.path.basename(path))[0].capitalize()
+        self.code = bytearray()
+        self.listing = []      # (offset, bytes, source text)
+        self.expects = []      # (ms, check text)
+        self.events = []       # (ms, mask)
+
+    @property
+    def identifier(self):
+        return "scene" + re.sub(r"\W", "", self.name)
+
+
+def assemble(path):
+    scene = Scene(path)
+    labels = {}
+    pending = []   # (line number, text, mnemonic, operands, offset)
+    with open(path) as f:
+        lines = f.read().splitlines()
+
+    offset = 0
+    for number, line in enumerate(lines, 1):
+        text = line.split(";", 1)[0].strip()
+        try:
+            while True:
+                m = re.match(r"(\w+):\s*", text)
+                if not m:
+                    break
+                if m.group(1) in labels:
+                    raise SceneError("label %r defined twice" % m.group(1))
+                labels[m.group(1)] = offset
+                text = text[m.end():]
+            if not text:
+                continue
+            words = text.split()
+            if words[0] == ".name":
+                scene.name = " ".join(words[1:])
+                continue
+            if words[0] == ".expect" and len(words) == 3:
+                scene.expects.append((parse_time(words[1]), words[2]))
+                continue
+            if words[0] == ".event" and len(words) == 3:
+                scene.events.append((parse_time(words[1]), parse_events(words[2])))
+                continue
+            mnemonic = words[0].lower()
+            if mnemonic not in OPERANDS:
+                raise SceneError("unknown instruction %r" % words[0])
+            kinds = OPERANDS[mnemonic]
+            if len(words) - 1 != len(kinds):
+                raise SceneError("%s takes %d operand(s)" % (mnemonic, len(kinds)))
+            pending.append((number, text, mnemonic, words[1:], offset))
+            offset += 1 + sum(2 if k == "time" else 1 for k in kinds)
+        except SceneError as error:
+            raise SceneError("%s:%d: %s" % (path, number, error))
+
+    if offset > MAX_SCENE_BYTES:
+        raise SceneError("%s: %d bytes, at most %d" % (path, offset, MAX_SCENE_BYTES))
+
+    loops = []
+    for number, text, mnemonic, operands, at in pending:
+        try:
+            out = bytearray((OP[mnemonic],))
+            values = []
+            for kind, word in zip(OPERANDS[mnemonic], operands):
+                if kind == "level":
+                    values.append(parse_number(word, 0, 255, "level"))
+                    out.append(values[-1])
+                elif kind == "count":
+                    out.append(parse_number(word, 1, 255, "loop count"))
+                elif kind == "label":
+                    if word not in labels:
+                        raise SceneError("undefined label %r" % word)
+                    out.append(labels[word])
+                elif kind == "events":
+                    out.append(parse_events(word))
+                else:
+                    time = encode_time(parse_time(word))
+                    out += bytes((time & 0xFF, time >> 8))
+            if mnemonic == "flicker" and values[0] > values[1]:
+                raise SceneError("flicker: LOW above HIGH")
+            if mnemonic == "loop":
+                if labels[operands[1]] > at:
+                    raise SceneError("loop target must come before the loop")
+                loops.append((labels[operands[1]], at))
+        except SceneError as error:
+            raise SceneError("%s:%d: %s" % (path, number, error))
+        scene.code += out
+        scene.listing.append((at, bytes(out), text))
+
+    # One loop counter in the firmware: a loop body may not contain another loop
+    for start, end in loops:
+        for other_start, other_end in loops:
+            if (other_start, other_end) != (start, end) and start <= other_end < end:
+                raise SceneError("%s: loops at offsets %d and %d nest"
+                                 % (path, other_end, end))
+    return scene
+
+
+# --- Interpreter (mirrors sceneTick() in src/main.cpp) ---
+
+def c_div(a, b):
+    q = abs(a) // abs(b)
+    return -q if (a < 0) != (b < 0) else q
+
+
+class Interpreter:
+    def __init__(self, code):
+        self.code = code
+        self.pc = 0
+        self.op = OP["end"]
+        self.loops_left = 0
+        self.flicker_low = 0
+        self.flicker_span = 0
+        self.ticks_left = 0
+        self.level_q16 = 255 << 16
+        self.step_q16 = 0
+        self.ramp_target = 0
+        self.events = 0
+        self.random = RANDOM_SEED
+        self.running = True
+        self.switched_off = False
+
+    @property
+    def intensity(self):
+        return self.level_q16 >> 16
+
+    def fetch(self):
+        if self.pc >= len(self.code):
+            raise SceneError("ran past the end of the scene")
+        value = self.code[self.pc]
+        self.pc += 1
+        return value
+
+    def fetch_ticks(self):
+        time = self.fetch()
+        time |= self.fetch() << 8
+        return decode_ticks(time)
+
+    def xorshift(self):
+        x = self.random
+        x ^= (x << 7) & 0xFFFF
+        x ^= x >> 9
+        x ^= (x << 8) & 0xFFFF
+        self.random = x
+        return x
+
+    def tick(self):
+        if not self.running:
+            return
+        if self.ticks_left:
+            if self.op == OP["ramp"]:
+                self.level_q16 += self.step_q16
+                if self.ticks_left == 1:
+                    self.level_q16 = self.ramp_target << 16
+            elif self.op == OP["flicker"]:
+                target = self.flicker_low + (((self.xorshift() & 0xFF) * (self.flicker_span + 1)) >> 8)
+                self.level_q16 += ((target << 16) - self.level_q16) >> 2
+            self.ticks_left -= 1
+        if not self.ticks_left:
+            self.run()
+
+    def run(self):
+        for _ in range(STEPS_PER_TICK):
+            at = self.pc
+            op = self.fetch()
+            self.op = op
+            if op == OP["set"]:
+                self.level_q16 = self.fetch() << 16
+            elif op == OP["ramp"]:
+                self.ramp_target = self.fetch()
+                ticks = self.fetch_ticks()
+                if ticks == 0:
+                    self.level_q16 = self.ramp_target << 16
+                    continue
+                self.step_q16 = c_div((self.ramp_target << 16) - self.level_q16, ticks)
+                self.ticks_left = ticks
+                return
+            elif op == OP["hold"]:
+                self.ticks_left = self.fetch_ticks()
+                if self.ticks_left:
+                    return
+            elif op == OP["flicker"]:
+                self.flicker_low = self.fetch()
+                self.flicker_span = self.fetch() - self.flicker_low
+                self.ticks_left = self.fetch_ticks()
+                if self.ticks_left:
+                    return
+            elif op == OP["loop"]:
+                count, target = self.fetch(), self.fetch()
+                if self.loops_left == 0:
+                    self.loops_left = count
+                self.loops_left -= 1
+                if self.loops_left:
+                    self.pc = target
+            elif op == OP["jump"]:
+                self.pc = self.fetch()
+            elif op == OP["wait"]:
+                mask = self.fetch()
+                if not self.events & mask:
+                    self.pc = at
+                    return
+                self.events &= ~mask
+            elif op == OP["jev"]:
+                mask, target = self.fetch(), self.fetch()
+                if self.events & mask:
+                    self.events &= ~mask
+                    self.pc = target
+            else:
+                self.switched_off = op == OP["off"]
+                self.running = False
+                return
+
+    def state(self):
+        if self.running:
+            return str(self.intensity)
+        return "off" if self.switched_off else "end"
+
+
+def run_scene(scene, until_ms, on_tick=None):
+    """Tick the scene from t = 0 up to until_ms; returns the interpreter."""
+    interp = Interpreter(scene.code)
+    events = sorted(scene.events)
+    for tick in range(until_ms // TICK_MS + 1):
+        now = tick * TICK_MS
+        while events and events[0][0] <= now:
+            interp.events |= events.pop(0)[1]
+        interp.tick()
+        if on_tick:
+            on_tick(now, interp)
+    return interp
+
+
+def matches(state, check):
+    if check in ("end", "off") or not state.isdigit():
+        return state == check
+    low, _, high = check.partition("..")
+    return int(low) <= int(state) <= int(high or low)
+
+
+def check_scene(scene):
+    failures = []
+    for ms, check in sorted(scene.expects):
+        state = run_scene(scene, ms).state()
+        if not matches(state, check):
+            failures.append("%s: at %d ms expected %s, got %s" % (scene.path, ms, check, state))
+    return failures
+
+
+# --- C output ---
+
+def c_block(scenes, command):
+    out = [BEGIN_MARK + " (" + command + ")"]
+    for scene in scenes:
+        out.append("// %s (%s)" % (scene.name, os.path.basename(scene.path)))
+        out.append("const uint8_t %s[] PROGMEM = {" % scene.identifier)
+        for at, code, text in scene.listing:
+            names = ["SCENE_" + OPCODES[code[0]].upper()] + ["%d" % b for b in code[1:]]
+            out.append("  %-36s // %3d: %s" % (", ".join(names) + ",", at, text))
+        out.append("};")
+        out.append('const char %sName[] PROGMEM = "%s";' % (scene.identifier, scene.name))
+    out.append("const SceneDescriptor sceneTable[] PROGMEM = {")
+    for scene in scenes:
+        out.append("  { %s, %sName }," % (scene.identifier, scene.identifier))
+    out.append("};")
+    out.append("const uint8_t SCENE_COUNT = %d;" % len(scenes))
+    out.append(END_MARK)
+    return "\n".join(out) + "\n"
+
+
+def update_source(path, block):
+    with open(path) as f:
+        text = f.read()
+    start = text.find(BEGIN_MARK)
+    end = text.find(END_MARK)
+    if start < 0 or end < start:
+        raise SceneError("%s: no generated scene block" % path)
+    end = text.index("\n", end) + 1
+    with open(path, "w") as f:
+        f.write(text[:start] + block + text[end:])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+    c_cmd = sub.add_parser("c", help="print (or update) the generated C block")
+    c_cmd.add_argument("--update", metavar="SOURCE", help="rewrite the block in this file")
+    c_cmd.add_argument("scenes", nargs="+")
+    sim = sub.add_parser("simulate", help="print the intensity over time")
+    sim.add_argument("scene")
+    sim.add_argument("--until", default="60s", help="simulated time (default 60s)")
+    check = sub.add_parser("check", help="check the .expect lines")
+    check.add_argument("scenes", nargs="+")
+    args = parser.parse_args()
+
+    try:
+        if args.command == "c":
+            scenes = [assemble(path) for path in args.scenes]
+            command = "tools/sceneasm.py c " + " ".join(
+                "tools/scenes/" + os.path.basename(s.path) for s in scenes)
+            block = c_block(scenes, command)
+            if args.update:
+                update_source(args.update, block)
+            else:
+                sys.stdout.write(block)
+        elif args.command == "simulate":
+            scene = assemble(args.scene)
+            last = [None]
+
+            def show(now, interp):
+                state = interp.state()
+                if state != last[0]:
+                    print("%9d ms  %s" % (now, state))
+                    last[0] = state
+            run_scene(scene, parse_time(args.until), show)
+        else:
+            failures = []
+            for path in args.scenes:
+                scene = assemble(path)
+                problems = check_scene(scene)
+                print("%s: %d bytes, %s" % (path, len(scene.code),
+                                            "FAIL" if problems else "ok"))
+                failures += problems
+            for failure in failures:
+                print(failure, file=sys.stderr)
+            return 1 if failures else 0
+    except SceneError as error:
+        print("error: %s" % error, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
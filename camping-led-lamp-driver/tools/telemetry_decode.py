@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+"""Decode the lamp's EEPROM telemetry log.
+
+Reads a dump either from a file (raw bytes as sent by the lamp) or straight
+from the serial port (LOG_DUMP command of the serial protocol, see lampctl.py;
+needs pyserial) and prints one CSV row per record:
+
+    telemetry_decode.py dump.bin
+    telemetry_decode.py --port /dev/ttyUSB0 --save dump.bin
+
+Times are seconds since the boot the record belongs to. A new boot starts at
+every battery keyframe carrying the boot marker.
+"""
+import argparse
+import sys
+
+HEADER_SIZE = 8
+RECORD_SIZE = 4
+KINDS = ("key_battery", "key_temp", "delta", "event")
+STATES = ("operating", "charging", "low_battery", "?")
+
+
+def int8(value):
+    return value - 256 if value & 0x80 else value
+
+
+def int16(hi, lo):
+    value = (hi << 8) | lo
+    return value - 65536 if value & 0x8000 else value
+
+
+def read_dump(data):
+    if len(data) < HEADER_SIZE or data[:4] != b"TLOG":
+        raise ValueError("not a telemetry dump (missing TLOG header)")
+    version, slots = data[4], data[5]
+    if version != 1:
+        raise ValueError("unsupported log format version %d" % version)
+    interval = (data[6] << 8) | data[7]
+    body = data[HEADER_SIZE:HEADER_SIZE + slots * RECORD_SIZE]
+    if len(body) != slots * RECORD_SIZE:
+        raise ValueError("truncated dump: %d of %d record bytes"
+                         % (len(body), slots * RECORD_SIZE))
+    return interval, [body[i:i + RECORD_SIZE] for i in range(0, len(body), RECORD_SIZE)]
+
+
+def decode(interval, records):
+    """Yield one dict per sample, oldest first. A keyframe pair yields a single
+    row. Records before the first complete keyframe are skipped because their
+    deltas have no base."""
+    boot = 0
+    time = battery = temp = None
+    for header, a, b, c in records:
+        if header == 0xFF:
+            continue  # never written
+        kind = KINDS[(header >> 5) & 0x03]
+        if kind == "key_battery":
+            if c & 0x80:
+                boot += 1
+                time = 0
+            elif time is not None:
+                time += interval
+            battery, temp = (a << 8) | b, None
+            continue
+        if kind == "key_temp":
+            temp = int16(a, b)
+        elif kind == "delta":
+            if time is None or battery is None or temp is None:
+                continue
+            time += interval
+            battery += int8(a)
+            temp += int8(b)
+        if time is None or battery is None or temp is None:
+            continue
+        yield {
+            "boot": boot,
+            "time_s": time + ((a << 8) | b) if kind == "event" else time,
+            "kind": kind,
+            "state": STATES[(header >> 3) & 0x03],
+            "lamp_on": header & 1,
+            "warn": (header >> 1) & 1,
+            "critical": (header >> 2) & 1,
+            "brightness": c & 0x7F,
+            "battery_mv": battery * 10,
+            "temp_c": temp / 10.0,
+        }
+
+
+def fetch(port, baud, timeout):
+    from lampctl import Lamp
+
+    with Lamp(port, baud) as lamp:
+        return lamp.dump_log(timeout)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", nargs="?", help="raw dump file")
+    parser.add_argument("--port", help="serial port of the lamp")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--timeout", type=float, default=3.0)
+    parser.add_argument("--save", help="also write the raw dump to this file")
+    args = parser.parse_args()
+
+    if args.port:
+        data = fetch(args.port, args.baud, args.timeout)
+    elif args.dump:
+        with open(args.dump, "rb") as f:
+            data = f.read()
+    else:
+        parser.error("give a dump file or --port")
+    if args.save:
+        with open(args.save, "wb") as f:
+            f.write(data)
+
+    interval, records = read_dump(data)
+    columns = ("boot", "time_s", "kind", "state", "lamp_on", "warn", "critical",
+               "brightness", "battery_mv", "temp_c")
+    print(",".join(columns))
+    for row in decode(interval, records):
+        print(",".join(str(row[c]) for c in columns))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())